@@ -0,0 +1,403 @@
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <memory>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "gl_stats.hpp"
+#include "headless.hpp"
+#include "heightmap.hpp"
+#include "image_write.hpp"
+#include "terrain.hpp"
+#include "trace.hpp"
+#include "work_queue.hpp"
+
+/**
+ * Batch map generation for dataset production.
+ *
+ * Maps flow through three stages connected by bounded queues:
+ *      generate (create_heightmap on a thread pool)
+ *      render   (shade_map on a thread pool, or StepShadow.fs on a single
+ *                headless GL context with --gl)
+ *      encode   (PNG + metadata writers on another pool)
+ */
+
+struct MapParams {
+        unsigned seed;
+        glm::vec3 sun_dir;
+};
+
+struct MapJob {
+        size_t index;
+        MapParams params;
+        Heightmap heightmap;
+        std::vector<unsigned char> image;
+        double generate_ms{};
+        double render_ms{};
+};
+
+using JobPtr = std::unique_ptr<MapJob>;
+
+struct BatchOptions {
+        std::string seeds_path;
+        unsigned first_seed{0};
+        int count{16};
+        glm::vec3 sun_dir{1.0, 0.0, -1.0};
+        int map_size{1024};
+        int image_size{1024};
+        std::string out_dir{"maps"};
+        int generate_threads{0};
+        int render_threads{0};
+        int encode_threads{0};
+        size_t queue_capacity{4};
+        bool gl{false};
+};
+
+static double ms_since(std::chrono::steady_clock::time_point start) {
+        return std::chrono::duration<double, std::milli>(
+                       std::chrono::steady_clock::now() - start)
+                .count();
+}
+
+static void print_usage(const char *name) {
+        std::cout
+                << "Usage: " << name << " [options]\n"
+                << "  --seeds FILE        one map per line: seed [x,y,z]\n"
+                << "  --count N           maps to generate without a seed "
+                   "file (16)\n"
+                << "  --first-seed N      first seed without a seed file (0)\n"
+                << "  --sun x,y,z         default sun direction (1,0,-1)\n"
+                << "  --map-size N        heightmap resolution (1024)\n"
+                << "  --image-size N      shaded image resolution (1024)\n"
+                << "  --out DIR           output directory (maps)\n"
+                << "  --generate-threads N\n"
+                << "  --render-threads N\n"
+                << "  --encode-threads N\n"
+                << "  --queue N           capacity of each stage queue (4)\n"
+                << "  --gl                render on a headless GL context\n";
+}
+
+static bool parse_vec3(const char *s, glm::vec3 &v) {
+        return std::sscanf(s, "%f,%f,%f", &v.x, &v.y, &v.z) == 3;
+}
+
+static bool parse_options(int argc, char **argv, BatchOptions &options) {
+        for (int i = 1; i < argc; i++) {
+                const char *arg = argv[i];
+                bool has_value = i + 1 < argc;
+                if (std::strcmp(arg, "--gl") == 0) {
+                        options.gl = true;
+                } else if (!has_value) {
+                        print_usage(argv[0]);
+                        return false;
+                } else if (std::strcmp(arg, "--seeds") == 0) {
+                        options.seeds_path = argv[++i];
+                } else if (std::strcmp(arg, "--count") == 0) {
+                        options.count = std::stoi(argv[++i]);
+                } else if (std::strcmp(arg, "--first-seed") == 0) {
+                        options.first_seed = std::stoul(argv[++i]);
+                } else if (std::strcmp(arg, "--sun") == 0) {
+                        if (!parse_vec3(argv[++i], options.sun_dir)) {
+                                std::cout << "--sun expects x,y,z\n";
+                                return false;
+                        }
+                } else if (std::strcmp(arg, "--map-size") == 0) {
+                        options.map_size = std::stoi(argv[++i]);
+                } else if (std::strcmp(arg, "--image-size") == 0) {
+                        options.image_size = std::stoi(argv[++i]);
+                } else if (std::strcmp(arg, "--out") == 0) {
+                        options.out_dir = argv[++i];
+                } else if (std::strcmp(arg, "--generate-threads") == 0) {
+                        options.generate_threads = std::stoi(argv[++i]);
+                } else if (std::strcmp(arg, "--render-threads") == 0) {
+                        options.render_threads = std::stoi(argv[++i]);
+                } else if (std::strcmp(arg, "--encode-threads") == 0) {
+                        options.encode_threads = std::stoi(argv[++i]);
+                } else if (std::strcmp(arg, "--queue") == 0) {
+                        options.queue_capacity =
+                                std::max(0, std::stoi(argv[++i]));
+                } else {
+                        print_usage(argv[0]);
+                        return false;
+                }
+        }
+        return true;
+}
+
+static bool parse_args(int argc, char **argv, BatchOptions &options) {
+        /* std::stoi and friends throw invalid_argument or out_of_range, both
+         * logic_errors, on values that aren't numbers */
+        try {
+                if (!parse_options(argc, argv, options)) {
+                        return false;
+                }
+        } catch (const std::logic_error &) {
+                print_usage(argv[0]);
+                return false;
+        }
+        if (options.map_size < 1 || options.image_size < 1 ||
+            options.queue_capacity < 1) {
+                std::cout << "Sizes and queue capacity must be at least 1\n";
+                return false;
+        }
+        return true;
+}
+
+static bool read_params(const BatchOptions &options,
+                        std::vector<MapParams> &params) {
+        if (options.seeds_path.empty()) {
+                for (int i = 0; i < options.count; i++) {
+                        params.push_back({options.first_seed + i,
+                                          options.sun_dir});
+                }
+                return true;
+        }
+
+        std::ifstream file{options.seeds_path};
+        if (!file.is_open()) {
+                std::cout << "Failed to open seed file at path: "
+                          << options.seeds_path << "\n";
+                return false;
+        }
+        std::string line;
+        while (std::getline(file, line)) {
+                std::istringstream ss{line};
+                std::string seed, sun;
+                if (!(ss >> seed) || seed[0] == '#') {
+                        continue;
+                }
+                MapParams p{0, options.sun_dir};
+                try {
+                        p.seed = static_cast<unsigned>(std::stoul(seed));
+                } catch (const std::logic_error &) {
+                        std::cout << "Bad seed in seed file: " << seed << "\n";
+                        return false;
+                }
+                if (ss >> sun && !parse_vec3(sun.c_str(), p.sun_dir)) {
+                        std::cout << "Bad sun direction in seed file: " << sun
+                                  << "\n";
+                        return false;
+                }
+                params.push_back(p);
+        }
+        return true;
+}
+
+static bool write_metadata(const std::string &path, const MapJob &job,
+                           const BatchOptions &options) {
+        int land = 0;
+        int peak = 0;
+        double sum = 0.0;
+        for (unsigned char h : job.heightmap.data) {
+                land += h > 0;
+                peak = std::max(peak, static_cast<int>(h));
+                sum += h;
+        }
+        double cells = static_cast<double>(job.heightmap.data.size());
+
+        std::ofstream file{path};
+        glm::vec3 sun = job.params.sun_dir;
+        file << "{\n"
+             << "  \"seed\": " << job.params.seed << ",\n"
+             << "  \"sun_dir\": [" << sun.x << ", " << sun.y << ", " << sun.z
+             << "],\n"
+             << "  \"map_size\": " << options.map_size << ",\n"
+             << "  \"image_size\": " << options.image_size << ",\n"
+             << "  \"renderer\": \"" << (options.gl ? "gl" : "cpu") << "\",\n"
+             << "  \"land_fraction\": " << land / cells << ",\n"
+             << "  \"mean_height\": " << sum / cells / 255.0 << ",\n"
+             << "  \"max_height\": " << peak / 255.0 << ",\n"
+             << "  \"generate_ms\": " << job.generate_ms << ",\n"
+             << "  \"render_ms\": " << job.render_ms << "\n"
+             << "}\n";
+        file.close();
+        return !file.fail();
+}
+
+static bool encode(const MapJob &job, const BatchOptions &options) {
+        TRACE_FUNCTION();
+        char name[64];
+        std::snprintf(name, sizeof(name), "/%05zu_%u", job.index,
+                      job.params.seed);
+        std::string base = options.out_dir + name;
+
+        /* Heightmap rows run bottom up like the GL texture */
+        int size = options.map_size;
+        const std::vector<unsigned char> &rows = job.heightmap.data;
+        std::vector<unsigned char> flipped(rows.size());
+        for (int y = 0; y < size; y++) {
+                std::copy(rows.begin() + (size - 1 - y) * size,
+                          rows.begin() + (size - y) * size,
+                          flipped.begin() + y * size);
+        }
+        if (!write_png(base + "_height.png", flipped.data(), size, size, 1) ||
+            !write_png(base + "_shaded.png", job.image.data(),
+                       options.image_size, options.image_size, 3) ||
+            !write_metadata(base + ".json", job, options)) {
+                std::cout << "Failed to write map " << base << "\n";
+                return false;
+        }
+        return true;
+}
+
+int main(int argc, char **argv) {
+        BatchOptions options{};
+        if (!parse_args(argc, argv, options)) {
+                return -1;
+        }
+
+        std::vector<MapParams> params;
+        if (!read_params(options, params)) {
+                return -1;
+        }
+
+        int cores = std::max(1u, std::thread::hardware_concurrency());
+        if (options.generate_threads <= 0) {
+                options.generate_threads = std::max(1, cores / 2);
+        }
+        if (options.render_threads <= 0 || options.gl) {
+                options.render_threads =
+                        options.gl ? 1 : std::max(1, cores / 2);
+        }
+        if (options.encode_threads <= 0) {
+                options.encode_threads = std::max(1, cores / 4);
+        }
+
+        std::error_code error;
+        std::filesystem::create_directories(options.out_dir, error);
+        if (error) {
+                std::cout << "Failed to create output directory "
+                          << options.out_dir << ": " << error.message()
+                          << "\n";
+                return -1;
+        }
+
+        TRACE_BEGIN_SESSION("batch_trace.json");
+        TRACE_THREAD_NAME("main");
+
+        WorkQueue<JobPtr> render_queue{options.queue_capacity};
+        WorkQueue<JobPtr> encode_queue{options.queue_capacity};
+        std::atomic<size_t> next_job{0};
+        std::atomic<int> generators_left{options.generate_threads};
+        std::atomic<int> renderers_left{options.render_threads};
+        std::atomic<size_t> maps_done{0};
+        std::atomic<size_t> maps_failed{0};
+
+        auto start = std::chrono::steady_clock::now();
+
+        auto generate = [&] {
+                TRACE_THREAD_NAME("generate");
+                size_t i;
+                int size = options.map_size;
+                while ((i = next_job++) < params.size()) {
+                        auto t = std::chrono::steady_clock::now();
+                        JobPtr job = std::make_unique<MapJob>();
+                        job->index = i;
+                        job->params = params[i];
+                        job->heightmap =
+                                create_heightmap(size, size, job->params.seed);
+                        job->generate_ms = ms_since(t);
+                        render_queue.push(std::move(job));
+                }
+                if (--generators_left == 0) {
+                        render_queue.close();
+                }
+        };
+
+        auto render_cpu = [&] {
+                TRACE_THREAD_NAME("render");
+                JobPtr job;
+                int size = options.image_size;
+                while (render_queue.pop(job)) {
+                        auto t = std::chrono::steady_clock::now();
+                        job->image.resize(static_cast<size_t>(size) * size * 3);
+                        shade_map(job->heightmap,
+                                  glm::normalize(job->params.sun_dir),
+                                  job->image.data(), size, size);
+                        job->render_ms = ms_since(t);
+                        encode_queue.push(std::move(job));
+                }
+                if (--renderers_left == 0) {
+                        encode_queue.close();
+                }
+        };
+
+        auto encode_worker = [&] {
+                TRACE_THREAD_NAME("encode");
+                JobPtr job;
+                while (encode_queue.pop(job)) {
+                        if (encode(*job, options)) {
+                                maps_done++;
+                        } else {
+                                maps_failed++;
+                        }
+                }
+        };
+
+        std::vector<std::thread> threads;
+        for (int i = 0; i < options.generate_threads; i++) {
+                threads.emplace_back(generate);
+        }
+        for (int i = 0; i < options.encode_threads; i++) {
+                threads.emplace_back(encode_worker);
+        }
+
+        /* GL contexts are tied to one thread, so that stage runs on main */
+        if (options.gl) {
+                GLFWwindow *window = create_headless_context();
+                JobPtr job;
+                if (window != NULL) {
+                        int size = options.image_size;
+                        OffscreenRenderer renderer{size, size};
+                        while (render_queue.pop(job)) {
+                                auto t = std::chrono::steady_clock::now();
+                                job->image.resize(static_cast<size_t>(size) *
+                                                  size * 3);
+                                renderer.render(
+                                        job->heightmap,
+                                        glm::normalize(job->params.sun_dir),
+                                        job->image.data());
+                                /* One map is one frame, for the budgets */
+                                GLStats::instance().end_frame();
+                                job->render_ms = ms_since(t);
+                                encode_queue.push(std::move(job));
+                        }
+                }
+                /* Drain so the generators can finish if GL failed */
+                while (render_queue.pop(job)) {
+                }
+                encode_queue.close();
+                if (window != NULL) {
+                        glfwTerminate();
+                }
+        } else {
+                for (int i = 0; i < options.render_threads; i++) {
+                        threads.emplace_back(render_cpu);
+                }
+        }
+
+        for (std::thread &t : threads) {
+                t.join();
+        }
+        TRACE_END_SESSION();
+
+        double seconds = ms_since(start) / 1000.0;
+        std::cout << "Wrote " << maps_done << " maps to " << options.out_dir
+                  << " in " << seconds << "s (" << maps_done / seconds
+                  << " maps/s) using " << options.generate_threads
+                  << " generate, " << options.render_threads << " render and "
+                  << options.encode_threads << " encode threads\n";
+        if (maps_failed > 0) {
+                std::cout << maps_failed << " maps failed to write\n";
+        }
+        return maps_done == params.size() ? 0 : -1;
+}
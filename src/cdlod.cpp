@@ -0,0 +1,124 @@
+#include "cdlod.hpp"
+#include "terrain.hpp"
+#include "trace.hpp"
+
+#include <limits>
+
+/* Distance from p to the closest point of the box */
+static float box_distance(glm::vec3 p, glm::vec3 min, glm::vec3 max) {
+        return glm::length(glm::max(glm::max(min - p, p - max), 0.0f));
+}
+
+CdlodQuadtree::CdlodQuadtree(const Heightmap &map, float leaf_range) {
+        TRACE_FUNCTION();
+        /* Leaves take the texels under their vertices, edges included */
+        Level leaves;
+        leaves.size = CDLOD_LEAF_SIZE;
+        leaves.nodes_x = (map.width + CDLOD_LEAF_SIZE - 1) / CDLOD_LEAF_SIZE;
+        leaves.nodes_z = (map.height + CDLOD_LEAF_SIZE - 1) / CDLOD_LEAF_SIZE;
+        leaves.heights.resize(static_cast<size_t>(leaves.nodes_x) *
+                              leaves.nodes_z);
+        for (int nz = 0; nz < leaves.nodes_z; nz++) {
+                for (int nx = 0; nx < leaves.nodes_x; nx++) {
+                        int x0 = nx * CDLOD_LEAF_SIZE;
+                        int z0 = nz * CDLOD_LEAF_SIZE;
+                        int x1 = std::min(x0 + CDLOD_LEAF_SIZE, map.width - 1);
+                        int z1 = std::min(z0 + CDLOD_LEAF_SIZE,
+                                          map.height - 1);
+                        unsigned char low = 255, high = 0;
+                        for (int z = z0; z <= z1; z++) {
+                                for (int x = x0; x <= x1; x++) {
+                                        low = std::min(low, map.at(x, z));
+                                        high = std::max(high, map.at(x, z));
+                                }
+                        }
+                        const float scale = TERRAIN_HEIGHT_SCALE / 255.0f;
+                        leaves.heights[nz * leaves.nodes_x + nx] = {
+                                low * scale, high * scale};
+                }
+        }
+        bounds.push_back(std::move(leaves));
+
+        while (bounds.back().nodes_x > 1 || bounds.back().nodes_z > 1) {
+                const Level &child = bounds.back();
+                Level parent;
+                parent.size = child.size * 2;
+                parent.nodes_x = (child.nodes_x + 1) / 2;
+                parent.nodes_z = (child.nodes_z + 1) / 2;
+                parent.heights.assign(
+                        static_cast<size_t>(parent.nodes_x) * parent.nodes_z,
+                        glm::vec2(std::numeric_limits<float>::max(),
+                                  std::numeric_limits<float>::lowest()));
+                for (int nz = 0; nz < child.nodes_z; nz++) {
+                        for (int nx = 0; nx < child.nodes_x; nx++) {
+                                glm::vec2 h = child.heights[nz * child.nodes_x +
+                                                            nx];
+                                glm::vec2 &p =
+                                        parent.heights[nz / 2 *
+                                                               parent.nodes_x +
+                                                       nx / 2];
+                                p = {std::min(p.x, h.x), std::max(p.y, h.y)};
+                        }
+                }
+                bounds.push_back(std::move(parent));
+        }
+
+        float range = leaf_range * CDLOD_LEAF_SIZE;
+        for (size_t level = 0; level + 1 < bounds.size(); level++) {
+                ranges.push_back(range);
+                range *= 2.0f;
+        }
+        ranges.push_back(std::numeric_limits<float>::max());
+}
+
+glm::vec2 CdlodQuadtree::morph_range(int level) const {
+        float previous = level > 0 ? ranges[level - 1] : 0.0f;
+        float end = ranges[level];
+        if (level + 1 == levels()) {
+                /* Nothing coarser to morph into */
+                return {end, end};
+        }
+        return {previous + (end - previous) * CDLOD_MORPH_START, end};
+}
+
+void CdlodQuadtree::select(glm::vec3 camera, const Frustum &frustum,
+                           std::vector<CdlodNode> &selection) const {
+        TRACE_FUNCTION();
+        select_node(levels() - 1, 0, 0, camera, frustum, selection);
+}
+
+bool CdlodQuadtree::select_node(int level, int nx, int nz, glm::vec3 camera,
+                                const Frustum &frustum,
+                                std::vector<CdlodNode> &selection) const {
+        const Level &node = bounds[level];
+        if (nx >= node.nodes_x || nz >= node.nodes_z) {
+                /* Past the edge of a map that isn't a power of two */
+                return true;
+        }
+        glm::vec2 heights = node.heights[nz * node.nodes_x + nx];
+        glm::vec3 min{nx * node.size, heights.x, nz * node.size};
+        glm::vec3 max{(nx + 1) * node.size, heights.y, (nz + 1) * node.size};
+        if (box_distance(camera, min, max) > ranges[level]) {
+                return false;
+        }
+        if (!frustum.intersects_box(min, max)) {
+                return true;
+        }
+
+        uint8_t quarters = CDLOD_ALL_QUARTERS;
+        if (level > 0 && box_distance(camera, min, max) <= ranges[level - 1]) {
+                for (int i = 0; i < 4; i++) {
+                        if (select_node(level - 1, nx * 2 + (i & 1),
+                                        nz * 2 + (i >> 1), camera, frustum,
+                                        selection)) {
+                                quarters &= ~(1 << i);
+                        }
+                }
+        }
+        if (quarters != 0) {
+                selection.push_back({static_cast<int>(min.x),
+                                     static_cast<int>(min.z), node.size,
+                                     level, quarters});
+        }
+        return true;
+}
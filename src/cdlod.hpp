@@ -0,0 +1,90 @@
+#ifndef CDLOD_H
+#define CDLOD_H
+
+#include <glm/glm.hpp>
+
+#include <cstdint>
+#include <vector>
+
+#include "frustum.hpp"
+#include "heightmap.hpp"
+
+/**
+ * Continuous distance-dependent level of detail (Strugar's CDLOD) for the
+ * 3D terrain.
+ *
+ * The map is covered by a quadtree whose leaves are CDLOD_LEAF_SIZE texels
+ * wide. Every node is drawn with the same grid of CDLOD_GRID quads, so a
+ * leaf has one vertex per texel and each level up halves the density.
+ * Level l is used within ranges[l] of the camera, measured to the node's
+ * bounding box, and the top level everywhere else. The last stretch of each
+ * range morphs the grid into the one of the next level, which removes both
+ * popping and cracks: where a node meets a coarser neighbour the camera is
+ * past its range, so its edge vertices have fully morphed.
+ *
+ * A node partly within the finer range hands those quarters to its
+ * children and keeps the rest, so the selection is a list of nodes with a
+ * mask of the quarters to draw. Boxes come from the min and max height of
+ * every node, and nodes outside the frustum are dropped on the way down.
+ * The number of nodes, and of triangles, depends on the ranges and not on
+ * the size of the map.
+ *
+ * Positions are in terrain world units, as in scatter.hpp.
+ */
+
+const int CDLOD_GRID = 32;
+const int CDLOD_LEAF_SIZE = 32;
+/* Ranges double every level, the finest one covers this many leaves. At
+ * least two keep neighbours within one level of each other. */
+const float CDLOD_LEAF_RANGE = 4.0f;
+/* Fraction of each range before morphing starts */
+const float CDLOD_MORPH_START = 0.7f;
+
+/* Quarter masks, x grows along bit 0 and z along bit 1 */
+const uint8_t CDLOD_ALL_QUARTERS = 0xf;
+
+struct CdlodNode {
+        /* Corner with the lowest x and z, and width in world units */
+        int x;
+        int z;
+        int size;
+        int level;
+        uint8_t quarters;
+};
+
+class CdlodQuadtree {
+      public:
+        CdlodQuadtree(const Heightmap &map,
+                      float leaf_range = CDLOD_LEAF_RANGE);
+
+        int levels() const { return static_cast<int>(bounds.size()); }
+
+        /* Distance up to which level is used, the last one is unbounded */
+        float range(int level) const { return ranges[level]; }
+
+        /* Distances over which level morphs into level + 1 */
+        glm::vec2 morph_range(int level) const;
+
+        /* Appends the nodes to draw, children before their parents */
+        void select(glm::vec3 camera, const Frustum &frustum,
+                    std::vector<CdlodNode> &selection) const;
+
+      private:
+        struct Level {
+                int size;
+                int nodes_x;
+                int nodes_z;
+                /* Min and max world height of each node */
+                std::vector<glm::vec2> heights;
+        };
+        std::vector<Level> bounds;
+        std::vector<float> ranges;
+
+        /* True when the node is dealt with, drawn or culled, and false
+         * when it is out of its range and the parent has to draw it */
+        bool select_node(int level, int nx, int nz, glm::vec3 camera,
+                         const Frustum &frustum,
+                         std::vector<CdlodNode> &selection) const;
+};
+
+#endif /* CDLOD_H */
@@ -0,0 +1,113 @@
+#include "cdlod_renderer.hpp"
+#include "gl_state.hpp"
+#include "gl_stats.hpp"
+#include "renderer.hpp"
+#include "terrain.hpp"
+#include "trace.hpp"
+
+/* Indices of one quarter of the grid */
+static const GLsizei QUARTER_INDICES = (CDLOD_GRID / 2) * (CDLOD_GRID / 2) * 6;
+
+CdlodRenderer::CdlodRenderer(const Heightmap &map, GLuint heightmap_texture)
+        : shader{"src/shaders/Cdlod.vs", "src/shaders/Terrain.fs"},
+          tree{map}, heightmap{heightmap_texture},
+          map_size{map.width, map.height} {
+        TRACE_FUNCTION();
+        const int row = CDLOD_GRID + 1;
+        std::vector<glm::vec2> vertices;
+        for (int z = 0; z < row; z++) {
+                for (int x = 0; x < row; x++) {
+                        vertices.push_back(glm::vec2(x, z) /
+                                           static_cast<float>(CDLOD_GRID));
+                }
+        }
+        std::vector<GLuint> indices;
+        const int half = CDLOD_GRID / 2;
+        for (int quarter = 0; quarter < 4; quarter++) {
+                int x0 = (quarter & 1) * half, z0 = (quarter >> 1) * half;
+                for (int z = z0; z < z0 + half; z++) {
+                        for (int x = x0; x < x0 + half; x++) {
+                                GLuint corner = z * row + x;
+                                indices.insert(indices.end(),
+                                               {corner, corner + row,
+                                                corner + 1, corner + 1,
+                                                corner + row,
+                                                corner + row + 1});
+                        }
+                }
+        }
+
+        GLState &state = GLState::instance();
+        glGenVertexArrays(1, &VAO);
+        glGenBuffers(1, &VBO);
+        glGenBuffers(1, &EBO);
+        state.bind_vertex_array(VAO);
+        state.bind_buffer(GL_ARRAY_BUFFER, VBO);
+        buffer_data(GL_ARRAY_BUFFER, vertices.size() * sizeof(glm::vec2),
+                    vertices.data(), GL_STATIC_DRAW);
+        state.bind_buffer(GL_ELEMENT_ARRAY_BUFFER, EBO);
+        buffer_data(GL_ELEMENT_ARRAY_BUFFER, indices.size() * sizeof(GLuint),
+                    indices.data(), GL_STATIC_DRAW);
+        glEnableVertexAttribArray(0);
+        glVertexAttribPointer(0, 2, GL_FLOAT, GL_FALSE, sizeof(glm::vec2),
+                              (void *)0);
+
+        set_terrain_uniforms(shader);
+        shader.set_uniform("map_size", map_size);
+        shader.set_uniform("height_scale", TERRAIN_HEIGHT_SCALE);
+        shader.set_uniform("grid_size", static_cast<float>(CDLOD_GRID));
+        shader.set_uniform("heightmap", 0);
+}
+
+CdlodRenderer::~CdlodRenderer() {
+        GLState &state = GLState::instance();
+        state.delete_vertex_array(VAO);
+        state.delete_buffer(VBO);
+        state.delete_buffer(EBO);
+}
+
+void CdlodRenderer::draw(const glm::mat4 &view, const glm::mat4 &projection,
+                         glm::vec3 camera, glm::vec3 sun_dir) {
+        TRACE_FUNCTION();
+        nodes.clear();
+        tree.select(camera, Frustum{projection * view}, nodes);
+
+        GLState &state = GLState::instance();
+        shader.use();
+        glm::mat4 view_matrix = view, projection_matrix = projection;
+        shader.set_uniform("view", view_matrix);
+        shader.set_uniform("projection", projection_matrix);
+        shader.set_uniform("camera_position", camera);
+        shader.set_uniform("sun_dir", sun_dir);
+        state.bind_texture(0, GL_TEXTURE_2D, heightmap);
+        state.bind_vertex_array(VAO);
+
+        for (const CdlodNode &node : nodes) {
+                glm::vec2 morph = tree.morph_range(node.level);
+                shader.set_uniform("node_offset", static_cast<float>(node.x),
+                                   static_cast<float>(node.z));
+                shader.set_uniform("node_size",
+                                   static_cast<float>(node.size));
+                shader.set_uniform("morph_range", morph);
+                /* Runs of neighbouring quarters are contiguous indices */
+                for (int first = 0; first < 4;) {
+                        if (!(node.quarters & (1 << first))) {
+                                first++;
+                                continue;
+                        }
+                        int last = first;
+                        while (last + 1 < 4 &&
+                               (node.quarters & (1 << (last + 1)))) {
+                                last++;
+                        }
+                        draw_elements_base_vertex(
+                                GL_TRIANGLES,
+                                (last - first + 1) * QUARTER_INDICES,
+                                GL_UNSIGNED_INT,
+                                (void *)(first * QUARTER_INDICES *
+                                         sizeof(GLuint)),
+                                0);
+                        first = last + 1;
+                }
+        }
+}
@@ -0,0 +1,48 @@
+#ifndef CDLOD_RENDERER_H
+#define CDLOD_RENDERER_H
+
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+
+#include <vector>
+
+#include "cdlod.hpp"
+#include "heightmap.hpp"
+#include "shader.hpp"
+
+/**
+ * Draws the terrain in 3D with a CdlodQuadtree. Every node shares one grid
+ * of CDLOD_GRID by CDLOD_GRID quads in [0, 1], whose indices are sorted by
+ * quarter so a node missing some quarters still draws in at most two
+ * calls. Cdlod.vs places the grid over the node, morphs it by distance and
+ * displaces it with the heightmap texture, Terrain.fs colors it by height
+ * band and lights it from sun_dir, given the way StepShadow.fs takes it.
+ *
+ * Selection and culling run on the CPU every draw, the GPU only ever sees
+ * the grid and a few uniforms per node. Owns its GL objects but not the
+ * heightmap texture.
+ */
+class CdlodRenderer {
+      public:
+        Shader shader;
+
+        CdlodRenderer(const Heightmap &map, GLuint heightmap_texture);
+        ~CdlodRenderer();
+        CdlodRenderer(const CdlodRenderer &) = delete;
+        CdlodRenderer &operator=(const CdlodRenderer &) = delete;
+
+        void draw(const glm::mat4 &view, const glm::mat4 &projection,
+                  glm::vec3 camera, glm::vec3 sun_dir);
+
+        /* Nodes of the last draw */
+        const std::vector<CdlodNode> &selection() const { return nodes; }
+
+      private:
+        CdlodQuadtree tree;
+        GLuint heightmap;
+        glm::vec2 map_size;
+        GLuint VAO{0}, VBO{0}, EBO{0};
+        std::vector<CdlodNode> nodes;
+};
+
+#endif /* CDLOD_RENDERER_H */
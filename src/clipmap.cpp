@@ -0,0 +1,51 @@
+#include "clipmap.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
+
+glm::ivec2 clipmap_origin(glm::vec2 camera, int level) {
+        float spacing = std::ldexp(1.0f, level);
+        glm::ivec2 center =
+                glm::ivec2(glm::floor(camera / (2.0f * spacing))) * 2;
+        return center - CLIPMAP_GRID / 2;
+}
+
+void exposed_rects(glm::ivec2 from, glm::ivec2 to, int size,
+                   std::vector<TexelRect> &rects) {
+        glm::ivec2 shift = to - from;
+        if (std::abs(shift.x) >= size || std::abs(shift.y) >= size) {
+                rects.push_back({to.x, to.y, size, size});
+                return;
+        }
+        /* Columns over the full height, then rows beside them */
+        int columns_x = shift.x > 0 ? from.x + size : to.x;
+        int rows_x = shift.x > 0 ? to.x : to.x - shift.x;
+        if (shift.x != 0) {
+                rects.push_back({columns_x, to.y, std::abs(shift.x), size});
+        }
+        if (shift.y != 0) {
+                int rows_z = shift.y > 0 ? from.y + size : to.y;
+                rects.push_back({rows_x, rows_z, size - std::abs(shift.x),
+                                 std::abs(shift.y)});
+        }
+}
+
+void toroidal_rects(const TexelRect &rect, int size,
+                    std::vector<TexelRect> &pieces) {
+        int x_split = size - wrap_texel(rect.x, size);
+        int z_split = size - wrap_texel(rect.z, size);
+        int widths[2] = {std::min(rect.width, x_split),
+                         rect.width - std::min(rect.width, x_split)};
+        int heights[2] = {std::min(rect.height, z_split),
+                          rect.height - std::min(rect.height, z_split)};
+        for (int j = 0; j < 2; j++) {
+                for (int i = 0; i < 2; i++) {
+                        if (widths[i] > 0 && heights[j] > 0) {
+                                pieces.push_back({rect.x + i * widths[0],
+                                                  rect.z + j * heights[0],
+                                                  widths[i], heights[j]});
+                        }
+                }
+        }
+}
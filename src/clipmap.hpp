@@ -0,0 +1,60 @@
+#ifndef CLIPMAP_H
+#define CLIPMAP_H
+
+#include <glm/glm.hpp>
+
+#include <vector>
+
+/**
+ * Window bookkeeping of geometry clipmaps (Losasso and Hoppe), the GL
+ * side is ClipmapRenderer.
+ *
+ * Level l is a grid of CLIPMAP_GRID quads, 2^l world units apart, centered
+ * on the camera. Its origin snaps to every other vertex, so it always
+ * lies on the grid of level l + 1, where it cuts a hole of half the size.
+ * The heights under a level live in a window of CLIPMAP_WINDOW texels,
+ * one more than the vertices on each side for the normals, stored in a
+ * texture of CLIPMAP_TEXELS that wraps around: level texel x, z is at
+ * x mod CLIPMAP_TEXELS, z mod CLIPMAP_TEXELS. As the window slides only
+ * the strips it newly covers are read and uploaded, and the texture never
+ * has to move.
+ *
+ * Coordinates here are level texels, see HeightSource.
+ */
+
+/* Quads per side of a level, a multiple of four so the origin of a level
+ * falls on the coarser grid and the hole on whole quads */
+const int CLIPMAP_GRID = 252;
+const int CLIPMAP_WINDOW = CLIPMAP_GRID + 3;
+const int CLIPMAP_TEXELS = 256;
+const int CLIPMAP_MAX_LEVELS = 16;
+
+struct TexelRect {
+        int x;
+        int z;
+        int width;
+        int height;
+};
+
+/* First vertex of level with the camera above world position camera */
+glm::ivec2 clipmap_origin(glm::vec2 camera, int level);
+
+/* First texel of the window of a level whose first vertex is at origin */
+inline glm::ivec2 clipmap_window(glm::ivec2 origin) { return origin - 1; }
+
+/* Appends the parts of a square window of size texels at to that the one
+ * at from didn't cover, at most two rectangles that don't overlap */
+void exposed_rects(glm::ivec2 from, glm::ivec2 to, int size,
+                   std::vector<TexelRect> &rects);
+
+/* Appends rect cut where it wraps around a texture of size texels, the
+ * pieces keep level coordinates */
+void toroidal_rects(const TexelRect &rect, int size,
+                    std::vector<TexelRect> &pieces);
+
+/* Non-negative remainder, where a level texel lands in the texture */
+inline int wrap_texel(int texel, int size) {
+        return ((texel % size) + size) % size;
+}
+
+#endif /* CLIPMAP_H */
@@ -0,0 +1,199 @@
+#include "clipmap_renderer.hpp"
+#include "gl_state.hpp"
+#include "gl_stats.hpp"
+#include "renderer.hpp"
+#include "terrain.hpp"
+#include "trace.hpp"
+
+#include <algorithm>
+#include <cmath>
+
+static const int ROW_INDICES = CLIPMAP_GRID * 6;
+
+/* Enough levels that half the coarsest one spans the whole source */
+static int levels_for(const HeightSource &source) {
+        int size = std::max(source.width(), source.height());
+        int levels = 1;
+        while (levels < CLIPMAP_MAX_LEVELS &&
+               (CLIPMAP_GRID / 2 << (levels - 1)) < size) {
+                levels++;
+        }
+        return levels;
+}
+
+ClipmapRenderer::ClipmapRenderer(const HeightSource &source)
+        : shader{"src/shaders/Clipmap.vs", "src/shaders/Terrain.fs"},
+          source{source}, level_count{levels_for(source)},
+          level_state(level_count) {
+        TRACE_FUNCTION();
+        const int row = CLIPMAP_GRID + 1;
+        std::vector<glm::vec2> vertices;
+        for (int z = 0; z < row; z++) {
+                for (int x = 0; x < row; x++) {
+                        vertices.push_back(glm::vec2(x, z));
+                }
+        }
+        /* Row by row, so any span of quads in a row is one range */
+        std::vector<GLuint> indices;
+        for (int z = 0; z < CLIPMAP_GRID; z++) {
+                for (int x = 0; x < CLIPMAP_GRID; x++) {
+                        GLuint corner = z * row + x;
+                        indices.insert(indices.end(),
+                                       {corner, corner + row, corner + 1,
+                                        corner + 1, corner + row,
+                                        corner + row + 1});
+                }
+        }
+
+        GLState &state = GLState::instance();
+        glGenVertexArrays(1, &VAO);
+        glGenBuffers(1, &VBO);
+        glGenBuffers(1, &EBO);
+        state.bind_vertex_array(VAO);
+        state.bind_buffer(GL_ARRAY_BUFFER, VBO);
+        buffer_data(GL_ARRAY_BUFFER, vertices.size() * sizeof(glm::vec2),
+                    vertices.data(), GL_STATIC_DRAW);
+        state.bind_buffer(GL_ELEMENT_ARRAY_BUFFER, EBO);
+        buffer_data(GL_ELEMENT_ARRAY_BUFFER, indices.size() * sizeof(GLuint),
+                    indices.data(), GL_STATIC_DRAW);
+        glEnableVertexAttribArray(0);
+        glVertexAttribPointer(0, 2, GL_FLOAT, GL_FALSE, sizeof(glm::vec2),
+                              (void *)0);
+
+        glGenTextures(1, &texture);
+        state.bind_texture(GL_TEXTURE_2D_ARRAY, texture);
+        glTexImage3D(GL_TEXTURE_2D_ARRAY, 0, GL_R8, CLIPMAP_TEXELS,
+                     CLIPMAP_TEXELS, level_count, 0, GL_RED, GL_UNSIGNED_BYTE,
+                     NULL);
+        /* Wrapping is what makes the texture toroidal */
+        glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_S, GL_REPEAT);
+        glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_T, GL_REPEAT);
+        glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+        glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+
+        set_terrain_uniforms(shader);
+        shader.set_uniform("texels", static_cast<float>(CLIPMAP_TEXELS));
+        shader.set_uniform("grid_size", static_cast<float>(CLIPMAP_GRID));
+        shader.set_uniform("levels", level_count);
+        shader.set_uniform("height_scale", TERRAIN_HEIGHT_SCALE);
+        shader.set_uniform("clipmaps", 0);
+}
+
+ClipmapRenderer::~ClipmapRenderer() {
+        GLState &state = GLState::instance();
+        state.delete_texture(texture);
+        state.delete_vertex_array(VAO);
+        state.delete_buffer(VBO);
+        state.delete_buffer(EBO);
+}
+
+/* Slides the window of level to window, reading what it newly covers */
+void ClipmapRenderer::update(int level, glm::ivec2 window) {
+        Level &state = level_state[level];
+        rects.clear();
+        if (state.valid) {
+                exposed_rects(state.window, window, CLIPMAP_WINDOW, rects);
+        } else {
+                rects.push_back({window.x, window.y, CLIPMAP_WINDOW,
+                                 CLIPMAP_WINDOW});
+        }
+        state.window = window;
+        state.valid = true;
+
+        pieces.clear();
+        for (const TexelRect &rect : rects) {
+                toroidal_rects(rect, CLIPMAP_TEXELS, pieces);
+        }
+        if (pieces.empty()) {
+                return;
+        }
+        TRACE_SCOPE("clipmap_upload");
+        GLState::instance().bind_texture(GL_TEXTURE_2D_ARRAY, texture);
+        glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+        for (const TexelRect &piece : pieces) {
+                size_t size = static_cast<size_t>(piece.width) * piece.height;
+                texels.resize(size);
+                source.read(level, piece.x, piece.z, piece.width,
+                            piece.height, texels.data());
+                glTexSubImage3D(GL_TEXTURE_2D_ARRAY, 0,
+                                wrap_texel(piece.x, CLIPMAP_TEXELS),
+                                wrap_texel(piece.z, CLIPMAP_TEXELS), level,
+                                piece.width, piece.height, 1, GL_RED,
+                                GL_UNSIGNED_BYTE, texels.data());
+                GLStats::instance().count_upload(size);
+                uploaded_texels += size;
+        }
+}
+
+void ClipmapRenderer::draw(const glm::mat4 &view,
+                           const glm::mat4 &projection, glm::vec3 camera,
+                           glm::vec3 sun_dir) {
+        TRACE_FUNCTION();
+        /* A level narrower than 2.5 times the height adds nothing */
+        finest_level = 0;
+        while (finest_level + 1 < level_count &&
+               0.4f * std::ldexp(static_cast<float>(CLIPMAP_GRID),
+                                 finest_level) < camera.y) {
+                level_state[finest_level].valid = false;
+                finest_level++;
+        }
+
+        uploaded_texels = 0;
+        glm::vec2 position{camera.x, camera.z};
+        for (int level = finest_level; level < level_count; level++) {
+                Level &current = level_state[level];
+                current.origin = clipmap_origin(position, level);
+                update(level, clipmap_window(current.origin));
+        }
+
+        GLState &state = GLState::instance();
+        shader.use();
+        glm::mat4 view_matrix = view, projection_matrix = projection;
+        shader.set_uniform("view", view_matrix);
+        shader.set_uniform("projection", projection_matrix);
+        shader.set_uniform("sun_dir", sun_dir);
+        state.bind_texture(0, GL_TEXTURE_2D_ARRAY, texture);
+        state.bind_vertex_array(VAO);
+        for (int level = finest_level; level < level_count; level++) {
+                draw_level(level);
+        }
+}
+
+/* The whole grid for the finest level, the ring around the hole of the
+ * finer level otherwise */
+void ClipmapRenderer::draw_level(int level) {
+        glm::ivec2 origin = level_state[level].origin;
+        shader.set_uniform("level", level);
+        shader.set_uniform("origin", static_cast<float>(origin.x),
+                           static_cast<float>(origin.y));
+
+        counts.clear();
+        offsets.clear();
+        auto add = [&](int row, int first, int quads) {
+                if (quads > 0) {
+                        counts.push_back(quads * 6);
+                        offsets.push_back(reinterpret_cast<const void *>(
+                                (static_cast<size_t>(row) * ROW_INDICES +
+                                 first * 6) *
+                                sizeof(GLuint)));
+                }
+        };
+        if (level == finest_level) {
+                add(0, 0, CLIPMAP_GRID * CLIPMAP_GRID);
+        } else {
+                /* Finer origins are even, so the hole starts on a quad */
+                glm::ivec2 hole = level_state[level - 1].origin / 2 - origin;
+                const int size = CLIPMAP_GRID / 2;
+                add(0, 0, hole.y * CLIPMAP_GRID);
+                for (int z = hole.y; z < hole.y + size; z++) {
+                        add(z, 0, hole.x);
+                        add(z, hole.x + size, CLIPMAP_GRID - hole.x - size);
+                }
+                add(hole.y + size, 0,
+                    (CLIPMAP_GRID - hole.y - size) * CLIPMAP_GRID);
+        }
+        base_vertices.assign(counts.size(), 0);
+        multi_draw_elements_base_vertex(GL_TRIANGLES, counts.data(),
+                                        GL_UNSIGNED_INT, offsets.data(),
+                                        counts.size(), base_vertices.data());
+}
@@ -0,0 +1,74 @@
+#ifndef CLIPMAP_RENDERER_H
+#define CLIPMAP_RENDERER_H
+
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+
+#include <cstddef>
+#include <vector>
+
+#include "clipmap.hpp"
+#include "height_source.hpp"
+#include "shader.hpp"
+
+/**
+ * Draws the terrain in 3D as geometry clipmaps, see clipmap.hpp, reading
+ * heights from a HeightSource as the camera moves.
+ *
+ * Every level is one layer of a texture array of CLIPMAP_TEXELS squared,
+ * so video memory stays the same whatever the size of the source. A
+ * draw slides each window after the camera and uploads just the strips
+ * it exposes with glTexSubImage3D, a few texels wide per level at flying
+ * speed. Levels much finer than the camera's height are skipped, as in the
+ * paper.
+ *
+ * All levels share one grid of CLIPMAP_GRID quads. A level skips the hole
+ * where the next finer one draws with a multi draw of the rows around it,
+ * and Clipmap.vs blends heights into the coarser level near the border so
+ * levels meet without cracks. Terrain.fs shades it the way it shades the
+ * CDLOD terrain. Owns its GL objects, the source has to outlive it.
+ */
+class ClipmapRenderer {
+      public:
+        Shader shader;
+
+        explicit ClipmapRenderer(const HeightSource &source);
+        ~ClipmapRenderer();
+        ClipmapRenderer(const ClipmapRenderer &) = delete;
+        ClipmapRenderer &operator=(const ClipmapRenderer &) = delete;
+
+        void draw(const glm::mat4 &view, const glm::mat4 &projection,
+                  glm::vec3 camera, glm::vec3 sun_dir);
+
+        int levels() const { return level_count; }
+        /* Finest level of the last draw */
+        int finest() const { return finest_level; }
+        /* Texels read and uploaded by the last draw */
+        size_t uploaded() const { return uploaded_texels; }
+
+      private:
+        struct Level {
+                glm::ivec2 origin;
+                /* First texel of the window the texture holds */
+                glm::ivec2 window;
+                bool valid{false};
+        };
+
+        const HeightSource &source;
+        int level_count;
+        int finest_level{0};
+        std::vector<Level> level_state;
+        GLuint texture{0}, VAO{0}, VBO{0}, EBO{0};
+        size_t uploaded_texels{0};
+        /* Reused from draw to draw */
+        std::vector<TexelRect> rects, pieces;
+        std::vector<unsigned char> texels;
+        std::vector<GLsizei> counts;
+        std::vector<const void *> offsets;
+        std::vector<GLint> base_vertices;
+
+        void update(int level, glm::ivec2 window);
+        void draw_level(int level);
+};
+
+#endif /* CLIPMAP_RENDERER_H */
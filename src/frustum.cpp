@@ -0,0 +1,34 @@
+#include "frustum.hpp"
+
+Frustum::Frustum(const glm::mat4 &view_projection) {
+        glm::mat4 rows = glm::transpose(view_projection);
+        for (int i = 0; i < 3; i++) {
+                planes[i * 2] = rows[3] + rows[i];
+                planes[i * 2 + 1] = rows[3] - rows[i];
+        }
+        for (glm::vec4 &plane : planes) {
+                plane /= glm::length(glm::vec3(plane));
+        }
+}
+
+bool Frustum::intersects_sphere(glm::vec3 center, float radius) const {
+        for (const glm::vec4 &plane : planes) {
+                if (glm::dot(glm::vec3(plane), center) + plane.w < -radius) {
+                        return false;
+                }
+        }
+        return true;
+}
+
+/* Tests the corner furthest along each plane's normal */
+bool Frustum::intersects_box(glm::vec3 min, glm::vec3 max) const {
+        for (const glm::vec4 &plane : planes) {
+                glm::vec3 corner{plane.x >= 0.0f ? max.x : min.x,
+                                 plane.y >= 0.0f ? max.y : min.y,
+                                 plane.z >= 0.0f ? max.z : min.z};
+                if (glm::dot(glm::vec3(plane), corner) + plane.w < 0.0f) {
+                        return false;
+                }
+        }
+        return true;
+}
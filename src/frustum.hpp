@@ -0,0 +1,24 @@
+#ifndef FRUSTUM_H
+#define FRUSTUM_H
+
+#include <glm/glm.hpp>
+
+/**
+ * The six planes of a view volume, taken from the rows of a projection
+ * times view matrix (Gribb and Hartmann). Normals point inwards and are
+ * normalized, so dot(plane.xyz, p) + plane.w is the signed distance of p.
+ * Order is left, right, bottom, top, near, far, the same as the planes
+ * array of Cull.vs.
+ */
+class Frustum {
+      public:
+        glm::vec4 planes[6];
+
+        explicit Frustum(const glm::mat4 &view_projection);
+
+        /* Conservative, a sphere near a corner may pass without touching */
+        bool intersects_sphere(glm::vec3 center, float radius) const;
+        bool intersects_box(glm::vec3 min, glm::vec3 max) const;
+};
+
+#endif /* FRUSTUM_H */
@@ -0,0 +1,186 @@
+#include "gl_state.hpp"
+#include "gl_stats.hpp"
+
+#include <algorithm>
+#include <iterator>
+
+/* Never handed out as a name, so the next bind always goes through */
+static const GLuint UNKNOWN = ~0u;
+
+GLState &GLState::instance() {
+        static GLState state;
+        return state;
+}
+
+void GLState::invalidate() {
+        program = vao = framebuffer = active_unit = UNKNOWN;
+        std::fill(std::begin(buffers), std::end(buffers), UNKNOWN);
+        for (auto &unit : textures) {
+                std::fill(std::begin(unit), std::end(unit), UNKNOWN);
+        }
+}
+
+bool GLState::cached(GLuint &current, GLuint value, size_t &issued) {
+        if (current == value) {
+                GLStats::instance().frame.binds_skipped++;
+                return true;
+        }
+        current = value;
+        issued++;
+        return false;
+}
+
+int GLState::buffer_slot(GLenum target) {
+        switch (target) {
+        case GL_ARRAY_BUFFER:
+                return ARRAY_SLOT;
+        case GL_COPY_READ_BUFFER:
+                return COPY_READ_SLOT;
+        case GL_COPY_WRITE_BUFFER:
+                return COPY_WRITE_SLOT;
+        case GL_PIXEL_PACK_BUFFER:
+                return PIXEL_PACK_SLOT;
+        case GL_PIXEL_UNPACK_BUFFER:
+                return PIXEL_UNPACK_SLOT;
+        case GL_TRANSFORM_FEEDBACK_BUFFER:
+                return TRANSFORM_FEEDBACK_SLOT;
+        case GL_UNIFORM_BUFFER:
+                return UNIFORM_SLOT;
+        default:
+                return -1;
+        }
+}
+
+int GLState::texture_slot(GLenum target) {
+        switch (target) {
+        case GL_TEXTURE_2D:
+                return TEXTURE_2D_SLOT;
+        case GL_TEXTURE_2D_ARRAY:
+                return TEXTURE_2D_ARRAY_SLOT;
+        case GL_TEXTURE_BUFFER:
+                return TEXTURE_BUFFER_SLOT;
+        default:
+                return -1;
+        }
+}
+
+void GLState::use_program(GLuint program) {
+        if (!cached(this->program, program,
+                    GLStats::instance().frame.program_binds)) {
+                glUseProgram(program);
+        }
+}
+
+void GLState::bind_vertex_array(GLuint vao) {
+        if (!cached(this->vao, vao,
+                    GLStats::instance().frame.vertex_array_binds)) {
+                glBindVertexArray(vao);
+        }
+}
+
+void GLState::bind_framebuffer(GLuint framebuffer) {
+        if (!cached(this->framebuffer, framebuffer,
+                    GLStats::instance().frame.other_binds)) {
+                glBindFramebuffer(GL_FRAMEBUFFER, framebuffer);
+        }
+}
+
+/* Element array bindings belong to the VAO, they always go through */
+void GLState::bind_buffer(GLenum target, GLuint buffer) {
+        int slot = buffer_slot(target);
+        size_t &issued = GLStats::instance().frame.other_binds;
+        if (slot < 0) {
+                issued++;
+                glBindBuffer(target, buffer);
+                return;
+        }
+        if (!cached(buffers[slot], buffer, issued)) {
+                glBindBuffer(target, buffer);
+        }
+}
+
+/* Always issued, the indexed binding points aren't shadowed */
+void GLState::bind_buffer_base(GLenum target, GLuint index, GLuint buffer) {
+        int slot = buffer_slot(target);
+        if (slot >= 0) {
+                buffers[slot] = buffer;
+        }
+        GLStats::instance().frame.other_binds++;
+        glBindBufferBase(target, index, buffer);
+}
+
+void GLState::active_texture(GLuint unit) {
+        if (!cached(active_unit, unit,
+                    GLStats::instance().frame.other_binds)) {
+                glActiveTexture(GL_TEXTURE0 + unit);
+        }
+}
+
+void GLState::bind_texture(GLuint unit, GLenum target, GLuint texture) {
+        int slot = texture_slot(target);
+        if (unit < GL_STATE_TEXTURE_UNITS && slot >= 0 &&
+            textures[unit][slot] == texture) {
+                GLStats::instance().frame.binds_skipped++;
+                return;
+        }
+        active_texture(unit);
+        bind_texture(target, texture);
+}
+
+void GLState::bind_texture(GLenum target, GLuint texture) {
+        if (active_unit == UNKNOWN) {
+                active_texture(0);
+        }
+        int slot = texture_slot(target);
+        size_t &issued = GLStats::instance().frame.texture_binds;
+        if (active_unit >= GL_STATE_TEXTURE_UNITS || slot < 0) {
+                issued++;
+                glBindTexture(target, texture);
+                return;
+        }
+        if (!cached(textures[active_unit][slot], texture, issued)) {
+                glBindTexture(target, texture);
+        }
+}
+
+void GLState::delete_texture(GLuint &texture) {
+        if (texture == 0) {
+                return;
+        }
+        for (auto &unit : textures) {
+                std::replace(std::begin(unit), std::end(unit), texture, 0u);
+        }
+        glDeleteTextures(1, &texture);
+        texture = 0;
+}
+
+void GLState::delete_buffer(GLuint &buffer) {
+        if (buffer == 0) {
+                return;
+        }
+        std::replace(std::begin(buffers), std::end(buffers), buffer, 0u);
+        glDeleteBuffers(1, &buffer);
+        buffer = 0;
+}
+
+void GLState::delete_vertex_array(GLuint &vao) {
+        if (vao == 0) {
+                return;
+        }
+        if (this->vao == vao) {
+                this->vao = 0;
+        }
+        glDeleteVertexArrays(1, &vao);
+        vao = 0;
+}
+
+void GLState::delete_framebuffer(GLuint &framebuffer) {
+        if (framebuffer == 0) {
+                return;
+        }
+        if (this->framebuffer == framebuffer) {
+                this->framebuffer = 0;
+        }
+        glDeleteFramebuffers(1, &framebuffer);
+        framebuffer = 0;
+}
@@ -0,0 +1,86 @@
+#ifndef GL_STATE_H
+#define GL_STATE_H
+
+#include <glad/glad.h>
+
+#include <cstddef>
+
+/* Texture units whose bindings are shadowed, higher ones always bind */
+const GLuint GL_STATE_TEXTURE_UNITS = 16;
+
+/**
+ * Shadow copy of the context's bindings: program, VAO, framebuffer, the 2D,
+ * 2D array and buffer texture of each unit, the active unit and the buffers
+ * bound outside a VAO. Binding what is already bound never reaches the
+ * driver, so callers just ask for the state they need and don't unbind
+ * afterwards.
+ *
+ * Every bind in the tree has to go through here, a raw glBind* leaves the
+ * shadow stale. GL unbinds objects when they are deleted, the delete_*
+ * calls do the same to the shadow so a recycled name isn't taken as bound.
+ * The element array binding is part of the VAO and is not tracked.
+ *
+ * Starts out unknown, and goes back to unknown with invalidate, so the
+ * first bind of everything is always issued. Issued and skipped binds are
+ * counted in the GLStats of the frame.
+ */
+class GLState {
+      public:
+        static GLState &instance();
+
+        void use_program(GLuint program);
+        void bind_vertex_array(GLuint vao);
+        void bind_framebuffer(GLuint framebuffer);
+        void bind_buffer(GLenum target, GLuint buffer);
+        /* Indexed binding, which also replaces the generic one of target */
+        void bind_buffer_base(GLenum target, GLuint index, GLuint buffer);
+
+        /* For drawing, only switches the active unit when it has to bind */
+        void bind_texture(GLuint unit, GLenum target, GLuint texture);
+        /* On whatever unit is active, for creating and updating textures */
+        void bind_texture(GLenum target, GLuint texture);
+        void active_texture(GLuint unit);
+
+        void delete_texture(GLuint &texture);
+        void delete_buffer(GLuint &buffer);
+        void delete_vertex_array(GLuint &vao);
+        void delete_framebuffer(GLuint &framebuffer);
+
+        /* Forget everything, for a new context or after foreign GL code */
+        void invalidate();
+
+      private:
+        enum BufferSlot {
+                ARRAY_SLOT,
+                COPY_READ_SLOT,
+                COPY_WRITE_SLOT,
+                PIXEL_PACK_SLOT,
+                PIXEL_UNPACK_SLOT,
+                TRANSFORM_FEEDBACK_SLOT,
+                UNIFORM_SLOT,
+                BUFFER_SLOTS,
+        };
+        enum TextureSlot {
+                TEXTURE_2D_SLOT,
+                TEXTURE_2D_ARRAY_SLOT,
+                TEXTURE_BUFFER_SLOT,
+                TEXTURE_SLOTS,
+        };
+
+        GLuint program;
+        GLuint vao;
+        GLuint framebuffer;
+        GLuint active_unit;
+        GLuint buffers[BUFFER_SLOTS];
+        GLuint textures[GL_STATE_TEXTURE_UNITS][TEXTURE_SLOTS];
+
+        GLState() { invalidate(); }
+
+        /* True when current already holds value, otherwise stores it and
+         * counts the bind in issued */
+        static bool cached(GLuint &current, GLuint value, size_t &issued);
+        static int buffer_slot(GLenum target);
+        static int texture_slot(GLenum target);
+};
+
+#endif /* GL_STATE_H */
@@ -0,0 +1,156 @@
+#include "gl_stats.hpp"
+
+#include <algorithm>
+#include <iomanip>
+#include <iostream>
+#include <sstream>
+
+static const struct {
+        const char *name;
+        size_t GLCounters::*field;
+} COUNTERS[] = {
+        {"draw calls", &GLCounters::draw_calls},
+        {"primitives", &GLCounters::primitives},
+        {"program binds", &GLCounters::program_binds},
+        {"vertex array binds", &GLCounters::vertex_array_binds},
+        {"texture binds", &GLCounters::texture_binds},
+        {"other binds", &GLCounters::other_binds},
+        {"binds skipped", &GLCounters::binds_skipped},
+        {"uniform updates", &GLCounters::uniform_updates},
+        {"upload bytes", &GLCounters::upload_bytes},
+};
+
+GLStats &GLStats::instance() {
+        static GLStats stats;
+        return stats;
+}
+
+void GLStats::end_frame() {
+        bool over_budget = false;
+        for (const auto &counter : COUNTERS) {
+                size_t value = frame.*counter.field;
+                size_t limit = budget.*counter.field;
+                total.*counter.field += value;
+                peak.*counter.field = std::max(peak.*counter.field, value);
+
+                bool is_over = limit != 0 && value > limit;
+                if (is_over && over.*counter.field == 0) {
+                        std::cout << "Frame " << frames << " over budget: "
+                                  << counter.name << " " << value << " > "
+                                  << limit << "\n";
+                }
+                over.*counter.field = is_over;
+                over_budget |= is_over;
+        }
+        over_budget_frames += over_budget;
+        frames++;
+        last = frame;
+        frame = {};
+}
+
+std::string GLStats::summary() const {
+        std::ostringstream out;
+        out << last.draw_calls << " draws, " << last.primitives << " tris, "
+            << last.program_binds + last.vertex_array_binds +
+                       last.texture_binds + last.other_binds
+            << " binds (" << last.binds_skipped << " skipped), "
+            << last.uniform_updates << " uniforms, "
+            << last.upload_bytes / 1024 << " KB up";
+        return out.str();
+}
+
+void GLStats::dump(std::ostream &out) const {
+        out << "GL stats over " << frames << " frames, " << over_budget_frames
+            << " over budget\n";
+        out << std::setw(20) << std::left << "" << std::right << std::setw(14)
+            << "total" << std::setw(12) << "per frame" << std::setw(12)
+            << "peak" << std::setw(12) << "budget"
+            << "\n";
+        for (const auto &counter : COUNTERS) {
+                size_t sum = total.*counter.field;
+                out << std::setw(20) << std::left << counter.name
+                    << std::right << std::setw(14) << sum << std::setw(12)
+                    << (frames ? sum / frames : 0) << std::setw(12)
+                    << peak.*counter.field << std::setw(12);
+                if (budget.*counter.field != 0) {
+                        out << budget.*counter.field;
+                } else {
+                        out << "-";
+                }
+                out << "\n";
+        }
+}
+
+/* Primitives assembled from count vertices, adjacency modes aren't used */
+static size_t primitive_count(GLenum mode, GLsizei count) {
+        switch (mode) {
+        case GL_POINTS:
+                return count;
+        case GL_LINES:
+                return count / 2;
+        case GL_LINE_STRIP:
+                return std::max(count - 1, 0);
+        case GL_LINE_LOOP:
+                return count;
+        case GL_TRIANGLE_STRIP:
+        case GL_TRIANGLE_FAN:
+                return std::max(count - 2, 0);
+        default:
+                return count / 3;
+        }
+}
+
+void draw_arrays(GLenum mode, GLint first, GLsizei count) {
+        GLCounters &frame = GLStats::instance().frame;
+        frame.draw_calls++;
+        frame.primitives += primitive_count(mode, count);
+        glDrawArrays(mode, first, count);
+}
+
+void draw_elements_base_vertex(GLenum mode, GLsizei count, GLenum type,
+                               const void *indices, GLint base_vertex) {
+        GLCounters &frame = GLStats::instance().frame;
+        frame.draw_calls++;
+        frame.primitives += primitive_count(mode, count);
+        glDrawElementsBaseVertex(mode, count, type, indices, base_vertex);
+}
+
+void draw_elements_instanced_base_vertex(GLenum mode, GLsizei count,
+                                         GLenum type, const void *indices,
+                                         GLsizei instance_count,
+                                         GLint base_vertex) {
+        GLCounters &frame = GLStats::instance().frame;
+        frame.draw_calls++;
+        frame.primitives += primitive_count(mode, count) * instance_count;
+        glDrawElementsInstancedBaseVertex(mode, count, type, indices,
+                                          instance_count, base_vertex);
+}
+
+/* One call, but the driver still walks every draw in it */
+void multi_draw_elements_base_vertex(GLenum mode, const GLsizei *counts,
+                                     GLenum type, const void *const *indices,
+                                     GLsizei draw_count,
+                                     const GLint *base_vertices) {
+        GLCounters &frame = GLStats::instance().frame;
+        frame.draw_calls++;
+        for (GLsizei i = 0; i < draw_count; i++) {
+                frame.primitives += primitive_count(mode, counts[i]);
+        }
+        glMultiDrawElementsBaseVertex(mode, counts, type, indices, draw_count,
+                                      base_vertices);
+}
+
+/* Allocating without data costs no transfer */
+void buffer_data(GLenum target, GLsizeiptr size, const void *data,
+                 GLenum usage) {
+        if (data != NULL) {
+                GLStats::instance().count_upload(size);
+        }
+        glBufferData(target, size, data, usage);
+}
+
+void buffer_sub_data(GLenum target, GLintptr offset, GLsizeiptr size,
+                     const void *data) {
+        GLStats::instance().count_upload(size);
+        glBufferSubData(target, offset, size, data);
+}
@@ -0,0 +1,106 @@
+#ifndef GL_STATS_H
+#define GL_STATS_H
+
+#include <glad/glad.h>
+
+#include <cstddef>
+#include <ostream>
+#include <string>
+
+/* What one frame asked of the driver */
+struct GLCounters {
+        size_t draw_calls{0};
+        size_t primitives{0};
+        size_t program_binds{0};
+        size_t vertex_array_binds{0};
+        size_t texture_binds{0};
+        /* Buffers, framebuffers and active texture unit switches */
+        size_t other_binds{0};
+        /* Binds GLState found already in place */
+        size_t binds_skipped{0};
+        size_t uniform_updates{0};
+        /* Client memory handed to buffers and textures */
+        size_t upload_bytes{0};
+};
+
+/* Per frame limits, generous for the map view on llvmpipe at 800x800 so
+ * only a real regression trips them. Zero means no limit. */
+const GLCounters DEFAULT_FRAME_BUDGET = {
+        /* draw_calls */ 1000,
+        /* primitives */ 4000000,
+        /* program_binds */ 50,
+        /* vertex_array_binds */ 500,
+        /* texture_binds */ 1000,
+        /* other_binds */ 1000,
+        /* binds_skipped */ 0,
+        /* uniform_updates */ 5000,
+        /* upload_bytes */ 16 << 20,
+};
+
+/**
+ * Counts the GL work of every frame, keeps totals and peaks over the run
+ * and warns when a frame goes over budget.
+ *
+ * The counters are filled by GLState for binds, by Shader for uniforms and
+ * by the wrappers below, which stand in for the GL calls of the same name
+ * and take the same arguments. Texture uploads are reported with
+ * count_upload where the size is known. The render loop calls end_frame
+ * once per frame.
+ *
+ * A warning is printed when a counter first goes over budget, and again
+ * only after it has come back under, so a slow frame doesn't flood stdout.
+ */
+class GLStats {
+      public:
+        /* Counters of the frame in progress */
+        GLCounters frame;
+
+        static GLStats &instance();
+
+        void set_budget(const GLCounters &budget) { this->budget = budget; }
+
+        /* Drops what was counted so far, say the loading before frame 1 */
+        void reset() { frame = {}; }
+
+        void end_frame();
+        void count_upload(size_t bytes) { frame.upload_bytes += bytes; }
+
+        const GLCounters &last_frame() const { return last; }
+        size_t frame_count() const { return frames; }
+        size_t frames_over_budget() const { return over_budget_frames; }
+
+        /* One line for the window title */
+        std::string summary() const;
+
+        /* Totals, averages, peaks and budgets of every counter */
+        void dump(std::ostream &out) const;
+
+      private:
+        GLCounters budget{DEFAULT_FRAME_BUDGET};
+        GLCounters last;
+        GLCounters total;
+        GLCounters peak;
+        GLCounters over;
+        size_t frames{0};
+        size_t over_budget_frames{0};
+
+        GLStats() = default;
+};
+
+void draw_arrays(GLenum mode, GLint first, GLsizei count);
+void draw_elements_base_vertex(GLenum mode, GLsizei count, GLenum type,
+                               const void *indices, GLint base_vertex);
+void draw_elements_instanced_base_vertex(GLenum mode, GLsizei count,
+                                         GLenum type, const void *indices,
+                                         GLsizei instance_count,
+                                         GLint base_vertex);
+void multi_draw_elements_base_vertex(GLenum mode, const GLsizei *counts,
+                                     GLenum type, const void *const *indices,
+                                     GLsizei draw_count,
+                                     const GLint *base_vertices);
+void buffer_data(GLenum target, GLsizeiptr size, const void *data,
+                 GLenum usage);
+void buffer_sub_data(GLenum target, GLintptr offset, GLsizeiptr size,
+                     const void *data);
+
+#endif /* GL_STATS_H */
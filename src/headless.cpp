@@ -0,0 +1,99 @@
+#include "headless.hpp"
+#include "gl_state.hpp"
+#include "renderer.hpp"
+#include "trace.hpp"
+
+#include <algorithm>
+#include <vector>
+
+static GLFWwindow *create_hidden_window() {
+        glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 3);
+        glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 3);
+        glfwWindowHint(GLFW_OPENGL_PROFILE, GLFW_OPENGL_CORE_PROFILE);
+        glfwWindowHint(GLFW_VISIBLE, GLFW_FALSE);
+#ifdef __APPLE__
+        glfwWindowHint(GLFW_OPENGL_FORWARD_COMPAT, GL_TRUE);
+#endif
+        return glfwCreateWindow(1, 1, "MapSim", NULL, NULL);
+}
+
+GLFWwindow *create_headless_context() {
+        TRACE_FUNCTION();
+        GLFWwindow *window = NULL;
+        if (glfwInit()) {
+                window = create_hidden_window();
+                if (window == NULL) {
+                        glfwTerminate();
+                }
+        }
+
+        if (window == NULL) {
+                glfwInitHint(GLFW_PLATFORM, GLFW_PLATFORM_NULL);
+                if (!glfwInit()) {
+                        std::cout << "Failed to initialize glfw\n";
+                        return NULL;
+                }
+                glfwWindowHint(GLFW_CONTEXT_CREATION_API,
+                               GLFW_OSMESA_CONTEXT_API);
+                window = create_hidden_window();
+                if (window == NULL) {
+                        std::cout << "Failed to create headless context\n";
+                        glfwTerminate();
+                        return NULL;
+                }
+        }
+
+        glfwMakeContextCurrent(window);
+        if (!gladLoadGLLoader((GLADloadproc)glfwGetProcAddress)) {
+                std::cout << "Failed to initialize GLAD\n";
+                glfwDestroyWindow(window);
+                glfwTerminate();
+                return NULL;
+        }
+        return window;
+}
+
+OffscreenRenderer::OffscreenRenderer(int width, int height)
+        : width{width}, height{height}, target{width, height, GL_RGB8},
+          map_pass{"src/shaders/StepShadow.fs"} {
+        set_terrain_uniforms(map_pass.shader);
+}
+
+OffscreenRenderer::~OffscreenRenderer() {
+        GLState::instance().delete_texture(perlin_map);
+}
+
+void OffscreenRenderer::render(const Heightmap &map, glm::vec3 sun_dir,
+                               unsigned char *rgb) {
+        TRACE_SCOPE("OffscreenRenderer::render");
+        if (perlin_map != 0 && map.width == map_width &&
+            map.height == map_height) {
+                update_heightmap_texture(perlin_map, map);
+        } else {
+                GLState::instance().delete_texture(perlin_map);
+                perlin_map = create_heightmap_texture(map);
+                map_width = map.width;
+                map_height = map.height;
+                map_pass.set_input("perlin_map", 0, perlin_map);
+        }
+
+        glDisable(GL_DEPTH_TEST);
+        map_pass.shader.use();
+        map_pass.shader.set_uniform("sun_dir", sun_dir);
+        map_pass.draw(target);
+
+        /* GL's origin is the bottom left, images are written top down */
+        std::vector<unsigned char> flipped(static_cast<size_t>(width) *
+                                           height * 3);
+        GLState::instance().bind_framebuffer(target.fbo);
+        glPixelStorei(GL_PACK_ALIGNMENT, 1);
+        glReadPixels(0, 0, width, height, GL_RGB, GL_UNSIGNED_BYTE,
+                     flipped.data());
+
+        size_t stride = static_cast<size_t>(width) * 3;
+        for (int y = 0; y < height; y++) {
+                std::copy(flipped.begin() + (height - 1 - y) * stride,
+                          flipped.begin() + (height - y) * stride,
+                          rgb + y * stride);
+        }
+}
@@ -0,0 +1,43 @@
+#ifndef HEADLESS_H
+#define HEADLESS_H
+
+#include <glad/glad.h>
+
+#include <GLFW/glfw3.h>
+#include <glm/glm.hpp>
+
+#include "heightmap.hpp"
+#include "renderpass.hpp"
+
+/**
+ * Creates an invisible GL 3.3 context and makes it current. A hidden window
+ * is tried first, if there is no display GLFW's null platform with an
+ * OSMesa context is used instead, which runs on Mesa llvmpipe.
+ * Returns NULL on failure, the caller owns glfwTerminate().
+ */
+GLFWwindow *create_headless_context();
+
+/**
+ * Draws the shaded map into a framebuffer object and reads it back.
+ * Requires a current GL context.
+ */
+class OffscreenRenderer {
+      public:
+        int width;
+        int height;
+
+        OffscreenRenderer(int width, int height);
+        ~OffscreenRenderer();
+
+        /* rgb receives width * height * 3 bytes, top row first */
+        void render(const Heightmap &map, glm::vec3 sun_dir,
+                    unsigned char *rgb);
+
+      private:
+        RenderTarget target;
+        FullscreenPass map_pass;
+        GLuint perlin_map{};
+        int map_width{}, map_height{};
+};
+
+#endif /* HEADLESS_H */
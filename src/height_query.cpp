@@ -0,0 +1,278 @@
+#include "height_query.hpp"
+#include "terrain.hpp"
+#include "trace.hpp"
+
+#include <algorithm>
+#include <cmath>
+
+static const float HEIGHT_STEP = TERRAIN_HEIGHT_SCALE / 255.0f;
+
+HeightQuery::HeightQuery(const Heightmap &map) : map{map} {
+        TRACE_FUNCTION();
+        Level cells{map.width, map.height, {}};
+        cells.bounds.resize(static_cast<size_t>(map.width) * map.height);
+        for (int z = 0; z < map.height; z++) {
+                int z1 = std::min(z + 1, map.height - 1);
+                for (int x = 0; x < map.width; x++) {
+                        int x1 = std::min(x + 1, map.width - 1);
+                        auto corners = {map.at(x, z), map.at(x1, z),
+                                        map.at(x, z1), map.at(x1, z1)};
+                        cells.bounds[static_cast<size_t>(z) * map.width + x] =
+                                {std::min(corners), std::max(corners)};
+                }
+        }
+        levels.push_back(std::move(cells));
+
+        while (levels.back().width > 1 || levels.back().height > 1) {
+                const Level &below = levels.back();
+                Level level{(below.width + 1) / 2, (below.height + 1) / 2, {}};
+                level.bounds.resize(static_cast<size_t>(level.width) *
+                                    level.height);
+                for (int z = 0; z < level.height; z++) {
+                        for (int x = 0; x < level.width; x++) {
+                                Bounds b{255, 0};
+                                for (int i = 0; i < 4; i++) {
+                                        int cx = 2 * x + (i & 1);
+                                        int cz = 2 * z + (i >> 1);
+                                        if (cx >= below.width ||
+                                            cz >= below.height) {
+                                                continue;
+                                        }
+                                        Bounds child = below.at(cx, cz);
+                                        b.min = std::min(b.min, child.min);
+                                        b.max = std::max(b.max, child.max);
+                                }
+                                level.bounds[static_cast<size_t>(z) *
+                                                     level.width +
+                                             x] = b;
+                        }
+                }
+                levels.push_back(std::move(level));
+        }
+}
+
+float HeightQuery::texel_height(int x, int z) const {
+        return map.at(std::clamp(x, 0, map.width - 1),
+                      std::clamp(z, 0, map.height - 1)) *
+               HEIGHT_STEP;
+}
+
+float HeightQuery::sample_height(float x, float z) const {
+        x = std::clamp(x, 0.0f, static_cast<float>(map.width));
+        z = std::clamp(z, 0.0f, static_cast<float>(map.height));
+        int x0 = static_cast<int>(x), z0 = static_cast<int>(z);
+        float fx = x - x0, fz = z - z0;
+        float bottom = texel_height(x0, z0) * (1.0f - fx) +
+                       texel_height(x0 + 1, z0) * fx;
+        float top = texel_height(x0, z0 + 1) * (1.0f - fx) +
+                    texel_height(x0 + 1, z0 + 1) * fx;
+        return bottom * (1.0f - fz) + top * fz;
+}
+
+void HeightQuery::sample_heights(const glm::vec2 *points, size_t count,
+                                 float *heights) const {
+        TRACE_FUNCTION();
+        for (size_t i = 0; i < count; i++) {
+                heights[i] = sample_height(points[i].x, points[i].y);
+        }
+}
+
+glm::vec2 HeightQuery::height_range(glm::vec2 lo, glm::vec2 hi) const {
+        int x0 = std::clamp(static_cast<int>(std::floor(lo.x)), 0,
+                            map.width - 1);
+        int z0 = std::clamp(static_cast<int>(std::floor(lo.y)), 0,
+                            map.height - 1);
+        int x1 = std::clamp(static_cast<int>(std::ceil(hi.x)) - 1, x0,
+                            map.width - 1);
+        int z1 = std::clamp(static_cast<int>(std::ceil(hi.y)) - 1, z0,
+                            map.height - 1);
+
+        /* Cells x0..x1, z0..z1, taking whole nodes where they fit and
+         * going down a level along the ragged edges */
+        Bounds range{255, 0};
+        struct Node {
+                int level;
+                int x;
+                int z;
+        };
+        std::vector<Node> stack{{static_cast<int>(levels.size()) - 1, 0, 0}};
+        while (!stack.empty()) {
+                Node node = stack.back();
+                stack.pop_back();
+                int lx0 = node.x << node.level, lz0 = node.z << node.level;
+                int lx1 = lx0 + (1 << node.level) - 1;
+                int lz1 = lz0 + (1 << node.level) - 1;
+                if (lx0 > x1 || lz0 > z1 || lx1 < x0 || lz1 < z0) {
+                        continue;
+                }
+                if (node.level == 0 ||
+                    (lx0 >= x0 && lz0 >= z0 && lx1 <= x1 && lz1 <= z1)) {
+                        Bounds b = levels[node.level].at(node.x, node.z);
+                        range.min = std::min(range.min, b.min);
+                        range.max = std::max(range.max, b.max);
+                        continue;
+                }
+                const Level &below = levels[node.level - 1];
+                for (int i = 0; i < 4; i++) {
+                        int cx = 2 * node.x + (i & 1);
+                        int cz = 2 * node.z + (i >> 1);
+                        if (cx < below.width && cz < below.height) {
+                                stack.push_back({node.level - 1, cx, cz});
+                        }
+                }
+        }
+        return glm::vec2(range.min, range.max) * HEIGHT_STEP;
+}
+
+/* Where the ray is within the box, clipped to [t0, t1] */
+static bool clip_to_box(glm::vec3 origin, glm::vec3 inverse, glm::vec3 lo,
+                        glm::vec3 hi, float &t0, float &t1) {
+        glm::vec3 a = (lo - origin) * inverse;
+        glm::vec3 b = (hi - origin) * inverse;
+        glm::vec3 near = glm::min(a, b), far = glm::max(a, b);
+        t0 = std::max({t0, near.x, near.y, near.z});
+        t1 = std::min({t1, far.x, far.y, far.z});
+        return t0 <= t1;
+}
+
+bool HeightQuery::intersect_cell(int x, int z, const TerrainRay &ray,
+                                 float t0, float t1, float &t) const {
+        /* Height over the cell is a + b u + c v + d u v for u, v in [0, 1],
+         * and the ray's height above it a quadratic in t */
+        double a = texel_height(x, z);
+        double b = texel_height(x + 1, z) - a;
+        double c = texel_height(x, z + 1) - a;
+        double d = texel_height(x + 1, z + 1) - a - b - c;
+        double ou = ray.origin.x - x, ov = ray.origin.z - z;
+        double du = ray.direction.x, dv = ray.direction.z;
+        double qa = -d * du * dv;
+        double qb = ray.direction.y - b * du - c * dv - d * (ou * dv + ov * du);
+        double qc = ray.origin.y - a - b * ou - c * ov - d * ou * ov;
+
+        auto above = [&](double s) { return (qa * s + qb) * s + qc; };
+        if (above(t0) <= 0.0) {
+                t = t0;
+                return true;
+        }
+        double roots[2];
+        int count = 0;
+        if (std::abs(qa) < 1e-12) {
+                if (qb != 0.0) {
+                        roots[count++] = -qc / qb;
+                }
+        } else {
+                double discriminant = qb * qb - 4.0 * qa * qc;
+                if (discriminant < 0.0) {
+                        return false;
+                }
+                /* The form that doesn't cancel, then Vieta for the other */
+                double q = -0.5 * (qb + std::copysign(std::sqrt(discriminant),
+                                                      qb));
+                roots[count++] = q / qa;
+                if (q != 0.0) {
+                        roots[count++] = qc / q;
+                }
+        }
+        bool found = false;
+        for (int i = 0; i < count; i++) {
+                if (roots[i] >= t0 && roots[i] <= t1 &&
+                    (!found || roots[i] < t)) {
+                        t = static_cast<float>(roots[i]);
+                        found = true;
+                }
+        }
+        return found;
+}
+
+bool HeightQuery::intersect(const TerrainRay &ray, TerrainHit &hit) const {
+        /* A zero component would make 0 * inf in the slab test */
+        glm::vec3 direction = ray.direction;
+        for (int i = 0; i < 3; i++) {
+                if (direction[i] == 0.0f) {
+                        direction[i] = 1e-30f;
+                }
+        }
+        glm::vec3 inverse = 1.0f / direction;
+
+        struct Node {
+                int level;
+                int x;
+                int z;
+                float t0;
+                float t1;
+        };
+        auto clip = [&](int level, int x, int z, Node &node) {
+                Bounds b = levels[level].at(x, z);
+                int size = 1 << level;
+                /* Padded, so over flat sea the box isn't a plane the ray
+                 * crosses in a single rounded t */
+                glm::vec3 lo(x * size, b.min * HEIGHT_STEP - 1e-3f, z * size);
+                glm::vec3 hi(std::min((x + 1) * size, map.width),
+                             b.max * HEIGHT_STEP + 1e-3f,
+                             std::min((z + 1) * size, map.height));
+                node = {level, x, z, 0.0f, ray.max_distance};
+                return clip_to_box(ray.origin, inverse, lo, hi, node.t0,
+                                   node.t1);
+        };
+
+        Node root;
+        if (!clip(static_cast<int>(levels.size()) - 1, 0, 0, root)) {
+                return false;
+        }
+        /* Children go on nearest last, so the walk is front to back and
+         * the first hit is the nearest. Cells don't overlap in x and z,
+         * and a hit can only be inside its cell. */
+        std::vector<Node> stack{root};
+        while (!stack.empty()) {
+                Node node = stack.back();
+                stack.pop_back();
+                float t;
+                if (node.level == 0) {
+                        if (intersect_cell(node.x, node.z, ray, node.t0,
+                                           node.t1, t)) {
+                                hit.distance = t;
+                                hit.position = ray.origin + ray.direction * t;
+                                hit.cell = {node.x, node.z};
+                                return true;
+                        }
+                        continue;
+                }
+                const Level &below = levels[node.level - 1];
+                Node children[4];
+                int count = 0;
+                for (int i = 0; i < 4; i++) {
+                        int cx = 2 * node.x + (i & 1);
+                        int cz = 2 * node.z + (i >> 1);
+                        if (cx < below.width && cz < below.height &&
+                            clip(node.level - 1, cx, cz, children[count])) {
+                                count++;
+                        }
+                }
+                std::sort(children, children + count,
+                          [](const Node &a, const Node &b) {
+                                  return a.t0 > b.t0;
+                          });
+                stack.insert(stack.end(), children, children + count);
+        }
+        return false;
+}
+
+bool HeightQuery::line_of_sight(glm::vec3 from, glm::vec3 to) const {
+        /* Stops short of the target, which may sit on the ground */
+        TerrainHit hit;
+        return !intersect({from, to - from, 1.0f - 1e-4f}, hit);
+}
+
+size_t HeightQuery::intersect(const TerrainRay *rays, size_t count,
+                              TerrainHit *hits) const {
+        TRACE_FUNCTION();
+        size_t hit_count = 0;
+        for (size_t i = 0; i < count; i++) {
+                if (intersect(rays[i], hits[i])) {
+                        hit_count++;
+                } else {
+                        hits[i].distance = -1.0f;
+                }
+        }
+        return hit_count;
+}
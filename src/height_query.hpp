@@ -0,0 +1,94 @@
+#ifndef HEIGHT_QUERY_H
+#define HEIGHT_QUERY_H
+
+#include <glm/glm.hpp>
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include "heightmap.hpp"
+
+/**
+ * Picking, line of sight and height lookups on the terrain.
+ *
+ * The surface is the one the terrain renderers draw: texel x, z of the map
+ * sits at world x, z, bilinear in between and flat past the last row and
+ * column, in terrain world units as in scatter.hpp. Cell x, z is the unit
+ * square with texel x, z as its lowest corner.
+ *
+ * A min/max quadtree over the cells bounds the surface. A ray walks down
+ * it front to back, skipping every node whose box it misses, and solves
+ * the quadratic of the bilinear patch exactly in the cells it reaches, so
+ * the first hit is the nearest one. Most rays touch a few dozen nodes,
+ * where marching along the ray would sample the map every fraction of a
+ * texel. The map has to outlive the query.
+ */
+
+struct TerrainRay {
+        glm::vec3 origin;
+        /* Need not be normalized, distances are in its lengths */
+        glm::vec3 direction;
+        float max_distance;
+};
+
+struct TerrainHit {
+        glm::vec3 position;
+        /* Negative when the ray missed, in batch queries */
+        float distance;
+        glm::ivec2 cell;
+};
+
+class HeightQuery {
+      public:
+        explicit HeightQuery(const Heightmap &map);
+
+        const Heightmap &heightmap() const { return map; }
+
+        /* Bilinear height at world x, z, what the renderers draw there */
+        float sample_height(float x, float z) const;
+
+        /* Lowest and highest point of the surface over [lo, hi] in x and
+         * z, rounded out to whole cells */
+        glm::vec2 height_range(glm::vec2 lo, glm::vec2 hi) const;
+
+        /* Nearest point where the ray meets the surface, if within its
+         * max_distance. A ray starting under the surface hits at once. */
+        bool intersect(const TerrainRay &ray, TerrainHit &hit) const;
+
+        /* True when no terrain lies strictly between the two points */
+        bool line_of_sight(glm::vec3 from, glm::vec3 to) const;
+
+        /* Batches of the above, returning how many rays hit */
+        void sample_heights(const glm::vec2 *points, size_t count,
+                            float *heights) const;
+        size_t intersect(const TerrainRay *rays, size_t count,
+                         TerrainHit *hits) const;
+
+      private:
+        /* Smallest and largest texel over a node's cells */
+        struct Bounds {
+                uint8_t min;
+                uint8_t max;
+        };
+        struct Level {
+                int width;
+                int height;
+                std::vector<Bounds> bounds;
+
+                Bounds at(int x, int z) const {
+                        return bounds[static_cast<size_t>(z) * width + x];
+                }
+        };
+
+        const Heightmap &map;
+        /* Level 0 has one node per cell, the last one a single node */
+        std::vector<Level> levels;
+
+        float texel_height(int x, int z) const;
+        /* First point of cell x, z on the ray within [t0, t1] */
+        bool intersect_cell(int x, int z, const TerrainRay &ray, float t0,
+                            float t1, float &t) const;
+};
+
+#endif /* HEIGHT_QUERY_H */
@@ -0,0 +1,36 @@
+#include "height_source.hpp"
+#include "trace.hpp"
+
+#include <algorithm>
+
+/* Map texel of level texel i, clamped to the map */
+static int map_texel(int i, int level, int size) {
+        long long texel = static_cast<long long>(i) * (1ll << level);
+        return static_cast<int>(std::clamp<long long>(texel, 0, size - 1));
+}
+
+void HeightmapSource::read(int level, int x, int z, int w, int h,
+                           unsigned char *out) const {
+        for (int row = 0; row < h; row++) {
+                int map_z = map_texel(z + row, level, map.height);
+                for (int column = 0; column < w; column++) {
+                        *out++ = map.at(map_texel(x + column, level,
+                                                  map.width),
+                                        map_z);
+                }
+        }
+}
+
+void NoiseSource::read(int level, int x, int z, int w, int h,
+                       unsigned char *out) const {
+        TRACE_FUNCTION();
+        for (int row = 0; row < h; row++) {
+                int map_z = map_texel(z + row, level, map_height);
+                for (int column = 0; column < w; column++) {
+                        *out++ = island_height(
+                                noise,
+                                map_texel(x + column, level, map_width),
+                                map_z, map_width, map_height);
+                }
+        }
+}
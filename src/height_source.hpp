@@ -0,0 +1,60 @@
+#ifndef HEIGHT_SOURCE_H
+#define HEIGHT_SOURCE_H
+
+#include "heightmap.hpp"
+#include "noise.hpp"
+
+/**
+ * Heights read a block at a time, for terrain too large to hold in memory.
+ * Level l has a texel every 2^l map texels, texel x, z of it is map texel
+ * x * 2^l, z * 2^l. Point sampled rather than filtered, so every level
+ * agrees with the finer ones where their texels coincide. Texels off the
+ * map take the value of the nearest edge.
+ */
+class HeightSource {
+      public:
+        virtual ~HeightSource() = default;
+
+        virtual int width() const = 0;
+        virtual int height() const = 0;
+
+        /* Fills out with the block [x, x + w) x [z, z + h) of level, row
+         * by row */
+        virtual void read(int level, int x, int z, int w, int h,
+                          unsigned char *out) const = 0;
+};
+
+/* A Heightmap already in memory, which has to outlive the source */
+class HeightmapSource : public HeightSource {
+      public:
+        explicit HeightmapSource(const Heightmap &map) : map{map} {}
+
+        int width() const override { return map.width; }
+        int height() const override { return map.height; }
+        void read(int level, int x, int z, int w, int h,
+                  unsigned char *out) const override;
+
+      private:
+        const Heightmap &map;
+};
+
+/* The island of create_heightmap at any size, computed as it is read.
+ * At 1024 x 1024 it matches create_heightmap texel for texel. */
+class NoiseSource : public HeightSource {
+      public:
+        NoiseSource(int width, int height, unsigned seed)
+                : map_width{width}, map_height{height}, noise{seed} {}
+
+        int width() const override { return map_width; }
+        int height() const override { return map_height; }
+        void read(int level, int x, int z, int w, int h,
+                  unsigned char *out) const override;
+
+      private:
+        int map_width;
+        int map_height;
+        /* fbm_noise isn't const but keeps no state between calls */
+        mutable perlin noise;
+};
+
+#endif /* HEIGHT_SOURCE_H */
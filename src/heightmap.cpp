@@ -0,0 +1,38 @@
+#include "heightmap.hpp"
+#include "noise.hpp"
+#include "trace.hpp"
+
+#include <glm/glm.hpp>
+
+float island_falloff(float x, float y) {
+        return glm::distance(glm::vec2(x, y), glm::vec2(0.5));
+}
+
+unsigned char island_height(perlin &noise, int x, int y, int width,
+                            int height) {
+        float v = noise.fbm_noise(x, y, 8);
+        v *= 0.5;
+        v +=  0.2;
+        v -= island_falloff((float)x / width, (float)y / height);
+        if (v < 0.0) {
+                v = 0.0;
+        }
+        return v * 255;
+}
+
+void create_noise(unsigned char *data, int width, int height, unsigned seed) {
+        TRACE_FUNCTION();
+        perlin p{seed};
+        for (int x = 0; x < width; x++) {
+                for (int y = 0; y < height; y++) {
+                        data[y * width + x] =
+                                island_height(p, x, y, width, height);
+                }
+        }
+}
+
+Heightmap create_heightmap(int width, int height, unsigned seed) {
+        Heightmap map{width, height};
+        create_noise(map.data.data(), width, height, seed);
+        return map;
+}
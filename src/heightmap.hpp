@@ -0,0 +1,63 @@
+#ifndef HEIGHTMAP_H
+#define HEIGHTMAP_H
+
+#include <algorithm>
+#include <cmath>
+#include <vector>
+
+/**
+ * 8-bit heightmap stored row major. Row 0 is the bottom of the map, the same
+ * way it ends up in the GL texture.
+ */
+class Heightmap {
+      public:
+        int width{};
+        int height{};
+        std::vector<unsigned char> data;
+
+        Heightmap() = default;
+        Heightmap(int width, int height)
+                : width{width}, height{height},
+                  data(static_cast<size_t>(width) * height) {}
+
+        unsigned char at(int x, int y) const { return data[y * width + x]; }
+
+        /* Bilinear lookup in [0, 1] with clamp to edge, like the GL sampler */
+        float sample(float u, float v) const {
+                float x = u * width - 0.5f;
+                float y = v * height - 0.5f;
+                float x_floor = std::floor(x);
+                float y_floor = std::floor(y);
+                float fx = x - x_floor;
+                float fy = y - y_floor;
+
+                int x0 = std::clamp(static_cast<int>(x_floor), 0, width - 1);
+                int x1 = std::clamp(static_cast<int>(x_floor) + 1, 0,
+                                    width - 1);
+                int y0 = std::clamp(static_cast<int>(y_floor), 0, height - 1);
+                int y1 = std::clamp(static_cast<int>(y_floor) + 1, 0,
+                                    height - 1);
+
+                float bottom = at(x0, y0) * (1.0f - fx) + at(x1, y0) * fx;
+                float top = at(x0, y1) * (1.0f - fx) + at(x1, y1) * fx;
+                return (bottom * (1.0f - fy) + top * fy) / 255.0f;
+        }
+};
+
+/* Amount subtracted from the noise so the map sinks into the sea at the edges,
+ * x and y are in [0, 1] */
+float island_falloff(float x, float y);
+
+class perlin;
+
+/* Height of texel x, y of a width * height island, what create_noise
+ * writes there */
+unsigned char island_height(perlin &noise, int x, int y, int width,
+                            int height);
+
+/* Fills a width * height buffer with island shaped fbm noise */
+void create_noise(unsigned char *data, int width, int height, unsigned seed);
+
+Heightmap create_heightmap(int width, int height, unsigned seed);
+
+#endif /* HEIGHTMAP_H */
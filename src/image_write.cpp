@@ -0,0 +1,87 @@
+#include "image_write.hpp"
+
+#include <algorithm>
+#include <cstdint>
+#include <fstream>
+#include <iostream>
+#include <vector>
+#include <zlib.h>
+
+static void put_u32(std::vector<unsigned char> &out, std::uint32_t v) {
+        out.push_back(v >> 24);
+        out.push_back(v >> 16);
+        out.push_back(v >> 8);
+        out.push_back(v);
+}
+
+static void write_chunk(std::ofstream &file, const char *type,
+                        const std::vector<unsigned char> &data) {
+        std::vector<unsigned char> chunk;
+        chunk.reserve(data.size() + 12);
+        put_u32(chunk, data.size());
+        chunk.insert(chunk.end(), type, type + 4);
+        chunk.insert(chunk.end(), data.begin(), data.end());
+
+        /* The CRC covers the chunk type and data but not the length */
+        uLong crc = crc32(0L, Z_NULL, 0);
+        crc = crc32(crc, chunk.data() + 4, chunk.size() - 4);
+        put_u32(chunk, crc);
+
+        file.write(reinterpret_cast<const char *>(chunk.data()), chunk.size());
+}
+
+bool write_png(const std::string &path, const unsigned char *pixels,
+               int width, int height, int channels) {
+        static const unsigned char color_types[] = {0, 0, 4, 2, 6};
+        if (channels < 1 || channels > 4) {
+                std::cout << "Cannot write PNG with " << channels
+                          << " channels\n";
+                return false;
+        }
+
+        /* Every row is prefixed with filter type 0 (none) */
+        size_t stride = static_cast<size_t>(width) * channels;
+        std::vector<unsigned char> raw((stride + 1) * height);
+        for (int y = 0; y < height; y++) {
+                unsigned char *row = &raw[y * (stride + 1)];
+                row[0] = 0;
+                std::copy(pixels + y * stride, pixels + (y + 1) * stride,
+                          row + 1);
+        }
+
+        uLongf compressed_size = compressBound(raw.size());
+        std::vector<unsigned char> idat(compressed_size);
+        if (compress2(idat.data(), &compressed_size, raw.data(), raw.size(),
+                      Z_DEFAULT_COMPRESSION) != Z_OK) {
+                std::cout << "Failed to compress PNG data for " << path
+                          << "\n";
+                return false;
+        }
+        idat.resize(compressed_size);
+
+        std::ofstream file{path, std::ios::binary};
+        if (!file.is_open()) {
+                std::cout << "Failed to open image file at path: " << path
+                          << "\n";
+                return false;
+        }
+
+        static const unsigned char signature[] = {0x89, 'P',  'N',  'G',
+                                                  '\r', '\n', 0x1a, '\n'};
+        file.write(reinterpret_cast<const char *>(signature),
+                   sizeof(signature));
+
+        std::vector<unsigned char> ihdr;
+        put_u32(ihdr, width);
+        put_u32(ihdr, height);
+        ihdr.push_back(8); // bit depth
+        ihdr.push_back(color_types[channels]);
+        ihdr.push_back(0); // deflate
+        ihdr.push_back(0); // adaptive filtering
+        ihdr.push_back(0); // no interlace
+        write_chunk(file, "IHDR", ihdr);
+        write_chunk(file, "IDAT", idat);
+        write_chunk(file, "IEND", {});
+
+        return file.good();
+}
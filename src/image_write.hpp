@@ -0,0 +1,13 @@
+#ifndef IMAGE_WRITE_H
+#define IMAGE_WRITE_H
+
+#include <string>
+
+/**
+ * Writes 8-bit pixels as a PNG. Rows are stored top to bottom and channels
+ * may be 1 (grey), 2 (grey + alpha), 3 (RGB) or 4 (RGBA).
+ */
+bool write_png(const std::string &path, const unsigned char *pixels,
+               int width, int height, int channels);
+
+#endif /* IMAGE_WRITE_H */
@@ -0,0 +1,85 @@
+#include "instance_buffer.hpp"
+#include "gl_state.hpp"
+#include "gl_stats.hpp"
+#include "trace.hpp"
+
+#include <iostream>
+#include <numeric>
+
+InstanceTransform pack_transform(const glm::mat4 &transform) {
+        glm::mat4 rows = glm::transpose(transform);
+        return {{rows[0], rows[1], rows[2]}};
+}
+
+InstanceBuffer::~InstanceBuffer() { release(); }
+
+InstanceBuffer::InstanceBuffer(InstanceBuffer &&other) noexcept
+        : VBO{other.VBO}, texture{other.texture}, indices{other.indices},
+          count{other.count} {
+        other.VBO = other.texture = other.indices = 0;
+        other.count = 0;
+}
+
+InstanceBuffer &InstanceBuffer::operator=(InstanceBuffer &&other) noexcept {
+        if (this != &other) {
+                release();
+                VBO = other.VBO;
+                texture = other.texture;
+                indices = other.indices;
+                count = other.count;
+                other.VBO = other.texture = other.indices = 0;
+                other.count = 0;
+        }
+        return *this;
+}
+
+void InstanceBuffer::release() {
+        GLState &state = GLState::instance();
+        state.delete_texture(texture);
+        state.delete_buffer(VBO);
+        state.delete_buffer(indices);
+        count = 0;
+}
+
+bool InstanceBuffer::upload(const InstanceTransform *transforms,
+                            size_t count) {
+        TRACE_FUNCTION();
+        /* Only 65536 texels are guaranteed, desktop drivers allow far more */
+        GLint max_texels = 0;
+        glGetIntegerv(GL_MAX_TEXTURE_BUFFER_SIZE, &max_texels);
+        if (count * 3 > static_cast<size_t>(max_texels)) {
+                std::cout << "Too many instances for a buffer texture: "
+                          << count << " > " << max_texels / 3 << "\n";
+                return false;
+        }
+
+        GLState &state = GLState::instance();
+        if (VBO == 0) {
+                glGenBuffers(1, &VBO);
+                glGenBuffers(1, &indices);
+                glGenTextures(1, &texture);
+        }
+        state.bind_buffer(GL_ARRAY_BUFFER, VBO);
+        buffer_data(GL_ARRAY_BUFFER, count * sizeof(InstanceTransform),
+                    transforms, GL_STATIC_DRAW);
+        state.bind_texture(GL_TEXTURE_BUFFER, texture);
+        glTexBuffer(GL_TEXTURE_BUFFER, GL_RGBA32F, VBO);
+
+        std::vector<GLuint> order(count);
+        std::iota(order.begin(), order.end(), 0u);
+        state.bind_buffer(GL_ARRAY_BUFFER, indices);
+        buffer_data(GL_ARRAY_BUFFER, count * sizeof(GLuint), order.data(),
+                    GL_STATIC_DRAW);
+        this->count = count;
+        return true;
+}
+
+bool InstanceBuffer::upload(const std::vector<ScatterInstance> &instances) {
+        std::vector<InstanceTransform> transforms;
+        transforms.reserve(instances.size());
+        for (const ScatterInstance &instance : instances) {
+                transforms.push_back(
+                        pack_transform(instance_transform(instance)));
+        }
+        return upload(transforms.data(), transforms.size());
+}
@@ -0,0 +1,58 @@
+#ifndef INSTANCE_BUFFER_H
+#define INSTANCE_BUFFER_H
+
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+
+#include <vector>
+
+#include "scatter.hpp"
+
+/* Vertex attribute of the instance index, after the mesh's own */
+const GLuint INSTANCE_ATTRIBUTE = 3;
+
+/* Texture unit of the transform buffer texture, below the material array */
+const GLuint INSTANCE_TRANSFORM_UNIT = 14;
+
+/* Top three rows of an affine model matrix, 48 bytes instead of 64. The
+ * shader rebuilds the position as dot(row, vec4(p, 1)) per component. */
+struct InstanceTransform {
+        glm::vec4 rows[3];
+};
+
+InstanceTransform pack_transform(const glm::mat4 &transform);
+
+/**
+ * Per instance transforms in a buffer texture, three RGBA32F texels each,
+ * and a stream of instance indices 0..count-1 read with a divisor of one.
+ * Scatter.vs fetches the transform of the index it is given, so a culling
+ * pass only has to write out the indices it keeps, see InstanceCuller.
+ * Draw with Model::draw_instanced. Owns its GL objects, so it can be moved
+ * but not copied.
+ */
+class InstanceBuffer {
+      public:
+        GLuint VBO{0};
+        /* Buffer texture over VBO */
+        GLuint texture{0};
+        /* Every instance index, in order */
+        GLuint indices{0};
+        GLsizei count{0};
+
+        InstanceBuffer() = default;
+        ~InstanceBuffer();
+        InstanceBuffer(InstanceBuffer &&other) noexcept;
+        InstanceBuffer &operator=(InstanceBuffer &&other) noexcept;
+        InstanceBuffer(const InstanceBuffer &) = delete;
+        InstanceBuffer &operator=(const InstanceBuffer &) = delete;
+
+        /* Replaces the contents, reallocating the buffers. Fails when
+         * the transforms don't fit GL_MAX_TEXTURE_BUFFER_SIZE. */
+        bool upload(const InstanceTransform *transforms, size_t count);
+        bool upload(const std::vector<ScatterInstance> &instances);
+
+      private:
+        void release();
+};
+
+#endif /* INSTANCE_BUFFER_H */
@@ -0,0 +1,154 @@
+#include "instance_culler.hpp"
+#include "frustum.hpp"
+#include "gl_state.hpp"
+#include "gl_stats.hpp"
+#include "model.hpp"
+#include "trace.hpp"
+
+#include <algorithm>
+#include <cmath>
+
+static const char *const CULL_VARYINGS[] = {"visible_instance"};
+
+InstanceCuller::InstanceCuller(glm::vec3 center, float radius,
+                               const std::vector<float> &lod_errors)
+        : shader{"src/shaders/Cull.vs", "src/shaders/Cull.gs", CULL_VARYINGS,
+                 1},
+          bounds{center, radius}, lod_errors{lod_errors} {
+        if (this->lod_errors.empty()) {
+                this->lod_errors.push_back(0.0f);
+        }
+        if (this->lod_errors.size() > CULL_MAX_LODS) {
+                this->lod_errors.resize(CULL_MAX_LODS);
+        }
+        for (Slot &slot : slots) {
+                slot.result.levels = this->lod_errors.size();
+                glGenBuffers(slot.result.levels, slot.result.buffers);
+                glGenQueries(slot.result.levels, slot.queries);
+        }
+        glGenVertexArrays(1, &empty_vao);
+}
+
+InstanceCuller::~InstanceCuller() {
+        GLState &state = GLState::instance();
+        state.delete_vertex_array(empty_vao);
+        for (Slot &slot : slots) {
+                for (size_t lod = 0; lod < slot.result.levels; lod++) {
+                        state.delete_buffer(slot.result.buffers[lod]);
+                }
+                glDeleteQueries(slot.result.levels, slot.queries);
+        }
+}
+
+/* Grows every buffer to hold count indices, the contents are lost */
+void InstanceCuller::reserve(GLsizei count) {
+        if (count <= capacity) {
+                return;
+        }
+        GLState &state = GLState::instance();
+        for (Slot &slot : slots) {
+                for (size_t lod = 0; lod < slot.result.levels; lod++) {
+                        state.bind_buffer(GL_TRANSFORM_FEEDBACK_BUFFER,
+                                          slot.result.buffers[lod]);
+                        buffer_data(GL_TRANSFORM_FEEDBACK_BUFFER,
+                                    count * sizeof(GLuint), NULL,
+                                    GL_DYNAMIC_COPY);
+                }
+                slot.pending = slot.ready = false;
+        }
+        capacity = count;
+}
+
+void InstanceCuller::cull(const InstanceBuffer &instances,
+                          const glm::mat4 &view_projection, glm::vec3 camera,
+                          float fovy, float viewport_height) {
+        TRACE_FUNCTION();
+        Slot &slot = slots[culls % CULL_FRAMES];
+        culls++;
+        slot.ready = slot.pending = false;
+        if (instances.count == 0) {
+                std::fill(std::begin(slot.result.counts),
+                          std::end(slot.result.counts), 0);
+                slot.ready = true;
+                return;
+        }
+        reserve(instances.count);
+
+        GLState &state = GLState::instance();
+        Frustum frustum{view_projection};
+        float pixel_scale = viewport_height / (2.0f * std::tan(fovy * 0.5f));
+        shader.use();
+        shader.set_uniform("planes", frustum.planes, 6);
+        shader.set_uniform("camera_position", camera);
+        shader.set_uniform("bounds", &bounds, 1);
+        shader.set_uniform("viewport_height", viewport_height);
+        shader.set_uniform("pixel_scale", pixel_scale);
+        shader.set_uniform("lod_errors", lod_errors.data(),
+                           lod_errors.size());
+        shader.set_uniform("lod_count", static_cast<int>(lod_errors.size()));
+        shader.set_uniform("max_pixel_error", LOD_PIXEL_ERROR);
+        state.bind_texture(INSTANCE_TRANSFORM_UNIT, GL_TEXTURE_BUFFER,
+                           instances.texture);
+        shader.set_uniform("instance_transforms", INSTANCE_TRANSFORM_UNIT);
+        state.bind_vertex_array(empty_vao);
+
+        glEnable(GL_RASTERIZER_DISCARD);
+        for (size_t lod = 0; lod < slot.result.levels; lod++) {
+                shader.set_uniform("lod", static_cast<int>(lod));
+                state.bind_buffer_base(GL_TRANSFORM_FEEDBACK_BUFFER, 0,
+                                       slot.result.buffers[lod]);
+                glBeginQuery(GL_TRANSFORM_FEEDBACK_PRIMITIVES_WRITTEN,
+                             slot.queries[lod]);
+                glBeginTransformFeedback(GL_POINTS);
+                draw_arrays(GL_POINTS, 0, instances.count);
+                glEndTransformFeedback();
+                glEndQuery(GL_TRANSFORM_FEEDBACK_PRIMITIVES_WRITTEN);
+        }
+        glDisable(GL_RASTERIZER_DISCARD);
+        slot.pending = true;
+}
+
+bool InstanceCuller::resolve(Slot &slot, bool block) {
+        if (!slot.pending) {
+                return slot.ready;
+        }
+        if (!block) {
+                for (size_t lod = 0; lod < slot.result.levels; lod++) {
+                        GLuint available = GL_FALSE;
+                        glGetQueryObjectuiv(slot.queries[lod],
+                                            GL_QUERY_RESULT_AVAILABLE,
+                                            &available);
+                        if (!available) {
+                                return false;
+                        }
+                }
+        }
+        for (size_t lod = 0; lod < slot.result.levels; lod++) {
+                GLuint count = 0;
+                glGetQueryObjectuiv(slot.queries[lod], GL_QUERY_RESULT,
+                                    &count);
+                slot.result.counts[lod] = count;
+        }
+        slot.pending = false;
+        slot.ready = true;
+        return true;
+}
+
+const CullResult &InstanceCuller::visible() {
+        TRACE_FUNCTION();
+        size_t in_flight = std::min(culls, CULL_FRAMES);
+        for (size_t age = 0; age < in_flight; age++) {
+                Slot &slot = slots[(culls - 1 - age) % CULL_FRAMES];
+                if (resolve(slot, false)) {
+                        return slot.result;
+                }
+        }
+        if (in_flight == 0) {
+                return empty;
+        }
+        /* Nothing finished, the newest cull will be first to */
+        Slot &newest = slots[(culls - 1) % CULL_FRAMES];
+        stall_count++;
+        resolve(newest, true);
+        return newest.result;
+}
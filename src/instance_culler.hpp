@@ -0,0 +1,99 @@
+#ifndef INSTANCE_CULLER_H
+#define INSTANCE_CULLER_H
+
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+
+#include <cstddef>
+#include <vector>
+
+#include "instance_buffer.hpp"
+#include "shader.hpp"
+
+/* Levels the cull shader can choose from, MAX_LODS in Cull.vs */
+const size_t CULL_MAX_LODS = 8;
+/* Culls in flight before one has to be waited for */
+const size_t CULL_FRAMES = 3;
+
+/* Visible instances of one cull, per LOD level the indices to draw from
+ * buffers[lod] and how many of them there are */
+struct CullResult {
+        GLuint buffers[CULL_MAX_LODS]{};
+        GLsizei counts[CULL_MAX_LODS]{};
+        size_t levels{0};
+};
+
+/**
+ * Frustum culling and LOD selection of instances on the GPU.
+ *
+ * Cull.vs tests the bounding sphere of every instance against the frustum
+ * and picks its level the way Model::select_lod would. Cull.gs drops the
+ * rejected points and transform feedback writes the indices of the rest,
+ * packed, into one buffer per level. GL 3.3 can't send a geometry shader's
+ * output to several streams, so each level is a pass over all instances;
+ * the vertex work is trivial, 100k instances take a few dozen
+ * microseconds per pass on a desktop GPU.
+ *
+ * How many indices a pass wrote is only known to the GPU. GL 3.3 has no
+ * indirect draws to feed that count back, so it is taken from a
+ * GL_TRANSFORM_FEEDBACK_PRIMITIVES_WRITTEN query, and to never wait on one
+ * the culls go round a ring of CULL_FRAMES sets of buffers and queries.
+ * visible returns the newest set whose queries have finished, usually the
+ * one just issued or the frame before. Its buffers hold exactly the
+ * instances counted, so a late result only shows the view of that frame.
+ * Only when nothing has finished yet, on the first frame, does it block.
+ *
+ *      culler.cull(rocks, projection * view, camera_position, fovy,
+ *                  height);
+ *      const CullResult &visible = culler.visible();
+ *      for (size_t lod = 0; lod < visible.levels; lod++) {
+ *              rock.draw_instanced(shader, rocks, visible.buffers[lod],
+ *                                  visible.counts[lod], lod);
+ *      }
+ */
+class InstanceCuller {
+      public:
+        /* Bounding sphere and LOD errors of the model being instanced */
+        InstanceCuller(glm::vec3 center, float radius,
+                       const std::vector<float> &lod_errors);
+        ~InstanceCuller();
+        InstanceCuller(const InstanceCuller &) = delete;
+        InstanceCuller &operator=(const InstanceCuller &) = delete;
+
+        /* Queues the passes, returns without waiting for them */
+        void cull(const InstanceBuffer &instances,
+                  const glm::mat4 &view_projection, glm::vec3 camera,
+                  float fovy, float viewport_height);
+
+        /* Newest finished cull, empty before the first one */
+        const CullResult &visible();
+
+        /* How often visible had to wait for the GPU */
+        size_t stalls() const { return stall_count; }
+
+      private:
+        struct Slot {
+                CullResult result;
+                GLuint queries[CULL_MAX_LODS]{};
+                bool pending{false};
+                bool ready{false};
+        };
+
+        Shader shader;
+        /* The passes read no attributes but GL 3.3 core wants a VAO bound */
+        GLuint empty_vao{0};
+        glm::vec4 bounds;
+        std::vector<float> lod_errors;
+        Slot slots[CULL_FRAMES];
+        /* Indices each buffer has room for */
+        GLsizei capacity{0};
+        size_t culls{0};
+        size_t stall_count{0};
+        CullResult empty;
+
+        void reserve(GLsizei count);
+        /* Reads the counts if the queries are done, or waits when block */
+        bool resolve(Slot &slot, bool block);
+};
+
+#endif /* INSTANCE_CULLER_H */
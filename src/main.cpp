@@ -4,33 +4,107 @@
 #include <glm/glm.hpp>
 #include <glm/gtc/matrix_transform.hpp>
 #include <glm/gtc/type_ptr.hpp>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <filesystem>
+#include <memory>
+#include <stdexcept>
 #include <stb_image.h>
-
+#include <string>
+#include <vector>
+
+#include "cdlod_renderer.hpp"
+#include "clipmap_renderer.hpp"
+#include "flycamera.hpp"
+#include "gl_state.hpp"
+#include "gl_stats.hpp"
+#include "headless.hpp"
+#include "height_query.hpp"
+#include "image_write.hpp"
+#include "instance_culler.hpp"
 #include "mapcamera.hpp"
-#include "noise.hpp"
+#include "model.hpp"
+#include "renderer.hpp"
+#include "renderpass.hpp"
+#include "scatter.hpp"
 #include "shader.hpp"
+#include "texture_manager.hpp"
+#include "tiled_heightmap.hpp"
+#include "trace.hpp"
+#include "viewshed.hpp"
 
 
 void framebuffer_size_callback(GLFWwindow *window, int width, int height);
 void process_input(GLFWwindow *window);
 void mouse_callback(GLFWwindow *window, double xposIn, double yposIn);
 void scroll_callback(GLFWwindow *window, double xoffset, double yoffset);
+void key_callback(GLFWwindow *window, int key, int scancode, int action,
+                  int mods);
 GLuint load_texture(const char *);
 
-void render_quad(GLuint vao, GLuint vbo);
-void create_noise(GLbyte *data, int width, int height);
+struct Options {
+        bool headless{false};
+        unsigned seed;
+        glm::vec3 sun_dir{1.0, 0.0, -1.0};
+        int size{1024};
+        std::string out_path{"map.png"};
+        bool stats{false};
+        /* 3D terrain renderer, empty for the flat map */
+        std::string terrain;
+        /* Side of the world the clipmap terrain streams */
+        int world{1024};
+        /* Tiled heightmap the clipmap streams instead, baked if missing */
+        std::string world_file;
+};
+
+bool parse_args(int argc, char **argv, Options &options);
+int run_headless(const Options &options);
+std::unique_ptr<TiledHeightmap> open_world_file(const std::string &path,
+                                                const HeightSource &world);
+void scatter_rocks(const HeightSource &source, int x, int z, int width,
+                   int height, unsigned seed, InstanceBuffer &rocks);
+
+/* Side of the block of the streamed world around the start that gets rocks */
+const int ROCK_FIELD_SIZE = 1024;
 
 static int screen_width = 800;
 static int screen_height = 800;
 
-MapCamera camera{0.0f, 0.0f, 4.0f};
+MapCamera map_camera{0.0f, 0.0f, 4.0f};
+/* Over the south edge of the map, looking north across it */
+FlyCamera fly_camera{512.0f, 80.0f, 1150.0f, 800.0f, 800.0f};
+Camera *camera = &map_camera;
+
+/* Terrain the cursor picks on, unset while flying over the streamed world */
+static const HeightQuery *height_query = nullptr;
+/* Map cell under the cursor, or under the screen centre when flying */
+static glm::ivec2 selected_cell{-1};
+/* Shown on the flat map, recomputed when the list changes */
+static std::vector<Observer> observers;
+static bool observers_changed = false;
 
 static float deltaTime = 0.0f;
 static float lastFrame = 0.0f;
 
 glm::vec3 sun_dir{1.0, 0.0, -1.0};
 
-int main() {
+int main(int argc, char **argv) {
+        Options options{};
+        options.seed =
+                std::chrono::system_clock::now().time_since_epoch().count();
+        if (!parse_args(argc, argv, options)) {
+                return -1;
+        }
+        std::cout << "Seed: " << options.seed << "\n";
+
+        if (options.headless) {
+                return run_headless(options);
+        }
+
+        TRACE_BEGIN_SESSION("trace.json");
+        TRACE_THREAD_NAME("main");
+
         glfwInit();
         glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 3);
         glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 3);
@@ -45,17 +119,22 @@ int main() {
         if (window == NULL) {
                 std::cout << "Failed to create glfw window\n";
                 glfwTerminate();
+                TRACE_END_SESSION();
                 return -1;
         }
         glfwMakeContextCurrent(window);
         glfwSetFramebufferSizeCallback(window, framebuffer_size_callback);
         glfwSetCursorPosCallback(window, mouse_callback);
         glfwSetScrollCallback(window, scroll_callback);
+        glfwSetKeyCallback(window, key_callback);
 
-        glfwSetInputMode(window, GLFW_CURSOR, GLFW_CURSOR_CAPTURED);
+        glfwSetInputMode(window, GLFW_CURSOR,
+                         options.terrain.empty() ? GLFW_CURSOR_CAPTURED
+                                                 : GLFW_CURSOR_DISABLED);
 
         if (!gladLoadGLLoader((GLADloadproc)glfwGetProcAddress)) {
                 std::cout << "Failed to initialize GLAD\n";
+                TRACE_END_SESSION();
                 return -1;
         }
 
@@ -63,100 +142,323 @@ int main() {
 
         glEnable(GL_DEPTH_TEST);
 
-        Shader texShader{"src/shaders/TexShader.vs",
-                         "src/shaders/StepShadow.fs"};
-
-        GLuint perlin_map;
-        glGenTextures(1, &perlin_map);
-        glBindTexture(GL_TEXTURE_2D, perlin_map);
+        FullscreenPass map_pass{"src/shaders/StepShadow.fs"};
+        set_terrain_uniforms(map_pass.shader);
 
-        GLbyte *perlin_data = new GLbyte[1024 * 1024];
-        create_noise(perlin_data, 1024, 1024);
-
-        glTexImage2D(GL_TEXTURE_2D, 0, GL_DEPTH_COMPONENT, 1024, 1024, 0,
-                     GL_DEPTH_COMPONENT, GL_UNSIGNED_BYTE, perlin_data);
-        glGenerateMipmap(GL_TEXTURE_2D);
-
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER,
-                        GL_LINEAR_MIPMAP_LINEAR);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+        Heightmap heightmap = create_heightmap(1024, 1024, options.seed);
+        GLuint perlin_map = create_heightmap_texture(heightmap);
+        map_pass.set_input("perlin_map", 0, perlin_map);
+        GLuint visibility_texture = 0;
+        HeightQuery query{heightmap};
+        if (options.terrain != "clipmap") {
+                height_query = &query;
+        }
 
-        glActiveTexture(GL_TEXTURE0);
-        glBindTexture(GL_TEXTURE_2D, perlin_map);
+        std::unique_ptr<CdlodRenderer> cdlod;
+        NoiseSource world{options.world, options.world, options.seed};
+        std::unique_ptr<TiledHeightmap> world_file;
+        const HeightSource *streamed = &world;
+        std::unique_ptr<ClipmapRenderer> clipmap;
+        if (options.terrain == "cdlod") {
+                cdlod = std::make_unique<CdlodRenderer>(heightmap, perlin_map);
+        } else if (options.terrain == "clipmap") {
+                if (!options.world_file.empty()) {
+                        world_file = open_world_file(options.world_file, world);
+                        if (!world_file) {
+                                glfwTerminate();
+                                TRACE_END_SESSION();
+                                return -1;
+                        }
+                        streamed = world_file.get();
+                }
+                clipmap = std::make_unique<ClipmapRenderer>(*streamed);
+                fly_camera.Position = glm::vec3(streamed->width() / 2, 80.0f,
+                                                streamed->height() / 2 + 638);
+        }
+        if (!options.terrain.empty()) {
+                camera = &fly_camera;
+                fly_camera.MovementSpeed = 100.0f;
+                sun_dir = glm::normalize(options.sun_dir);
+        }
 
-        GLuint quad_vao{}, quad_vbo{};
+        /* Rocks on the terrain the fly camera looks at, culled on the GPU
+         * and drawn with one instanced draw per LOD level */
+        std::unique_ptr<Model> rock;
+        std::unique_ptr<Shader> rock_shader;
+        std::unique_ptr<InstanceCuller> rock_culler;
+        InstanceBuffer rocks;
+        if (cdlod) {
+                scatter_rocks(HeightmapSource{heightmap}, 0, 0,
+                              heightmap.width, heightmap.height, options.seed,
+                              rocks);
+        } else if (clipmap) {
+                int width = std::min(ROCK_FIELD_SIZE, streamed->width());
+                int height = std::min(ROCK_FIELD_SIZE, streamed->height());
+                int x = std::clamp(int(fly_camera.Position.x) - width / 2, 0,
+                                   streamed->width() - width);
+                /* The camera starts on the south side looking north */
+                int z = std::clamp(int(fly_camera.Position.z) - height, 0,
+                                   streamed->height() - height);
+                scatter_rocks(*streamed, x, z, width, height, options.seed,
+                              rocks);
+        }
+        if (rocks.count > 0) {
+                rock = std::make_unique<Model>("resources/rock/rock.obj");
+                rock_shader = std::make_unique<Shader>(
+                        "src/shaders/Scatter.vs", "src/shaders/Model.fs");
+                rock_culler = std::make_unique<InstanceCuller>(
+                        rock->center, rock->radius, rock->lod_errors);
+        }
 
+        /* Only changes with the mouse, so most frames upload nothing */
+        glm::vec3 drawn_sun_dir{0.0f};
+        GLStats &stats = GLStats::instance();
+        stats.reset();
+        float hud_time = 0.0f;
+        size_t hud_frames = 0;
         while (!glfwWindowShouldClose(window)) {
+                TRACE_SCOPE("frame");
                 float currentFrame = glfwGetTime();
                 deltaTime = currentFrame - lastFrame;
                 lastFrame = currentFrame;
 
                 process_input(window);
+                TextureManager::instance().upload_pending();
 
                 glClearColor(0.1f, 0.1f, 0.1f, 1.0f);
                 glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
 
-                texShader.use();
-                texShader.set_uniform("sun_dir", sun_dir);
-                texShader.set_uniform("perlin_map", 0);
-                render_quad(quad_vao, quad_vbo);
+                glm::mat4 projection = glm::perspective(
+                        glm::radians(fly_camera.FOV),
+                        float(screen_width) / screen_height, 1.0f, 40000.0f);
+                glm::mat4 view = fly_camera.GetViewMatrix();
+                if (cdlod) {
+                        cdlod->draw(view, projection, fly_camera.Position,
+                                    sun_dir);
+                } else if (clipmap) {
+                        clipmap->draw(view, projection, fly_camera.Position,
+                                      sun_dir);
+                } else {
+                        if (observers_changed) {
+                                VisibilityMask mask =
+                                        combined_viewshed(heightmap, observers);
+                                if (visibility_texture == 0) {
+                                        visibility_texture =
+                                                create_visibility_texture(mask);
+                                        map_pass.set_input("viewshed",
+                                                           VIEWSHED_UNIT,
+                                                           visibility_texture);
+                                } else {
+                                        update_visibility_texture(
+                                                visibility_texture, mask);
+                                }
+                                map_pass.shader.use();
+                                map_pass.shader.set_uniform(
+                                        "show_viewshed",
+                                        observers.empty() ? 0 : 1);
+                                observers_changed = false;
+                        }
+                        if (sun_dir != drawn_sun_dir) {
+                                map_pass.shader.use();
+                                map_pass.shader.set_uniform("sun_dir",
+                                                            sun_dir);
+                                drawn_sun_dir = sun_dir;
+                        }
+                        map_pass.draw_to_screen(screen_width, screen_height);
+                }
+                if (rock) {
+                        rock_culler->cull(rocks, projection * view,
+                                          fly_camera.Position,
+                                          glm::radians(fly_camera.FOV),
+                                          screen_height);
+                        const CullResult &visible = rock_culler->visible();
+                        rock_shader->use();
+                        rock_shader->set_uniform("view", view);
+                        rock_shader->set_uniform("projection", projection);
+                        rock_shader->set_uniform("sun_dir", sun_dir);
+                        for (size_t lod = 0; lod < visible.levels; lod++) {
+                                rock->draw_instanced(*rock_shader, rocks,
+                                                     visible.buffers[lod],
+                                                     visible.counts[lod], lod);
+                        }
+                }
+                stats.end_frame();
+
+                /* The HUD is the window title, refreshed twice a second */
+                if (currentFrame - hud_time >= 0.5f) {
+                        float fps = (stats.frame_count() - hud_frames) /
+                                    (currentFrame - hud_time);
+                        std::string title = "MapSim | " +
+                                            std::to_string(int(fps + 0.5f)) +
+                                            " fps | " + stats.summary();
+                        if (selected_cell.x >= 0) {
+                                title += " | cell " +
+                                         std::to_string(selected_cell.x) +
+                                         ", " +
+                                         std::to_string(selected_cell.y);
+                        }
+                        glfwSetWindowTitle(window, title.c_str());
+                        hud_time = currentFrame;
+                        hud_frames = stats.frame_count();
+                }
 
                 glfwSwapBuffers(window);
                 glfwPollEvents();
         }
 
+        if (options.stats) {
+                stats.dump(std::cout);
+        }
+        TextureManager::instance().shutdown();
         glfwTerminate();
+        TRACE_END_SESSION();
         return 0;
 }
 
-void create_noise(GLbyte *data, int width, int height) {
-        perlin p{};
-        for (int x = 0; x < width; x++) {
-                for (int y = 0; y < height; y++) {
-                        float v = p.fbm_noise(x, y, 8);
-                        v *= 0.5;
-                        v +=  0.2;
-                        float xpos = (float)x / width;
-                        float ypos = (float)y / height;
-                        float c = glm::distance(glm::vec2(xpos, ypos), glm::vec2(0.5));
-                        v -= c;
-                        if (v < 0.0) {
-                                v = 0.0;
+/* Bakes the world to path the first time, later runs stream it from there
+ * whatever --world says. A file that doesn't validate is baked again. */
+std::unique_ptr<TiledHeightmap> open_world_file(const std::string &path,
+                                                const HeightSource &world) {
+        if (std::filesystem::exists(path)) {
+                auto file = std::make_unique<TiledHeightmap>(path);
+                if (file->valid()) {
+                        return file;
+                }
+                std::cout << "Invalid tiled heightmap: " << path << "\n";
+        }
+        std::cout << "Baking the world to " << path << "\n";
+        if (!write_tiled_heightmap(path, world)) {
+                return nullptr;
+        }
+        auto file = std::make_unique<TiledHeightmap>(path);
+        if (!file->valid()) {
+                std::cout << "Invalid tiled heightmap: " << path << "\n";
+                return nullptr;
+        }
+        return file;
+}
+
+/* Scatters rocks over the width x height block of source with its corner at
+ * x, z and uploads them to rocks, in world units */
+void scatter_rocks(const HeightSource &source, int x, int z, int width,
+                   int height, unsigned seed, InstanceBuffer &rocks) {
+        TRACE_FUNCTION();
+        Heightmap block{width, height};
+        source.read(0, x, z, width, height, block.data.data());
+        ScatterSettings settings;
+        settings.seed = seed;
+        std::vector<ScatterInstance> instances =
+                scatter_instances(block, settings);
+        for (ScatterInstance &instance : instances) {
+                instance.position += glm::vec3(x, 0.0f, z);
+        }
+        /* Reports a failure itself and leaves rocks empty */
+        rocks.upload(instances);
+}
+
+/* 3D terrain renderers --terrain can pick */
+static bool is_terrain_mode(const char *name) {
+        return std::strcmp(name, "cdlod") == 0 ||
+               std::strcmp(name, "clipmap") == 0;
+}
+
+static void print_usage(const char *name) {
+        std::cout << "Usage: " << name
+                  << " [--seed N] [--stats] [--sun x,y,z]"
+                     " [--terrain cdlod|clipmap [--world N]"
+                     " [--world-file F]]"
+                     " [--headless"
+                     " [--size N] [--out map.png]]\n";
+}
+
+static bool parse_options(int argc, char **argv, Options &options) {
+        for (int i = 1; i < argc; i++) {
+                bool has_value = i + 1 < argc;
+                if (std::strcmp(argv[i], "--headless") == 0) {
+                        options.headless = true;
+                } else if (std::strcmp(argv[i], "--seed") == 0 && has_value) {
+                        options.seed = std::stoul(argv[++i]);
+                } else if (std::strcmp(argv[i], "--size") == 0 && has_value) {
+                        options.size = std::stoi(argv[++i]);
+                } else if (std::strcmp(argv[i], "--stats") == 0) {
+                        options.stats = true;
+                } else if (std::strcmp(argv[i], "--terrain") == 0 &&
+                           has_value && is_terrain_mode(argv[i + 1])) {
+                        options.terrain = argv[++i];
+                } else if (std::strcmp(argv[i], "--world") == 0 && has_value) {
+                        options.world = std::stoi(argv[++i]);
+                } else if (std::strcmp(argv[i], "--world-file") == 0 &&
+                           has_value) {
+                        options.world_file = argv[++i];
+                } else if (std::strcmp(argv[i], "--out") == 0 && has_value) {
+                        options.out_path = argv[++i];
+                } else if (std::strcmp(argv[i], "--sun") == 0 && has_value) {
+                        glm::vec3 &v = options.sun_dir;
+                        if (std::sscanf(argv[++i], "%f,%f,%f", &v.x, &v.y,
+                                        &v.z) != 3) {
+                                std::cout << "--sun expects x,y,z\n";
+                                return false;
                         }
-                        data[y * height + x] = v * 255;
+                } else {
+                        print_usage(argv[0]);
+                        return false;
                 }
         }
+        return true;
 }
 
-void render_quad(GLuint vao, GLuint vbo) {
-        if (vao == 0) {
-                // clang-format off
-                float quadVertices[] = {
-                        -1.0f,  1.0f, 0.0f, 0.0f, 1.0f,
-                        -1.0f, -1.0f, 0.0f, 0.0f, 0.0f,
-                         1.0f,  1.0f, 0.0f, 1.0f, 1.0f,
-                         1.0f, -1.0f, 0.0f, 1.0f, 0.0f,
-                };
-                // clang-format on
-                glGenVertexArrays(1, &vao);
-                glGenBuffers(1, &vbo);
-                glBindVertexArray(vao);
-                glBindBuffer(GL_ARRAY_BUFFER, vbo);
-                glBufferData(GL_ARRAY_BUFFER, sizeof(quadVertices),
-                             &quadVertices, GL_STATIC_DRAW);
-                glEnableVertexAttribArray(0);
-                glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE,
-                                      5 * sizeof(float), (void *)0);
-                glEnableVertexAttribArray(1);
-                glVertexAttribPointer(1, 2, GL_FLOAT, GL_FALSE,
-                                      5 * sizeof(float),
-                                      (void *)(3 * sizeof(float)));
-        }
-        glBindVertexArray(vao);
-        glDrawArrays(GL_TRIANGLE_STRIP, 0, 4);
-        glBindVertexArray(0);
+bool parse_args(int argc, char **argv, Options &options) {
+        /* std::stoi and friends throw invalid_argument or out_of_range, both
+         * logic_errors, on values that aren't numbers */
+        try {
+                if (!parse_options(argc, argv, options)) {
+                        return false;
+                }
+        } catch (const std::logic_error &) {
+                print_usage(argv[0]);
+                return false;
+        }
+        if (options.size < 1 || options.world < 1) {
+                std::cout << "--size and --world must be at least 1\n";
+                return false;
+        }
+        return true;
+}
+
+/* Renders one map for the given seed and sun direction to an image */
+int run_headless(const Options &options) {
+        TRACE_BEGIN_SESSION("trace.json");
+        TRACE_THREAD_NAME("main");
+
+        GLFWwindow *window = create_headless_context();
+        if (window == NULL) {
+                TRACE_END_SESSION();
+                return -1;
+        }
+
+        Heightmap heightmap = create_heightmap(1024, 1024, options.seed);
+
+        std::vector<unsigned char> pixels(static_cast<size_t>(options.size) *
+                                          options.size * 3);
+        {
+                OffscreenRenderer renderer{options.size, options.size};
+                renderer.render(heightmap, glm::normalize(options.sun_dir),
+                                pixels.data());
+                GLStats::instance().end_frame();
+        }
+        if (options.stats) {
+                GLStats::instance().dump(std::cout);
+        }
+
+        bool written = write_png(options.out_path, pixels.data(), options.size,
+                                 options.size, 3);
+        if (written) {
+                std::cout << "Wrote " << options.out_path << "\n";
+        }
+
+        glfwTerminate();
+        TRACE_END_SESSION();
+        return written ? 0 : -1;
 }
 
 void framebuffer_size_callback(GLFWwindow *window, int width, int height) {
@@ -170,30 +472,75 @@ void process_input(GLFWwindow *window) {
                 glfwSetWindowShouldClose(window, true);
         }
         if (glfwGetKey(window, GLFW_KEY_W) == GLFW_PRESS) {
-                camera.ProcessKeyboard(NORTH, deltaTime);
+                camera->ProcessKeyboard(NORTH, deltaTime);
         }
         if (glfwGetKey(window, GLFW_KEY_S) == GLFW_PRESS) {
-                camera.ProcessKeyboard(SOUTH, deltaTime);
+                camera->ProcessKeyboard(SOUTH, deltaTime);
         }
         if (glfwGetKey(window, GLFW_KEY_A) == GLFW_PRESS) {
-                camera.ProcessKeyboard(EAST, deltaTime);
+                camera->ProcessKeyboard(EAST, deltaTime);
         }
         if (glfwGetKey(window, GLFW_KEY_D) == GLFW_PRESS) {
-                camera.ProcessKeyboard(WEST, deltaTime);
+                camera->ProcessKeyboard(WEST, deltaTime);
+        }
+}
+
+/* The flat map fills the window with row 0 at the bottom, the 3D terrain
+ * picks along the view direction */
+static void pick_cell(float xpos, float ypos) {
+        if (!height_query) {
+                return;
+        }
+        if (camera == &map_camera) {
+                const Heightmap &map = height_query->heightmap();
+                selected_cell = glm::clamp(
+                        glm::ivec2(xpos / screen_width * map.width,
+                                   (1.0f - ypos / screen_height) *
+                                           map.height),
+                        glm::ivec2(0), glm::ivec2(map.width - 1,
+                                                  map.height - 1));
+                return;
+        }
+        TerrainHit hit;
+        if (height_query->intersect({fly_camera.Position, fly_camera.Front,
+                                     40000.0f},
+                                    hit)) {
+                selected_cell = hit.cell;
+        } else {
+                selected_cell = glm::ivec2(-1);
         }
 }
 
 void mouse_callback(GLFWwindow *window, double xposIn, double yposIn) {
         float xpos = static_cast<float>(xposIn);
         float ypos = static_cast<float>(yposIn);
-        camera.ProcessMouseMovement(xpos, ypos);
+        camera->ProcessMouseMovement(xpos, ypos);
+        pick_cell(xpos, ypos);
+        if (camera != &map_camera) {
+                return;
+        }
 
         sun_dir = glm::normalize(glm::vec3((screen_width >> 1) - xpos,
                                            -((screen_height >> 1) - ypos), -1000.0));
 }
 
 void scroll_callback(GLFWwindow *window, double xoffset, double yoffset) {
-        camera.ProcessMouseScroll(yoffset);
+        camera->ProcessMouseScroll(yoffset);
+}
+
+/* V adds an observer on the selected cell, C clears them */
+void key_callback(GLFWwindow *window, int key, int scancode, int action,
+                  int mods) {
+        if (action != GLFW_PRESS) {
+                return;
+        }
+        if (key == GLFW_KEY_V && selected_cell.x >= 0) {
+                observers.push_back({selected_cell});
+                observers_changed = true;
+        } else if (key == GLFW_KEY_C && !observers.empty()) {
+                observers.clear();
+                observers_changed = true;
+        }
 }
 
 GLuint load_texture(char const *path) {
@@ -213,9 +560,11 @@ GLuint load_texture(char const *path) {
                         format = GL_RGBA;
                 }
 
-                glBindTexture(GL_TEXTURE_2D, textureID);
+                GLState::instance().bind_texture(GL_TEXTURE_2D, textureID);
                 glTexImage2D(GL_TEXTURE_2D, 0, format, width, height, 0, format,
                              GL_UNSIGNED_BYTE, data);
+                GLStats::instance().count_upload(size_t(width) * height *
+                                                 nrComponents);
                 glGenerateMipmap(GL_TEXTURE_2D);
 
                 glTexParameteri(
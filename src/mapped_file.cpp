@@ -0,0 +1,90 @@
+#include "mapped_file.hpp"
+
+#include <filesystem>
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#ifdef _WIN32
+
+MappedFile::MappedFile(const std::string &path) {
+        file = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ, NULL,
+                           OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+        if (file == INVALID_HANDLE_VALUE) {
+                file = NULL;
+                return;
+        }
+        LARGE_INTEGER file_size;
+        if (!GetFileSizeEx(file, &file_size) || file_size.QuadPart == 0) {
+                return;
+        }
+        mapping = CreateFileMappingA(file, NULL, PAGE_READONLY, 0, 0, NULL);
+        if (mapping == NULL) {
+                return;
+        }
+        bytes = static_cast<const unsigned char *>(
+                MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0));
+        if (bytes != NULL) {
+                length = file_size.QuadPart;
+        }
+}
+
+MappedFile::~MappedFile() {
+        if (bytes != NULL) {
+                UnmapViewOfFile(bytes);
+        }
+        if (mapping != NULL) {
+                CloseHandle(mapping);
+        }
+        if (file != NULL) {
+                CloseHandle(file);
+        }
+}
+
+#else
+
+MappedFile::MappedFile(const std::string &path) {
+        int fd = open(path.c_str(), O_RDONLY);
+        if (fd < 0) {
+                return;
+        }
+        struct stat st;
+        if (fstat(fd, &st) == 0 && st.st_size > 0) {
+                void *p = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+                if (p != MAP_FAILED) {
+                        bytes = static_cast<const unsigned char *>(p);
+                        length = st.st_size;
+                }
+        }
+        /* The mapping keeps its own reference to the file */
+        close(fd);
+}
+
+MappedFile::~MappedFile() {
+        if (bytes != NULL) {
+                munmap(const_cast<unsigned char *>(bytes), length);
+        }
+}
+
+#endif
+
+bool file_stamp(const std::string &path, uint64_t &size, int64_t &mtime) {
+        std::error_code error;
+        size = std::filesystem::file_size(path, error);
+        if (error) {
+                return false;
+        }
+        auto time = std::filesystem::last_write_time(path, error);
+        if (error) {
+                return false;
+        }
+        mtime = time.time_since_epoch().count();
+        return true;
+}
@@ -0,0 +1,35 @@
+#ifndef MAPPED_FILE_H
+#define MAPPED_FILE_H
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+/**
+ * Read only memory mapping of a whole file. The mapping lives as long as the
+ * object, data() is NULL if the file could not be opened or mapped.
+ */
+class MappedFile {
+      public:
+        MappedFile(const std::string &path);
+        ~MappedFile();
+
+        MappedFile(const MappedFile &) = delete;
+        MappedFile &operator=(const MappedFile &) = delete;
+
+        const unsigned char *data() const { return bytes; }
+        size_t size() const { return length; }
+
+      private:
+        const unsigned char *bytes{};
+        size_t length{};
+#ifdef _WIN32
+        void *file{};
+        void *mapping{};
+#endif
+};
+
+/* Size and modification time, used by caches to notice a changed source */
+bool file_stamp(const std::string &path, uint64_t &size, int64_t &mtime);
+
+#endif /* MAPPED_FILE_H */
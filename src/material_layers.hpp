@@ -0,0 +1,39 @@
+#ifndef MATERIAL_LAYERS_H
+#define MATERIAL_LAYERS_H
+
+#include <algorithm>
+#include <cstddef>
+#include <vector>
+
+/**
+ * Layers of a texture array shared by the meshes of a model, for
+ * Model::build_material_array. textures holds each mesh's texture, layers
+ * gets every distinct one once in order of first use and mesh_layers the
+ * layer each mesh draws from.
+ *
+ * Fails when a mesh has no texture or one isn't compatible(first, other)
+ * with the first, the meshes then keep binding their own textures.
+ */
+template <typename Texture, typename Compatible>
+bool assign_material_layers(const std::vector<const Texture *> &textures,
+                            Compatible compatible,
+                            std::vector<const Texture *> &layers,
+                            std::vector<int> &mesh_layers) {
+        layers.clear();
+        mesh_layers.clear();
+        for (const Texture *texture : textures) {
+                if (texture == NULL ||
+                    !compatible(layers.empty() ? *texture : *layers[0],
+                                *texture)) {
+                        return false;
+                }
+                auto found = std::find(layers.begin(), layers.end(), texture);
+                mesh_layers.push_back(found - layers.begin());
+                if (found == layers.end()) {
+                        layers.push_back(texture);
+                }
+        }
+        return !layers.empty();
+}
+
+#endif /* MATERIAL_LAYERS_H */
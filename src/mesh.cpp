@@ -1,43 +1,177 @@
+#include "gl_state.hpp"
+#include "gl_stats.hpp"
 #include "model.hpp"
 
-Mesh::Mesh(std::vector<Vertex> vertices, std::vector<GLuint> indices,
-           std::vector<Texture> textures)
-        : vertices{vertices}, indices{indices}, textures{textures} {
-        setup_mesh();
-}
-
-void Mesh::setup_mesh() {
+MeshBuffer::MeshBuffer(size_t vertex_capacity, size_t index_capacity,
+                       VertexFormat format, VertexQuantization quantization)
+        : format{format}, quantization{quantization},
+          vertex_capacity{vertex_capacity}, index_capacity{index_capacity} {
         glGenVertexArrays(1, &VAO);
         glGenBuffers(1, &VBO);
         glGenBuffers(1, &EBO);
 
-        glBindVertexArray(VAO);
-        glBindBuffer(GL_ARRAY_BUFFER, VBO);
-        glBufferData(GL_ARRAY_BUFFER, vertices.size() * sizeof(Vertex),
-                     &vertices[0], GL_STATIC_DRAW);
-        glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, EBO);
-        glBufferData(GL_ELEMENT_ARRAY_BUFFER,
-                     indices.size() * sizeof(GLuint), &indices[0],
-                     GL_STATIC_DRAW);
+        GLState &state = GLState::instance();
+        state.bind_vertex_array(VAO);
+        state.bind_buffer(GL_ARRAY_BUFFER, VBO);
+        buffer_data(GL_ARRAY_BUFFER, vertex_capacity * vertex_size(), NULL,
+                    GL_STATIC_DRAW);
+        state.bind_buffer(GL_ELEMENT_ARRAY_BUFFER, EBO);
+        buffer_data(GL_ELEMENT_ARRAY_BUFFER, index_capacity * sizeof(GLuint),
+                    NULL, GL_STATIC_DRAW);
+        setup_attributes();
+}
+
+size_t MeshBuffer::vertex_size() const {
+        return format == VertexFormat::Packed ? sizeof(PackedVertex)
+                                              : sizeof(Vertex);
+}
 
+/* Same locations for both formats, the normalized packed attributes reach
+ * the shader as floats */
+void MeshBuffer::setup_attributes() {
         glEnableVertexAttribArray(0);
+        glEnableVertexAttribArray(1);
+        glEnableVertexAttribArray(2);
+        if (format == VertexFormat::Packed) {
+                glVertexAttribPointer(0, 3, GL_UNSIGNED_SHORT, GL_TRUE,
+                                      sizeof(PackedVertex), (void *)0);
+                glVertexAttribPointer(1, 4, GL_INT_2_10_10_10_REV, GL_TRUE,
+                                      sizeof(PackedVertex),
+                                      (void *)offsetof(PackedVertex, normal));
+                glVertexAttribPointer(2, 2, GL_HALF_FLOAT, GL_FALSE,
+                                      sizeof(PackedVertex),
+                                      (void *)offsetof(PackedVertex,
+                                                       tex_coords));
+                return;
+        }
         glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex),
                               (void *)0);
-        glEnableVertexAttribArray(1);
         glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex),
                               (void *)offsetof(Vertex, normal));
-        glEnableVertexAttribArray(2);
         glVertexAttribPointer(2, 2, GL_FLOAT, GL_FALSE, sizeof(Vertex),
                               (void *)offsetof(Vertex, tex_coords));
+}
+
+MeshBuffer::~MeshBuffer() { release(); }
+
+MeshBuffer::MeshBuffer(MeshBuffer &&other) noexcept
+        : VAO{other.VAO}, format{other.format},
+          quantization{other.quantization}, VBO{other.VBO}, EBO{other.EBO},
+          vertex_capacity{other.vertex_capacity},
+          index_capacity{other.index_capacity},
+          vertex_used{other.vertex_used}, index_used{other.index_used},
+          packed{std::move(other.packed)} {
+        other.VAO = other.VBO = other.EBO = 0;
+        other.vertex_capacity = other.index_capacity = 0;
+        other.vertex_used = other.index_used = 0;
+}
+
+MeshBuffer &MeshBuffer::operator=(MeshBuffer &&other) noexcept {
+        if (this != &other) {
+                release();
+                VAO = other.VAO;
+                format = other.format;
+                quantization = other.quantization;
+                VBO = other.VBO;
+                EBO = other.EBO;
+                vertex_capacity = other.vertex_capacity;
+                index_capacity = other.index_capacity;
+                vertex_used = other.vertex_used;
+                index_used = other.index_used;
+                packed = std::move(other.packed);
+                other.VAO = other.VBO = other.EBO = 0;
+                other.vertex_capacity = other.index_capacity = 0;
+                other.vertex_used = other.index_used = 0;
+        }
+        return *this;
+}
 
-        glBindVertexArray(0);
+/* Deleting 0 is a no-op, so moved from buffers are fine here */
+void MeshBuffer::release() {
+        GLState &state = GLState::instance();
+        state.delete_vertex_array(VAO);
+        state.delete_buffer(VBO);
+        state.delete_buffer(EBO);
 }
 
-void Mesh::draw(Shader &shader) {
+bool MeshBuffer::append(const Vertex *vertices, GLsizei vertex_count,
+                        const GLuint *indices, GLsizei index_count,
+                        GLint &base_vertex, GLsizei &first_index) {
+        if (vertex_used + vertex_count > vertex_capacity ||
+            index_used + index_count > index_capacity) {
+                std::cout << "MeshBuffer is full, mesh not uploaded\n";
+                base_vertex = 0;
+                first_index = 0;
+                return false;
+        }
+        base_vertex = vertex_used;
+        first_index = index_used;
+
+        const void *data = vertices;
+        if (format == VertexFormat::Packed) {
+                /* Scratch is kept between appends, it only ever grows to
+                 * the largest mesh */
+                packed.resize(vertex_count);
+                for (GLsizei i = 0; i < vertex_count; i++) {
+                        packed[i] = pack_vertex(vertices[i], quantization);
+                }
+                data = packed.data();
+        }
+        GLState &state = GLState::instance();
+        state.bind_buffer(GL_ARRAY_BUFFER, VBO);
+        buffer_sub_data(GL_ARRAY_BUFFER, vertex_used * vertex_size(),
+                        vertex_count * vertex_size(), data);
+        /* Binding the element buffer would change whatever VAO is bound */
+        state.bind_buffer(GL_COPY_WRITE_BUFFER, EBO);
+        buffer_sub_data(GL_COPY_WRITE_BUFFER, index_used * sizeof(GLuint),
+                        index_count * sizeof(GLuint), indices);
+
+        vertex_used += vertex_count;
+        index_used += index_count;
+        return true;
+}
+
+/* Always reattached, a recycled buffer name may not be the buffer the VAO
+ * still refers to */
+void MeshBuffer::attach_instances(GLuint buffer) {
+        GLState &state = GLState::instance();
+        state.bind_vertex_array(VAO);
+        state.bind_buffer(GL_ARRAY_BUFFER, buffer);
+        glEnableVertexAttribArray(INSTANCE_ATTRIBUTE);
+        glVertexAttribIPointer(INSTANCE_ATTRIBUTE, 1, GL_UNSIGNED_INT,
+                               sizeof(GLuint), (void *)0);
+        glVertexAttribDivisor(INSTANCE_ATTRIBUTE, 1);
+}
+
+Mesh::Mesh(MeshBuffer &buffer, const Vertex *vertices, GLsizei vertex_count,
+           const GLuint *indices, GLsizei index_count,
+           std::vector<Texture> textures, const std::vector<LodLevel> &lods)
+        : vertex_count{vertex_count}, index_count{index_count},
+          textures{std::move(textures)} {
+        if (!buffer.append(vertices, vertex_count, indices, index_count,
+                           base_vertex, first_index)) {
+                /* Nothing of it is in the buffer, so it draws nothing
+                 * rather than another mesh's indices */
+                this->vertex_count = 0;
+                this->index_count = 0;
+                this->lods.push_back({0, 0, 0.0f});
+                return;
+        }
+        for (const LodLevel &lod : lods) {
+                this->lods.push_back(
+                        {static_cast<GLsizei>(first_index + lod.first_index),
+                         static_cast<GLsizei>(lod.index_count), lod.error});
+        }
+        if (this->lods.empty()) {
+                this->lods.push_back({first_index, index_count, 0.0f});
+        }
+        this->index_count = this->lods[0].index_count;
+}
+
+void bind_textures(Shader &shader, const std::vector<Texture> &textures) {
         GLuint diffuseNr = 1;
         GLuint specularNr = 1;
         for(unsigned int i = 0; i < textures.size(); i++) {
-                glActiveTexture(GL_TEXTURE0 + i);
                 std::string number;
                 std::string name = textures[i].type;
 
@@ -47,12 +181,14 @@ void Mesh::draw(Shader &shader) {
                         number = std::to_string(specularNr++);
                 }
                 shader.set_uniform((name + number).c_str(), i);
-                glBindTexture(GL_TEXTURE_2D, textures[i].id);
+                GLState::instance().bind_texture(i, GL_TEXTURE_2D,
+                                                 textures[i].id);
         }
+}
 
-        glBindVertexArray(VAO);
-        glDrawElements(GL_TRIANGLES, indices.size(), GL_UNSIGNED_INT, 0);
-        glBindVertexArray(0);
-
-        glActiveTexture(GL_TEXTURE0);
-}
\ No newline at end of file
+void Mesh::draw(Shader &shader, size_t lod) {
+        bind_textures(shader, textures);
+        draw_elements_base_vertex(GL_TRIANGLES, level(lod).index_count,
+                                  GL_UNSIGNED_INT, index_offset(lod),
+                                  base_vertex);
+}
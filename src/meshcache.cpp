@@ -0,0 +1,211 @@
+#include "meshcache.hpp"
+#include "trace.hpp"
+
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+
+static const char MESH_CACHE_MAGIC[4] = {'M', 'S', 'M', 'C'};
+
+static uint64_t align16(uint64_t offset) { return (offset + 15) & ~15ull; }
+
+std::string mesh_cache_path(const std::string &source_path) {
+        return source_path + ".meshcache";
+}
+
+MeshCache::MeshCache(const std::string &source_path)
+        : file{mesh_cache_path(source_path)} {
+        TRACE_SCOPE("MeshCache::MeshCache");
+        const unsigned char *bytes = file.data();
+        size_t size = file.size();
+        if (bytes == NULL || size < sizeof(MeshCacheHeader)) {
+                return;
+        }
+
+        MeshCacheHeader header;
+        std::memcpy(&header, bytes, sizeof(header));
+        uint64_t source_size;
+        int64_t source_mtime;
+        if (std::memcmp(header.magic, MESH_CACHE_MAGIC, 4) != 0 ||
+            header.version != MESH_CACHE_VERSION ||
+            header.vertex_size != sizeof(Vertex) ||
+            !file_stamp(source_path, source_size, source_mtime) ||
+            header.source_size != source_size ||
+            header.source_mtime != source_mtime) {
+                return;
+        }
+
+        uint64_t table_end = sizeof(MeshCacheHeader) +
+                             uint64_t{header.mesh_count} * sizeof(MeshCacheEntry);
+        if (table_end > size) {
+                return;
+        }
+
+        for (uint32_t i = 0; i < header.mesh_count; i++) {
+                MeshCacheEntry entry;
+                std::memcpy(&entry,
+                            bytes + sizeof(MeshCacheHeader) +
+                                    i * sizeof(MeshCacheEntry),
+                            sizeof(entry));
+                uint64_t vertex_end = entry.vertex_offset +
+                                      uint64_t{entry.vertex_count} * sizeof(Vertex);
+                uint64_t index_end = entry.index_offset +
+                                     uint64_t{entry.index_count} * sizeof(GLuint);
+                uint64_t lod_end = entry.lod_offset +
+                                   uint64_t{entry.lod_count} * sizeof(MeshCacheLod);
+                if (vertex_end > size || index_end > size || lod_end > size ||
+                    entry.texture_offset > size) {
+                        return;
+                }
+
+                CachedMesh mesh;
+                mesh.vertices = reinterpret_cast<const Vertex *>(
+                        bytes + entry.vertex_offset);
+                mesh.vertex_count = entry.vertex_count;
+                mesh.indices = reinterpret_cast<const GLuint *>(
+                        bytes + entry.index_offset);
+                mesh.index_count = entry.index_count;
+                /* Drawn with a base vertex, so an index past the mesh's own
+                 * vertices would read another mesh's or past the buffer */
+                for (uint32_t j = 0; j < mesh.index_count; j++) {
+                        if (mesh.indices[j] >= mesh.vertex_count) {
+                                return;
+                        }
+                }
+
+                for (uint32_t l = 0; l < entry.lod_count; l++) {
+                        MeshCacheLod lod;
+                        std::memcpy(&lod,
+                                    bytes + entry.lod_offset +
+                                            l * sizeof(MeshCacheLod),
+                                    sizeof(lod));
+                        if (uint64_t{lod.first_index} + lod.index_count >
+                            entry.index_count) {
+                                return;
+                        }
+                        mesh.lods.push_back(
+                                {lod.first_index, lod.index_count, lod.error});
+                }
+
+                uint64_t offset = entry.texture_offset;
+                for (uint32_t t = 0; t < entry.texture_count; t++) {
+                        uint32_t lengths[2];
+                        if (offset + sizeof(lengths) > size) {
+                                return;
+                        }
+                        std::memcpy(lengths, bytes + offset, sizeof(lengths));
+                        offset += sizeof(lengths);
+                        if (offset + lengths[0] + lengths[1] > size) {
+                                return;
+                        }
+                        const char *chars =
+                                reinterpret_cast<const char *>(bytes + offset);
+                        mesh.textures.push_back(
+                                {std::string(chars, lengths[0]),
+                                 std::string(chars + lengths[0], lengths[1])});
+                        offset += lengths[0] + lengths[1];
+                }
+                meshes.push_back(std::move(mesh));
+        }
+        is_valid = true;
+}
+
+bool write_mesh_cache(const std::string &source_path,
+                      const std::vector<MeshData> &meshes) {
+        TRACE_FUNCTION();
+        MeshCacheHeader header{};
+        std::memcpy(header.magic, MESH_CACHE_MAGIC, 4);
+        header.version = MESH_CACHE_VERSION;
+        header.vertex_size = sizeof(Vertex);
+        header.mesh_count = meshes.size();
+        if (!file_stamp(source_path, header.source_size,
+                        header.source_mtime)) {
+                return false;
+        }
+
+        /* Lay out every mesh first so the table can be written up front */
+        std::vector<MeshCacheEntry> entries(meshes.size());
+        uint64_t offset = sizeof(MeshCacheHeader) +
+                          meshes.size() * sizeof(MeshCacheEntry);
+        for (size_t i = 0; i < meshes.size(); i++) {
+                const MeshData &mesh = meshes[i];
+                MeshCacheEntry &entry = entries[i];
+                entry.vertex_count = mesh.vertices.size();
+                entry.index_count = mesh.indices.size();
+                entry.lod_count = mesh.lods.size();
+                entry.texture_count = mesh.textures.size();
+
+                entry.vertex_offset = align16(offset);
+                offset = entry.vertex_offset +
+                         mesh.vertices.size() * sizeof(Vertex);
+                entry.index_offset = align16(offset);
+                offset = entry.index_offset +
+                         mesh.indices.size() * sizeof(GLuint);
+                entry.lod_offset = offset;
+                offset += mesh.lods.size() * sizeof(MeshCacheLod);
+                entry.texture_offset = offset;
+                for (const TextureRef &ref : mesh.textures) {
+                        offset += 2 * sizeof(uint32_t) + ref.type.size() +
+                                  ref.path.size();
+                }
+        }
+
+        /* Written next to the cache and renamed over it once complete, so
+         * another instance that has the old cache mapped keeps its pages */
+        std::string path = mesh_cache_path(source_path);
+        std::string temp_path = path + ".tmp";
+        std::ofstream out{temp_path, std::ios::binary};
+        if (!out.is_open()) {
+                std::cout << "Failed to open mesh cache at path: "
+                          << temp_path << "\n";
+                return false;
+        }
+
+        auto pad_to = [&out](uint64_t target) {
+                static const char zeros[16] = {};
+                uint64_t pos = out.tellp();
+                out.write(zeros, target - pos);
+        };
+
+        out.write(reinterpret_cast<const char *>(&header), sizeof(header));
+        out.write(reinterpret_cast<const char *>(entries.data()),
+                  entries.size() * sizeof(MeshCacheEntry));
+        for (size_t i = 0; i < meshes.size(); i++) {
+                const MeshData &mesh = meshes[i];
+                pad_to(entries[i].vertex_offset);
+                out.write(reinterpret_cast<const char *>(mesh.vertices.data()),
+                          mesh.vertices.size() * sizeof(Vertex));
+                pad_to(entries[i].index_offset);
+                out.write(reinterpret_cast<const char *>(mesh.indices.data()),
+                          mesh.indices.size() * sizeof(GLuint));
+                for (const LodLevel &level : mesh.lods) {
+                        MeshCacheLod lod{static_cast<uint32_t>(level.first_index),
+                                         static_cast<uint32_t>(level.index_count),
+                                         level.error, 0};
+                        out.write(reinterpret_cast<const char *>(&lod),
+                                  sizeof(lod));
+                }
+                for (const TextureRef &ref : mesh.textures) {
+                        uint32_t lengths[2] = {
+                                static_cast<uint32_t>(ref.type.size()),
+                                static_cast<uint32_t>(ref.path.size())};
+                        out.write(reinterpret_cast<const char *>(lengths),
+                                  sizeof(lengths));
+                        out.write(ref.type.data(), ref.type.size());
+                        out.write(ref.path.data(), ref.path.size());
+                }
+        }
+        out.close();
+        std::error_code error;
+        if (!out.fail()) {
+                std::filesystem::rename(temp_path, path, error);
+        }
+        if (out.fail() || error) {
+                std::cout << "Failed to write mesh cache at path: " << path
+                          << "\n";
+                std::filesystem::remove(temp_path, error);
+                return false;
+        }
+        return true;
+}
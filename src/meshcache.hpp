@@ -0,0 +1,86 @@
+#ifndef MESHCACHE_H
+#define MESHCACHE_H
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "mapped_file.hpp"
+#include "model.hpp"
+
+/**
+ * Binary cache of processed meshes, written next to the source asset as
+ * <asset>.meshcache so warm loads skip Assimp entirely.
+ *
+ * Layout, in host byte order:
+ *      MeshCacheHeader
+ *      MeshCacheEntry[mesh_count]
+ *      for each mesh: Vertex[vertex_count], GLuint[index_count] holding
+ *      every LOD level, MeshCacheLod[lod_count] and its texture refs as
+ *      (u32 type length, u32 path length, type, path)
+ *
+ * Vertex and index arrays start on 16 byte boundaries so they can be passed
+ * to glBufferData straight from the mapping. The header records the size
+ * and modification time of the source, a cache that doesn't match them, or
+ * was written by a different version, is ignored and rebuilt.
+ */
+
+const uint32_t MESH_CACHE_VERSION = 3;
+
+struct MeshCacheHeader {
+        char magic[4];
+        uint32_t version;
+        uint32_t vertex_size;
+        uint32_t mesh_count;
+        uint64_t source_size;
+        int64_t source_mtime;
+};
+
+struct MeshCacheEntry {
+        uint64_t vertex_offset;
+        uint64_t index_offset;
+        uint64_t lod_offset;
+        uint64_t texture_offset;
+        uint32_t vertex_count;
+        uint32_t index_count;
+        uint32_t lod_count;
+        uint32_t texture_count;
+};
+
+struct MeshCacheLod {
+        uint32_t first_index;
+        uint32_t index_count;
+        float error;
+        uint32_t padding;
+};
+
+/* Views into the mapped cache, valid while the MeshCache is alive */
+struct CachedMesh {
+        const Vertex *vertices;
+        uint32_t vertex_count;
+        const GLuint *indices;
+        uint32_t index_count;
+        std::vector<LodLevel> lods;
+        std::vector<TextureRef> textures;
+};
+
+class MeshCache {
+      public:
+        std::vector<CachedMesh> meshes;
+
+        /* Maps and validates the cache belonging to source_path */
+        MeshCache(const std::string &source_path);
+
+        bool valid() const { return is_valid; }
+
+      private:
+        MappedFile file;
+        bool is_valid{false};
+};
+
+std::string mesh_cache_path(const std::string &source_path);
+
+bool write_mesh_cache(const std::string &source_path,
+                      const std::vector<MeshData> &meshes);
+
+#endif /* MESHCACHE_H */
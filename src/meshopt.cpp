@@ -0,0 +1,543 @@
+#include "meshopt.hpp"
+#include "trace.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <numeric>
+
+float compute_acmr(const IndexList &indices, size_t vertex_count,
+                   unsigned int cache_size) {
+        if (indices.size() < 3) {
+                return 0.0f;
+        }
+        /* A vertex is cached while fewer than cache_size misses came after
+         * the one that loaded it */
+        std::pmr::vector<size_t> loaded_at(vertex_count, 0,
+                                           indices.get_allocator());
+        size_t misses = 0;
+        for (unsigned int v : indices) {
+                if (loaded_at[v] == 0 || misses - loaded_at[v] >= cache_size) {
+                        misses++;
+                        loaded_at[v] = misses;
+                }
+        }
+        return static_cast<float>(misses) / (indices.size() / 3);
+}
+
+static size_t hash_vertex(const Vertex &v) {
+        /* FNV-1a over the raw bytes, Vertex has no padding */
+        const unsigned char *bytes = reinterpret_cast<const unsigned char *>(&v);
+        size_t hash = 14695981039346656037ull;
+        for (size_t i = 0; i < sizeof(Vertex); i++) {
+                hash = (hash ^ bytes[i]) * 1099511628211ull;
+        }
+        return hash;
+}
+
+void weld_vertices(VertexList &vertices, IndexList &indices) {
+        TRACE_FUNCTION();
+        std::pmr::memory_resource *resource =
+                vertices.get_allocator().resource();
+        const unsigned int empty = ~0u;
+
+        /* Open addressing with linear probing over indices into welded, one
+         * allocation instead of a node per unique vertex */
+        size_t table_size = 16;
+        while (table_size < vertices.size() * 2) {
+                table_size *= 2;
+        }
+        std::pmr::vector<unsigned int> table(table_size, empty, resource);
+        std::pmr::vector<unsigned int> remap(vertices.size(), resource);
+        VertexList welded{resource};
+        welded.reserve(vertices.size());
+
+        for (size_t i = 0; i < vertices.size(); i++) {
+                size_t slot = hash_vertex(vertices[i]) & (table_size - 1);
+                while (table[slot] != empty &&
+                       std::memcmp(&welded[table[slot]], &vertices[i],
+                                   sizeof(Vertex)) != 0) {
+                        slot = (slot + 1) & (table_size - 1);
+                }
+                if (table[slot] == empty) {
+                        table[slot] = welded.size();
+                        welded.push_back(vertices[i]);
+                }
+                remap[i] = table[slot];
+        }
+        for (unsigned int &index : indices) {
+                index = remap[index];
+        }
+        vertices.swap(welded);
+}
+
+/*
+ * Tipsify, from "Fast Triangle Reordering for Vertex Locality and Reduced
+ * Overdraw" (Sander, Nehab, Barczak 2007). Triangles are emitted as fans
+ * around a vertex, the next fan is picked among the vertices just used
+ * that will still be in the cache once their remaining triangles are done.
+ *
+ * Clusters break where no such vertex is left and the walk skips to a
+ * dead end, and where the cluster's own miss ratio has dropped below
+ * cluster_acmr. Either way the cache starts empty again, as it will once
+ * optimize_overdraw moves the cluster, so the next one pays for its warm
+ * up and a long cluster can't be cut into ones a fan long.
+ */
+std::pmr::vector<size_t> optimize_vertex_cache(IndexList &indices,
+                                               size_t vertex_count,
+                                               unsigned int cache_size,
+                                               float cluster_acmr) {
+        TRACE_FUNCTION();
+        std::pmr::memory_resource *resource =
+                indices.get_allocator().resource();
+        size_t triangle_count = indices.size() / 3;
+        std::pmr::vector<size_t> clusters(1, 0, resource);
+        if (triangle_count == 0 || vertex_count == 0) {
+                return clusters;
+        }
+
+        /* Triangles around each vertex, stored flat with an offset table */
+        std::pmr::vector<unsigned int> live(vertex_count, 0, resource);
+        for (unsigned int v : indices) {
+                live[v]++;
+        }
+        std::pmr::vector<size_t> offsets(vertex_count + 1, 0, resource);
+        std::partial_sum(live.begin(), live.end(), offsets.begin() + 1);
+        std::pmr::vector<unsigned int> adjacency(indices.size(), resource);
+        std::pmr::vector<size_t> fill(offsets.begin(), offsets.end() - 1,
+                                      resource);
+        for (size_t i = 0; i < indices.size(); i++) {
+                adjacency[fill[indices[i]]++] = i / 3;
+        }
+
+        std::pmr::vector<unsigned int> cached_at(vertex_count, 0, resource);
+        unsigned int time = cache_size + 1;
+        std::pmr::vector<char> emitted(triangle_count, 0, resource);
+        /* Every index is pushed once at most, sizing up front keeps the
+         * loop free of reallocations */
+        std::pmr::vector<unsigned int> dead_end{resource};
+        dead_end.reserve(indices.size());
+        std::pmr::vector<unsigned int> candidates{resource};
+        candidates.reserve(indices.size());
+        IndexList output{resource};
+        output.reserve(indices.size());
+
+        size_t cursor = 1;
+        size_t cluster_misses = 0;
+        long fanning = 0;
+        while (fanning >= 0) {
+                candidates.clear();
+                for (size_t a = offsets[fanning]; a < offsets[fanning + 1];
+                     a++) {
+                        unsigned int t = adjacency[a];
+                        if (emitted[t]) {
+                                continue;
+                        }
+                        for (int k = 0; k < 3; k++) {
+                                unsigned int v = indices[t * 3 + k];
+                                output.push_back(v);
+                                dead_end.push_back(v);
+                                candidates.push_back(v);
+                                live[v]--;
+                                if (time - cached_at[v] > cache_size) {
+                                        cached_at[v] = time++;
+                                        cluster_misses++;
+                                }
+                        }
+                        emitted[t] = 1;
+                }
+
+                /* A vertex that would fall out of the cache before its
+                 * triangles are done is no better than a dead end */
+                long next = -1;
+                long best = 0;
+                for (unsigned int v : candidates) {
+                        if (live[v] == 0) {
+                                continue;
+                        }
+                        long priority = 0;
+                        if (time - cached_at[v] + 2 * live[v] <= cache_size) {
+                                priority = time - cached_at[v];
+                        }
+                        if (priority > best) {
+                                best = priority;
+                                next = v;
+                        }
+                }
+
+                bool skipped = next < 0;
+                while (next < 0 && !dead_end.empty()) {
+                        unsigned int v = dead_end.back();
+                        dead_end.pop_back();
+                        if (live[v] > 0) {
+                                next = v;
+                        }
+                }
+
+                /* Nothing nearby is left, jump to the next unused vertex */
+                if (next < 0) {
+                        for (; cursor < vertex_count; cursor++) {
+                                if (live[cursor] > 0) {
+                                        next = cursor;
+                                        break;
+                                }
+                        }
+                }
+
+                size_t cluster_triangles =
+                        (output.size() - clusters.back()) / 3;
+                if (next >= 0 && cluster_triangles > 0 &&
+                    (skipped ||
+                     cluster_misses < cluster_acmr * cluster_triangles)) {
+                        clusters.push_back(output.size());
+                        cluster_misses = 0;
+                        time += cache_size + 1;
+                }
+                fanning = next;
+        }
+
+        indices.swap(output);
+        return clusters;
+}
+
+void optimize_overdraw(const VertexList &vertices, IndexList &indices,
+                       const std::pmr::vector<size_t> &clusters) {
+        TRACE_FUNCTION();
+        if (clusters.size() < 2) {
+                return;
+        }
+        std::pmr::memory_resource *resource =
+                indices.get_allocator().resource();
+
+        struct Cluster {
+                size_t begin;
+                size_t end;
+                float sort_key;
+        };
+
+        glm::vec3 mesh_centroid{0.0f};
+        float mesh_area = 0.0f;
+        std::pmr::vector<Cluster> sorted{resource};
+        std::pmr::vector<glm::vec3> centroids{resource}, normals{resource};
+        sorted.reserve(clusters.size());
+        centroids.reserve(clusters.size());
+        normals.reserve(clusters.size());
+        for (size_t c = 0; c < clusters.size(); c++) {
+                size_t begin = clusters[c];
+                size_t end = c + 1 < clusters.size() ? clusters[c + 1]
+                                                     : indices.size();
+                glm::vec3 centroid{0.0f}, normal{0.0f};
+                float area = 0.0f;
+                for (size_t i = begin; i < end; i += 3) {
+                        glm::vec3 p0 = vertices[indices[i]].position;
+                        glm::vec3 p1 = vertices[indices[i + 1]].position;
+                        glm::vec3 p2 = vertices[indices[i + 2]].position;
+                        glm::vec3 n = glm::cross(p1 - p0, p2 - p0);
+                        float a = glm::length(n) * 0.5f;
+                        centroid += (p0 + p1 + p2) / 3.0f * a;
+                        normal += n;
+                        area += a;
+                }
+                mesh_centroid += centroid;
+                mesh_area += area;
+                centroids.push_back(area > 0.0f ? centroid / area : centroid);
+                normals.push_back(normal);
+                sorted.push_back({begin, end, 0.0f});
+        }
+        if (mesh_area > 0.0f) {
+                mesh_centroid /= mesh_area;
+        }
+
+        /* Clusters facing away from the middle are likely to occlude the
+         * rest, so they go first */
+        for (size_t c = 0; c < sorted.size(); c++) {
+                float length = glm::length(normals[c]);
+                glm::vec3 n = length > 0.0f ? normals[c] / length : normals[c];
+                sorted[c].sort_key = glm::dot(centroids[c] - mesh_centroid, n);
+        }
+        std::stable_sort(sorted.begin(), sorted.end(),
+                         [](const Cluster &a, const Cluster &b) {
+                                 return a.sort_key > b.sort_key;
+                         });
+
+        IndexList output{resource};
+        output.reserve(indices.size());
+        for (const Cluster &c : sorted) {
+                output.insert(output.end(), indices.begin() + c.begin,
+                              indices.begin() + c.end);
+        }
+        indices.swap(output);
+}
+
+void optimize_vertex_fetch(VertexList &vertices, IndexList &indices) {
+        TRACE_FUNCTION();
+        std::pmr::memory_resource *resource =
+                vertices.get_allocator().resource();
+        const unsigned int unused = ~0u;
+        std::pmr::vector<unsigned int> remap(vertices.size(), unused,
+                                             resource);
+        VertexList ordered{resource};
+        ordered.reserve(vertices.size());
+        for (unsigned int &index : indices) {
+                if (remap[index] == unused) {
+                        remap[index] = ordered.size();
+                        ordered.push_back(vertices[index]);
+                }
+                index = remap[index];
+        }
+        vertices.swap(ordered);
+}
+
+MeshOptStats optimize_mesh(VertexList &vertices, IndexList &indices) {
+        TRACE_FUNCTION();
+        MeshOptStats stats;
+        stats.vertices_before = vertices.size();
+        stats.acmr_before = compute_acmr(indices, vertices.size());
+
+        weld_vertices(vertices, indices);
+        std::pmr::vector<size_t> clusters =
+                optimize_vertex_cache(indices, vertices.size());
+        optimize_overdraw(vertices, indices, clusters);
+        optimize_vertex_fetch(vertices, indices);
+
+        stats.vertices_after = vertices.size();
+        stats.acmr_after = compute_acmr(indices, vertices.size());
+        return stats;
+}
+
+/* Plane distance squared as a symmetric matrix, weighted by area */
+struct Quadric {
+        double a00, a01, a02, a11, a12, a22;
+        double b0, b1, b2, c;
+        double weight;
+
+        void add(const Quadric &q) {
+                a00 += q.a00, a01 += q.a01, a02 += q.a02;
+                a11 += q.a11, a12 += q.a12, a22 += q.a22;
+                b0 += q.b0, b1 += q.b1, b2 += q.b2, c += q.c;
+                weight += q.weight;
+        }
+
+        /* Mean squared distance to the accumulated planes */
+        double error(glm::vec3 p) const {
+                double x = p.x, y = p.y, z = p.z;
+                double e = a00 * x * x + a11 * y * y + a22 * z * z +
+                           2 * (a01 * x * y + a02 * x * z + a12 * y * z) +
+                           2 * (b0 * x + b1 * y + b2 * z) + c;
+                return weight > 0.0 ? std::max(e, 0.0) / weight : 0.0;
+        }
+};
+
+static Quadric plane_quadric(glm::vec3 p0, glm::vec3 p1, glm::vec3 p2) {
+        glm::dvec3 n = glm::cross(glm::dvec3(p1 - p0), glm::dvec3(p2 - p0));
+        double length = glm::length(n);
+        if (length == 0.0) {
+                return Quadric{};
+        }
+        double area = length * 0.5;
+        n /= length;
+        double d = -glm::dot(n, glm::dvec3(p0));
+        return {area * n.x * n.x, area * n.x * n.y, area * n.x * n.z,
+                area * n.y * n.y, area * n.y * n.z, area * n.z * n.z,
+                area * d * n.x,   area * d * n.y,   area * d * n.z,
+                area * d * d,     area};
+}
+
+/* Moving from onto to must not turn any remaining triangle of from over */
+static bool collapse_flips(const VertexList &vertices, const IndexList &indices,
+                           const std::pmr::vector<size_t> &offsets,
+                           const std::pmr::vector<unsigned int> &adjacency,
+                           unsigned int from, unsigned int to) {
+        glm::vec3 target = vertices[to].position;
+        for (size_t a = offsets[from]; a < offsets[from + 1]; a++) {
+                const unsigned int *t = &indices[adjacency[a] * 3];
+                if (t[0] == to || t[1] == to || t[2] == to) {
+                        continue;
+                }
+                glm::vec3 p[3], moved[3];
+                for (int k = 0; k < 3; k++) {
+                        p[k] = vertices[t[k]].position;
+                        moved[k] = t[k] == from ? target : p[k];
+                }
+                glm::vec3 before = glm::cross(p[1] - p[0], p[2] - p[0]);
+                glm::vec3 after =
+                        glm::cross(moved[1] - moved[0], moved[2] - moved[0]);
+                if (glm::dot(before, after) <= 0.0f) {
+                        return true;
+                }
+        }
+        return false;
+}
+
+IndexList simplify_mesh(const VertexList &vertices, const IndexList &indices,
+                        size_t target_index_count, float &error) {
+        TRACE_FUNCTION();
+        std::pmr::memory_resource *resource =
+                indices.get_allocator().resource();
+        size_t vertex_count = vertices.size();
+        IndexList current{indices, resource};
+        error = 0.0f;
+
+        std::pmr::vector<Quadric> quadrics(vertex_count, Quadric{}, resource);
+        for (size_t i = 0; i + 2 < current.size(); i += 3) {
+                Quadric q = plane_quadric(vertices[current[i]].position,
+                                          vertices[current[i + 1]].position,
+                                          vertices[current[i + 2]].position);
+                for (int k = 0; k < 3; k++) {
+                        quadrics[current[i + k]].add(q);
+                }
+        }
+
+        /* Edges used by a single triangle are borders, their vertices stay */
+        std::pmr::vector<char> locked(vertex_count, 0, resource);
+        {
+                std::pmr::vector<std::pair<unsigned int, unsigned int>> edges{
+                        resource};
+                edges.reserve(current.size());
+                for (size_t i = 0; i < current.size(); i += 3) {
+                        for (int k = 0; k < 3; k++) {
+                                unsigned int a = current[i + k];
+                                unsigned int b = current[i + (k + 1) % 3];
+                                edges.push_back({std::min(a, b), std::max(a, b)});
+                        }
+                }
+                std::sort(edges.begin(), edges.end());
+                for (size_t i = 0; i < edges.size();) {
+                        size_t j = i;
+                        while (j < edges.size() && edges[j] == edges[i]) {
+                                j++;
+                        }
+                        if (j - i == 1) {
+                                locked[edges[i].first] = 1;
+                                locked[edges[i].second] = 1;
+                        }
+                        i = j;
+                }
+        }
+
+        struct Collapse {
+                unsigned int from;
+                unsigned int to;
+                double cost;
+        };
+        std::pmr::vector<Collapse> collapses{resource};
+        std::pmr::vector<size_t> offsets(vertex_count + 1, 0, resource);
+        std::pmr::vector<unsigned int> adjacency{resource};
+        std::pmr::vector<unsigned int> remap(vertex_count, 0, resource);
+        std::pmr::vector<char> touched(vertex_count, 0, resource);
+        IndexList next{resource};
+
+        /* Each pass collapses the cheapest independent edges, then rebuilds
+         * the index list without the triangles that became degenerate */
+        while (current.size() > target_index_count) {
+                std::fill(offsets.begin(), offsets.end(), 0);
+                for (unsigned int v : current) {
+                        offsets[v + 1]++;
+                }
+                std::partial_sum(offsets.begin(), offsets.end(),
+                                 offsets.begin());
+                adjacency.resize(current.size());
+                std::pmr::vector<size_t> fill(offsets.begin(), offsets.end() - 1,
+                                              resource);
+                for (size_t i = 0; i < current.size(); i++) {
+                        adjacency[fill[current[i]]++] = i / 3;
+                }
+
+                collapses.clear();
+                for (size_t i = 0; i < current.size(); i += 3) {
+                        for (int k = 0; k < 3; k++) {
+                                unsigned int a = current[i + k];
+                                unsigned int b = current[i + (k + 1) % 3];
+                                for (int dir = 0; dir < 2; dir++) {
+                                        if (!locked[a]) {
+                                                Quadric q = quadrics[a];
+                                                q.add(quadrics[b]);
+                                                collapses.push_back(
+                                                        {a, b,
+                                                         q.error(vertices[b]
+                                                                         .position)});
+                                        }
+                                        std::swap(a, b);
+                                }
+                        }
+                }
+                std::sort(collapses.begin(), collapses.end(),
+                          [](const Collapse &a, const Collapse &b) {
+                                  return a.cost < b.cost;
+                          });
+
+                std::iota(remap.begin(), remap.end(), 0u);
+                std::fill(touched.begin(), touched.end(), 0);
+                /* An interior collapse removes two triangles */
+                size_t wanted = (current.size() - target_index_count) / 6 + 1;
+                size_t done = 0;
+                for (const Collapse &c : collapses) {
+                        if (done >= wanted) {
+                                break;
+                        }
+                        if (touched[c.from] || touched[c.to] ||
+                            collapse_flips(vertices, current, offsets,
+                                           adjacency, c.from, c.to)) {
+                                continue;
+                        }
+                        remap[c.from] = c.to;
+                        quadrics[c.to].add(quadrics[c.from]);
+                        /* Keep the neighbourhood fixed for the rest of the
+                         * pass so the flip checks stay valid */
+                        for (size_t a = offsets[c.from];
+                             a < offsets[c.from + 1]; a++) {
+                                for (int k = 0; k < 3; k++) {
+                                        touched[current[adjacency[a] * 3 + k]] =
+                                                1;
+                                }
+                        }
+                        error = std::max(error,
+                                         static_cast<float>(std::sqrt(c.cost)));
+                        done++;
+                }
+                if (done == 0) {
+                        break;
+                }
+
+                next.clear();
+                next.reserve(current.size());
+                for (size_t i = 0; i < current.size(); i += 3) {
+                        unsigned int a = remap[current[i]];
+                        unsigned int b = remap[current[i + 1]];
+                        unsigned int c = remap[current[i + 2]];
+                        if (a != b && b != c && a != c) {
+                                next.push_back(a);
+                                next.push_back(b);
+                                next.push_back(c);
+                        }
+                }
+                current.swap(next);
+        }
+        return current;
+}
+
+std::vector<LodLevel> build_lod_chain(const VertexList &vertices,
+                                      IndexList &indices, size_t max_levels) {
+        TRACE_FUNCTION();
+        std::vector<LodLevel> levels{{0, indices.size(), 0.0f}};
+        IndexList previous{indices, indices.get_allocator()};
+        float error = 0.0f;
+        while (levels.size() < max_levels) {
+                float level_error;
+                IndexList level = simplify_mesh(vertices, previous,
+                                                previous.size() / 2,
+                                                level_error);
+                /* Borders and flips can stall it, a level that saves little
+                 * isn't worth the memory */
+                if (level.size() < 3 ||
+                    level.size() > previous.size() * 3 / 4) {
+                        break;
+                }
+                optimize_vertex_cache(level, vertices.size());
+                error = std::max(error, level_error);
+                levels.push_back({indices.size(), level.size(), error});
+                indices.insert(indices.end(), level.begin(), level.end());
+                previous.swap(level);
+        }
+        return levels;
+}
@@ -0,0 +1,91 @@
+#ifndef MESHOPT_H
+#define MESHOPT_H
+
+#include <cstddef>
+#include <memory_resource>
+#include <vector>
+
+#include "vertex.hpp"
+
+/**
+ * Import time mesh optimization for indexed triangle lists.
+ *
+ * optimize_mesh runs the whole pipeline:
+ *      weld_vertices         merge bitwise identical vertices
+ *      optimize_vertex_cache Tipsify triangle order for the post transform
+ *                            cache, cut into clusters where it jumps or
+ *                            the cache has paid for itself
+ *      optimize_overdraw     sort those clusters so outward facing ones draw
+ *                            first, keeping the order inside each cluster
+ *      optimize_vertex_fetch renumber vertices in order of first use
+ *
+ * build_lod_chain then appends coarser index lists made by simplify_mesh,
+ * which collapses edges by quadric error and only ever points indices at
+ * existing vertices, so every level shares the vertex array.
+ *
+ * Every temporary is allocated from the memory resource of the vertex list,
+ * so an import that hands in arena backed lists does no other heap work.
+ */
+
+using VertexList = std::pmr::vector<Vertex>;
+using IndexList = std::pmr::vector<unsigned int>;
+
+const unsigned int VERTEX_CACHE_SIZE = 16;
+/* Miss ratio under which a cluster is cut for optimize_overdraw, lower
+ * keeps clusters longer and the cache happier */
+const float CLUSTER_ACMR = 0.65f;
+const size_t MAX_LOD_LEVELS = 5;
+
+/* A range of the index list and how far it strays from the full mesh, in
+ * model units. Level 0 is the full mesh with no error. */
+struct LodLevel {
+        size_t first_index;
+        size_t index_count;
+        float error;
+};
+
+struct MeshOptStats {
+        size_t vertices_before;
+        size_t vertices_after;
+        float acmr_before;
+        float acmr_after;
+};
+
+/* Average cache miss ratio, transformed vertices per triangle for a FIFO
+ * cache. 3.0 is the worst case, around 0.5 to 0.7 is good for real meshes. */
+float compute_acmr(const IndexList &indices,
+                   size_t vertex_count,
+                   unsigned int cache_size = VERTEX_CACHE_SIZE);
+
+void weld_vertices(VertexList &vertices,
+                   IndexList &indices);
+
+/* Returns the index offsets where each cluster starts */
+std::pmr::vector<size_t> optimize_vertex_cache(
+        IndexList &indices, size_t vertex_count,
+        unsigned int cache_size = VERTEX_CACHE_SIZE,
+        float cluster_acmr = CLUSTER_ACMR);
+
+void optimize_overdraw(const VertexList &vertices,
+                       IndexList &indices,
+                       const std::pmr::vector<size_t> &clusters);
+
+void optimize_vertex_fetch(VertexList &vertices,
+                           IndexList &indices);
+
+MeshOptStats optimize_mesh(VertexList &vertices,
+                           IndexList &indices);
+
+/* Quadric error metric edge collapse down to about target_index_count.
+ * Open borders are kept in place. error is set to the largest distance a
+ * collapse moved the surface. */
+IndexList simplify_mesh(const VertexList &vertices, const IndexList &indices,
+                        size_t target_index_count, float &error);
+
+/* Halves the triangle count per level, appending each level to indices.
+ * Stops early once simplification no longer pays off. */
+std::vector<LodLevel> build_lod_chain(const VertexList &vertices,
+                                      IndexList &indices,
+                                      size_t max_levels = MAX_LOD_LEVELS);
+
+#endif /* MESHOPT_H */
@@ -1,10 +1,46 @@
 #include "model.hpp"
+#include "gl_state.hpp"
+#include "gl_stats.hpp"
+#include "material_layers.hpp"
+#include "meshcache.hpp"
+#include "meshopt.hpp"
+#include "trace.hpp"
 
-unsigned int texture_from_file(const char *path, const std::string &directory);
+#include <cmath>
 
-Model::Model(const char *path) { load_model(path); }
+Model::Model(const char *path, VertexFormat format) : format{format} {
+        load_model(path);
+}
+
+static size_t count_mesh_refs(const aiNode *node) {
+        size_t count = node->mNumMeshes;
+        for (unsigned int i = 0; i < node->mNumChildren; i++) {
+                count += count_mesh_refs(node->mChildren[i]);
+        }
+        return count;
+}
+
+/* Enough for the imported arrays plus the scratch optimize_mesh takes from
+ * the same arena, so a typical import never grows it */
+static size_t import_arena_size(const aiScene *scene) {
+        size_t bytes = 0;
+        for (unsigned int i = 0; i < scene->mNumMeshes; i++) {
+                size_t vertices = scene->mMeshes[i]->mNumVertices;
+                size_t indices = size_t{scene->mMeshes[i]->mNumFaces} * 3;
+                bytes += vertices * (4 * sizeof(Vertex) + 8 * sizeof(GLuint)) +
+                         indices * 12 * sizeof(GLuint);
+        }
+        return bytes;
+}
 
 void Model::load_model(std::string path) {
+        TRACE_FUNCTION();
+        directory = path.substr(0, path.find_last_of('/'));
+
+        if (load_cached(path)) {
+                return;
+        }
+
         Assimp::Importer import;
         const aiScene *scene = import.ReadFile(
                 path, aiProcess_Triangulate | aiProcess_FlipUVs |
@@ -17,28 +53,233 @@ void Model::load_model(std::string path) {
                 return;
         }
 
-        directory = path.substr(0, path.find_last_of('/'));
+        /* Everything below is freed at once when the arena goes away, the
+         * per mesh vectors are never resized past their first allocation */
+        std::pmr::monotonic_buffer_resource arena{import_arena_size(scene)};
+        std::vector<MeshData> mesh_data;
+        mesh_data.reserve(count_mesh_refs(scene->mRootNode));
+        process_node(scene->mRootNode, scene, mesh_data, &arena);
+        for (MeshData &data : mesh_data) {
+                MeshOptStats stats = optimize_mesh(data.vertices, data.indices);
+                data.lods = build_lod_chain(data.vertices, data.indices);
+                std::cout << "Optimized mesh in " << path << ": "
+                          << stats.vertices_before << " -> "
+                          << stats.vertices_after << " vertices, ACMR "
+                          << stats.acmr_before << " -> " << stats.acmr_after
+                          << ", " << data.lods.size() << " LOD levels\n";
+        }
+        write_mesh_cache(path, mesh_data);
+
+        std::vector<MeshSource> sources;
+        sources.reserve(mesh_data.size());
+        for (const MeshData &data : mesh_data) {
+                sources.push_back({data.vertices.data(), data.vertices.size(),
+                                   data.indices.data(), data.indices.size(),
+                                   &data.lods, &data.textures});
+        }
+        upload_meshes(path, sources);
+}
+
+/* Warm path, uploads straight from the mapped cache file */
+bool Model::load_cached(const std::string &path) {
+        MeshCache cache{path};
+        if (!cache.valid()) {
+                return false;
+        }
+        std::vector<MeshSource> sources;
+        sources.reserve(cache.meshes.size());
+        for (const CachedMesh &mesh : cache.meshes) {
+                sources.push_back({mesh.vertices, mesh.vertex_count,
+                                   mesh.indices, mesh.index_count,
+                                   &mesh.lods, &mesh.textures});
+        }
+        upload_meshes(path, sources);
+        return true;
+}
+
+/* Packed models share one quantization box, so batches can still be drawn
+ * with a single set of uniforms */
+void Model::upload_meshes(const std::string &path,
+                          const std::vector<MeshSource> &sources) {
+        size_t vertex_total = 0, index_total = 0;
+        glm::vec3 min{INFINITY}, max{-INFINITY};
+        for (const MeshSource &source : sources) {
+                vertex_total += source.vertex_count;
+                index_total += source.index_count;
+                expand_bounds(source.vertices, source.vertex_count, min, max);
+        }
+        if (vertex_total > 0) {
+                center = (min + max) * 0.5f;
+                radius = glm::length(max - min) * 0.5f;
+        }
+
+        VertexQuantization quantization;
+        if (format == VertexFormat::Packed) {
+                quantization = quantization_for_bounds(min, max);
+                QuantizationError error;
+                for (const MeshSource &source : sources) {
+                        measure_quantization_error(source.vertices,
+                                                   source.vertex_count,
+                                                   quantization, error);
+                }
+                std::cout << "Quantized vertices in " << path
+                          << ": position error " << error.position
+                          << ", normal error " << error.normal
+                          << " degrees, texture coordinate error "
+                          << error.tex_coord << "\n";
+        }
+
+        buffer = MeshBuffer{vertex_total, index_total, format, quantization};
+        meshes.reserve(sources.size());
+        for (const MeshSource &source : sources) {
+                meshes.emplace_back(buffer, source.vertices,
+                                    source.vertex_count, source.indices,
+                                    source.index_count,
+                                    load_textures(*source.textures),
+                                    *source.lods);
+        }
+        build_batches();
+}
 
-        process_node(scene->mRootNode, scene);
+static bool same_textures(const std::vector<Texture> &a,
+                          const std::vector<Texture> &b) {
+        if (a.size() != b.size()) {
+                return false;
+        }
+        for (size_t i = 0; i < a.size(); i++) {
+                if (a[i].id != b[i].id || a[i].type != b[i].type) {
+                        return false;
+                }
+        }
+        return true;
 }
 
-void Model::process_node(aiNode *node, const aiScene *scene) {
+/* Groups meshes by the textures they bind, in order of first use. Meshes
+ * with a shorter LOD chain draw their coarsest level in the later lists. */
+void Model::build_batches() {
+        size_t lod_count = 1;
+        for (const Mesh &mesh : meshes) {
+                lod_count = std::max(lod_count, mesh.lods.size());
+        }
+        lod_errors.assign(lod_count, 0.0f);
+        batches.clear();
+        for (const Mesh &mesh : meshes) {
+                MeshBatch *batch = NULL;
+                for (MeshBatch &existing : batches) {
+                        bool same = material_array
+                                            ? existing.layer == mesh.layer
+                                            : same_textures(existing.textures,
+                                                            mesh.textures);
+                        if (same) {
+                                batch = &existing;
+                                break;
+                        }
+                }
+                if (batch == NULL) {
+                        batches.push_back({mesh.textures,
+                                           std::vector<DrawList>(lod_count),
+                                           mesh.layer});
+                        batch = &batches.back();
+                }
+                for (size_t l = 0; l < lod_count; l++) {
+                        DrawList &list = batch->lods[l];
+                        list.counts.push_back(mesh.level(l).index_count);
+                        list.offsets.push_back(mesh.index_offset(l));
+                        list.base_vertices.push_back(mesh.base_vertex);
+                        lod_errors[l] =
+                                std::max(lod_errors[l], mesh.level(l).error);
+                }
+        }
+}
+
+static const Texture *diffuse_texture(const Mesh &mesh) {
+        for (const Texture &texture : mesh.textures) {
+                if (texture.type == "texture_diffuse") {
+                        return &texture;
+                }
+        }
+        return NULL;
+}
+
+bool Model::textures_resident() const {
+        for (const Mesh &mesh : meshes) {
+                for (const Texture &texture : mesh.textures) {
+                        if (!texture.handle->loaded) {
+                                return false;
+                        }
+                }
+        }
+        return true;
+}
+
+bool Model::build_material_array() {
+        TRACE_FUNCTION();
+        std::vector<const GpuTexture *> diffuse;
+        for (const Mesh &mesh : meshes) {
+                const Texture *texture = diffuse_texture(mesh);
+                diffuse.push_back(texture && texture->handle->loaded
+                                          ? texture->handle.get()
+                                          : NULL);
+        }
+        std::vector<const GpuTexture *> layers;
+        std::vector<int> mesh_layers;
+        if (!assign_material_layers(diffuse, TextureArray::compatible, layers,
+                                    mesh_layers)) {
+                return false;
+        }
+
+        material_array = std::make_unique<TextureArray>(layers);
+        for (size_t i = 0; i < meshes.size(); i++) {
+                meshes[i].layer = mesh_layers[i];
+        }
+        build_batches();
+        return true;
+}
+
+float projected_size(float radius, float distance, float fovy,
+                     float viewport_height) {
+        if (distance <= radius) {
+                return viewport_height;
+        }
+        return radius / (distance * std::tan(fovy * 0.5f)) * viewport_height;
+}
+
+size_t Model::select_lod(float screen_size) const {
+        if (radius <= 0.0f) {
+                return 0;
+        }
+        float pixels_per_unit = screen_size / (2.0f * radius);
+        size_t lod = 0;
+        while (lod + 1 < lod_errors.size() &&
+               lod_errors[lod + 1] * pixels_per_unit <= LOD_PIXEL_ERROR) {
+                lod++;
+        }
+        return lod;
+}
+
+void Model::process_node(aiNode *node, const aiScene *scene,
+                         std::vector<MeshData> &mesh_data,
+                         std::pmr::memory_resource *arena) {
         for (unsigned int i = 0; i < node->mNumMeshes; i++) {
                 aiMesh *mesh = scene->mMeshes[node->mMeshes[i]];
-                meshes.push_back(process_mesh(mesh, scene));
+                mesh_data.push_back(process_mesh(mesh, scene, arena));
         }
         for (unsigned int i = 0; i < node->mNumChildren; i++) {
-                process_node(node->mChildren[i], scene);
+                process_node(node->mChildren[i], scene, mesh_data, arena);
         }
 }
 
-Mesh Model::process_mesh(aiMesh *mesh, const aiScene *scene) {
-        std::vector<Vertex> vertices;
-        std::vector<GLuint> indices;
-        std::vector<Texture> textures;
+MeshData Model::process_mesh(aiMesh *mesh, const aiScene *scene,
+                             std::pmr::memory_resource *arena) {
+        MeshData data{arena};
+        VertexList &vertices = data.vertices;
+        IndexList &indices = data.indices;
 
+        /* Triangulated, so the sizes are known before reading anything */
+        vertices.resize(mesh->mNumVertices);
+        indices.reserve(size_t{mesh->mNumFaces} * 3);
         for (unsigned int i = 0; i < mesh->mNumVertices; i++) {
-                Vertex vertex;
+                Vertex &vertex = vertices[i];
                 glm::vec3 vector;
 
                 vector.x = mesh->mVertices[i].x;
@@ -59,12 +300,10 @@ Mesh Model::process_mesh(aiMesh *mesh, const aiScene *scene) {
                 } else {
                         vertex.tex_coords = glm::vec2(0.0f, 0.0f);
                 }
-
-                vertices.push_back(vertex);
         }
 
         for (unsigned int i = 0; i < mesh->mNumFaces; i++) {
-                aiFace face = mesh->mFaces[i];
+                const aiFace &face = mesh->mFaces[i];
                 for (unsigned int j = 0; j < face.mNumIndices; j++) {
                         indices.push_back(face.mIndices[j]);
                 }
@@ -72,92 +311,119 @@ Mesh Model::process_mesh(aiMesh *mesh, const aiScene *scene) {
 
         if (mesh->mMaterialIndex >= 0) {
                 aiMaterial *material = scene->mMaterials[mesh->mMaterialIndex];
-                std::vector<Texture> diffuse_maps = load_material_textures(
-                        material, aiTextureType_DIFFUSE, "texture_diffuse");
-                textures.insert(textures.end(), diffuse_maps.begin(),
-                                diffuse_maps.end());
-                std::vector<Texture> specular_maps = load_material_textures(
-                        material, aiTextureType_SPECULAR, "texture_specular");
-                textures.insert(textures.end(), specular_maps.begin(),
-                                specular_maps.end());
+                material_textures(material, aiTextureType_DIFFUSE,
+                                  "texture_diffuse", data.textures);
+                material_textures(material, aiTextureType_SPECULAR,
+                                  "texture_specular", data.textures);
         }
 
-        return Mesh(vertices, indices, textures);
+        return data;
 }
 
-std::vector<Texture> Model::load_material_textures(aiMaterial *mat,
-                                                 aiTextureType type,
-                                                 std::string typeName) {
-        std::vector<Texture> textures;
+void Model::material_textures(aiMaterial *mat, aiTextureType type,
+                              std::string typeName,
+                              std::vector<TextureRef> &refs) {
         for (unsigned int i = 0; i < mat->GetTextureCount(type); i++) {
                 aiString str;
                 mat->GetTexture(type, i, &str);
+                refs.push_back({typeName, str.C_Str()});
+        }
+}
 
-                bool skip = false;
-                for(unsigned int j = 0; j < textures_loaded.size(); j++)
-                {
-                        if(std::strcmp(textures_loaded[j].path.data(), str.C_Str()) == 0) {
-                                textures.push_back(textures_loaded[j]);
-                                skip = true; 
-                                break;
-                        }
-                }
-
-                if(!skip) {
-                        Texture texture;
-                        texture.id = texture_from_file(str.C_Str(), directory);
-                        texture.type = typeName;
-                        texture.path = str.C_Str();
-                        textures.push_back(texture);
-                        textures_loaded.push_back(texture);
-                }
+std::vector<Texture> Model::load_textures(const std::vector<TextureRef> &refs) {
+        std::vector<Texture> textures;
+        textures.reserve(refs.size());
+        for (const TextureRef &ref : refs) {
+                Texture texture;
+                texture.handle = TextureManager::instance().acquire(
+                        directory + '/' + ref.path);
+                texture.id = texture.handle->id;
+                texture.type = ref.type;
+                texture.path = ref.path;
+                textures.push_back(std::move(texture));
         }
         return textures;
 }
 
-unsigned int texture_from_file(const char *path, const std::string &directory) {
-        std::string filename{path};
-        filename = directory + '/' + filename;
-
-        unsigned int textureID;
-        glGenTextures(1, &textureID);
-
-        int width, height, nrComponents;
-        unsigned char *data =
-                stbi_load(filename.c_str(), &width, &height, &nrComponents, 0);
-        if (data) {
-                GLenum format;
-                if (nrComponents == 1)
-                        format = GL_RED;
-                else if (nrComponents == 3)
-                        format = GL_RGB;
-                else if (nrComponents == 4)
-                        format = GL_RGBA;
-
-                glBindTexture(GL_TEXTURE_2D, textureID);
-                glTexImage2D(GL_TEXTURE_2D, 0, format, width, height, 0, format,
-                             GL_UNSIGNED_BYTE, data);
-                glGenerateMipmap(GL_TEXTURE_2D);
-
-                glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
-                glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
-                glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER,
-                                GL_LINEAR_MIPMAP_LINEAR);
-                glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER,
-                                GL_LINEAR);
-
-                stbi_image_free(data);
+void Model::begin_draw(Shader &shader) {
+        /* Textures arrive over a few frames, the array can only be built
+         * once they are all in. Until then, or if it fails, every batch
+         * binds its own textures. */
+        if (!material_array_tried && textures_resident()) {
+                material_array_tried = true;
+                build_material_array();
+        }
+        GLState &state = GLState::instance();
+        shader.set_uniform("position_offset", buffer.quantization.offset);
+        shader.set_uniform("position_scale", buffer.quantization.scale);
+        shader.set_uniform("use_material_array", material_array ? 1 : 0);
+        if (material_array) {
+                /* Its own unit, samplers of different types may not share */
+                state.bind_texture(MATERIAL_ARRAY_UNIT, GL_TEXTURE_2D_ARRAY,
+                                   material_array->id);
+                shader.set_uniform("material_array", MATERIAL_ARRAY_UNIT);
+        }
+        state.bind_vertex_array(buffer.VAO);
+}
+
+void Model::bind_material(Shader &shader, const MeshBatch &batch) {
+        if (material_array) {
+                shader.set_uniform("material_layer",
+                                   static_cast<float>(batch.layer));
         } else {
-                std::cout << "Texture failed to load at path: " << path
-                          << std::endl;
-                stbi_image_free(data);
+                bind_textures(shader, batch.textures);
+        }
+}
+
+void Model::draw(Shader &shader, size_t lod) {
+        begin_draw(shader);
+        for (const MeshBatch &batch : batches) {
+                const DrawList &list =
+                        batch.lods[std::min(lod, batch.lods.size() - 1)];
+                bind_material(shader, batch);
+                multi_draw_elements_base_vertex(
+                        GL_TRIANGLES, list.counts.data(), GL_UNSIGNED_INT,
+                        list.offsets.data(), list.counts.size(),
+                        list.base_vertices.data());
         }
+}
 
-        return textureID;
+void Model::draw(Shader &shader, const glm::mat4 &model_view, float fovy,
+                 float viewport_height) {
+        glm::vec3 eye = model_view * glm::vec4(center, 1.0f);
+        float scale = glm::length(glm::vec3(model_view[0]));
+        float size = projected_size(radius * scale, glm::length(eye), fovy,
+                                    viewport_height);
+        draw(shader, select_lod(size));
 }
 
-void Model::draw(Shader &shader) {
-        for (unsigned int i = 0; i < meshes.size(); i++) {
-                meshes[i].draw(shader);
+void Model::draw_instanced(Shader &shader, const InstanceBuffer &instances,
+                           size_t lod) {
+        draw_instanced(shader, instances, instances.indices, instances.count,
+                       lod);
+}
+
+/* GL 3.3 has no instanced multi draw, so each mesh is its own call */
+void Model::draw_instanced(Shader &shader, const InstanceBuffer &instances,
+                           GLuint index_buffer, GLsizei count, size_t lod) {
+        if (count == 0) {
+                return;
         }
-}
\ No newline at end of file
+        buffer.attach_instances(index_buffer);
+        begin_draw(shader);
+        GLState::instance().bind_texture(INSTANCE_TRANSFORM_UNIT,
+                                         GL_TEXTURE_BUFFER,
+                                         instances.texture);
+        shader.set_uniform("instance_transforms", INSTANCE_TRANSFORM_UNIT);
+        for (const MeshBatch &batch : batches) {
+                const DrawList &list =
+                        batch.lods[std::min(lod, batch.lods.size() - 1)];
+                bind_material(shader, batch);
+                for (size_t i = 0; i < list.counts.size(); i++) {
+                        draw_elements_instanced_base_vertex(
+                                GL_TRIANGLES, list.counts[i], GL_UNSIGNED_INT,
+                                list.offsets[i], count,
+                                list.base_vertices[i]);
+                }
+        }
+}
@@ -6,18 +6,21 @@
 #include <assimp/scene.h>
 #include <glm/glm.hpp>
 #include <glm/gtc/matrix_transform.hpp>
+#include <algorithm>
+#include <memory>
+#include <memory_resource>
 #include <stb_image.h>
 #include <string>
 #include <vector>
 
 
+#include "instance_buffer.hpp"
+#include "meshopt.hpp"
+#include "quantize.hpp"
 #include "shader.hpp"
-
-struct Vertex {
-        glm::vec3 position;
-        glm::vec3 normal;
-        glm::vec2 tex_coords;
-};
+#include "texture_array.hpp"
+#include "texture_manager.hpp"
+#include "vertex.hpp"
 
 /**
  * Textures currently are required to follow a certain naming cnvention.
@@ -30,42 +33,216 @@ struct Texture {
         GLuint id;
         std::string type;
         std::string path;
+        /* Keeps id alive, shared with every other user of the file */
+        std::shared_ptr<GpuTexture> handle;
+};
+
+/* A texture a mesh asks for before it has been loaded */
+struct TextureRef {
+        std::string type;
+        std::string path;
+};
+
+/* Processed mesh on the CPU, as produced by Assimp or the mesh cache. The
+ * geometry lives in the memory resource it was built with, usually the arena
+ * of a single import. */
+struct MeshData {
+        VertexList vertices;
+        IndexList indices;
+        std::vector<LodLevel> lods;
+        std::vector<TextureRef> textures;
+
+        explicit MeshData(std::pmr::memory_resource *resource =
+                                  std::pmr::get_default_resource())
+                : vertices{resource}, indices{resource} {}
+};
+
+/**
+ * One vertex buffer, one index buffer and one VAO shared by many meshes.
+ * Space is reserved up front and meshes are appended into it, each one
+ * remembering where it landed so it can be drawn with a base vertex.
+ * Owns its GL objects, so it can be moved but not copied.
+ *
+ * With VertexFormat::Packed vertices are converted to PackedVertex on
+ * append, the vertex shader has to apply quantization to the position.
+ */
+class MeshBuffer {
+      public:
+        GLuint VAO{0};
+        VertexFormat format{VertexFormat::Float};
+        VertexQuantization quantization;
+
+        MeshBuffer() = default;
+        MeshBuffer(size_t vertex_capacity, size_t index_capacity,
+                   VertexFormat format = VertexFormat::Float,
+                   VertexQuantization quantization = {});
+        ~MeshBuffer();
+        MeshBuffer(MeshBuffer &&other) noexcept;
+        MeshBuffer &operator=(MeshBuffer &&other) noexcept;
+        MeshBuffer(const MeshBuffer &) = delete;
+        MeshBuffer &operator=(const MeshBuffer &) = delete;
+
+        /* Copies the arrays into the next free range, indices stay local
+         * to the mesh. Returns the first vertex and first index used, or
+         * false when the mesh doesn't fit and nothing was copied. */
+        bool append(const Vertex *vertices, GLsizei vertex_count,
+                    const GLuint *indices, GLsizei index_count,
+                    GLint &base_vertex, GLsizei &first_index);
+
+        /* Points the instance index attribute of the VAO at buffer */
+        void attach_instances(GLuint buffer);
+
+      private:
+        GLuint VBO{0}, EBO{0};
+        size_t vertex_capacity{0}, index_capacity{0};
+        size_t vertex_used{0}, index_used{0};
+        std::vector<PackedVertex> packed;
+
+        size_t vertex_size() const;
+        void setup_attributes();
+        void release();
 };
 
+/* Largest on screen error, in pixels, a LOD level may cause */
+const float LOD_PIXEL_ERROR = 1.0f;
+
+/* Texture unit of the material array, clear of the per mesh textures */
+const GLuint MATERIAL_ARRAY_UNIT = 15;
+
+/* Index range of one LOD level within a MeshBuffer */
+struct MeshLod {
+        GLsizei first_index;
+        GLsizei index_count;
+        float error;
+};
+
+/* A range of a MeshBuffer and the textures it is drawn with. Every LOD
+ * level indexes the same vertices, lods[0] is the full mesh. */
 class Mesh {
       public:
-        GLuint VAO;
-        std::vector<Vertex> vertices;
-        std::vector<GLuint> indices;
+        GLint base_vertex;
+        GLsizei first_index;
+        GLsizei vertex_count;
+        /* Of the full mesh, lods[0] */
+        GLsizei index_count;
+        std::vector<MeshLod> lods;
         std::vector<Texture> textures;
+        /* Layer of its diffuse texture in the model's material array */
+        int layer{-1};
 
-        Mesh(std::vector<Vertex> vertices, std::vector<GLuint> indices,
-             std::vector<Texture> textures);
-        void draw(Shader &shader);
+        /* index_count covers every level, lods are relative to indices. With
+         * no lods the whole index array is a single level. */
+        Mesh(MeshBuffer &buffer, const Vertex *vertices, GLsizei vertex_count,
+             const GLuint *indices, GLsizei index_count,
+             std::vector<Texture> textures,
+             const std::vector<LodLevel> &lods = {});
 
-      private:
-        GLuint VBO, EBO;
+        /* Expects the VAO of its MeshBuffer to be bound */
+        void draw(Shader &shader, size_t lod = 0);
+
+        const MeshLod &level(size_t lod) const {
+                return lods[std::min(lod, lods.size() - 1)];
+        }
+
+        /* Byte offset of the first index, as the draw calls want it */
+        const void *index_offset(size_t lod = 0) const {
+                return reinterpret_cast<const void *>(level(lod).first_index *
+                                                      sizeof(GLuint));
+        }
+};
+
+void bind_textures(Shader &shader, const std::vector<Texture> &textures);
 
-        void setup_mesh();
+/* Arguments of one multi draw call */
+struct DrawList {
+        std::vector<GLsizei> counts;
+        std::vector<const void *> offsets;
+        std::vector<GLint> base_vertices;
 };
 
+/* Meshes sharing the same textures, or the same material array layer,
+ * one draw list per LOD level */
+struct MeshBatch {
+        std::vector<Texture> textures;
+        std::vector<DrawList> lods;
+        int layer{-1};
+};
+
+/* Mesh arrays on their way to the GPU, from either load path */
+struct MeshSource {
+        const Vertex *vertices;
+        size_t vertex_count;
+        const GLuint *indices;
+        size_t index_count;
+        const std::vector<LodLevel> *lods;
+        const std::vector<TextureRef> *textures;
+};
+
+/* Height in pixels of a sphere seen from distance with a vertical field of
+ * view of fovy radians */
+float projected_size(float radius, float distance, float fovy,
+                     float viewport_height);
+
 class Model {
       public:
-        Model(const char *path);
-        void draw(Shader &shader);
+        Model(const char *path, VertexFormat format = VertexFormat::Float);
+        void draw(Shader &shader, size_t lod = 0);
+        /* At the level select_lod picks for how large it appears, with
+         * model_view taking it into eye space, uniformly scaled */
+        void draw(Shader &shader, const glm::mat4 &model_view, float fovy,
+                  float viewport_height);
+
+        /* Every instance in one call per mesh, for Scatter.vs */
+        void draw_instanced(Shader &shader, const InstanceBuffer &instances,
+                            size_t lod = 0);
+        /* The first count instance indices in index_buffer, as written by
+         * InstanceCuller */
+        void draw_instanced(Shader &shader, const InstanceBuffer &instances,
+                            GLuint index_buffer, GLsizei count,
+                            size_t lod = 0);
+
+        /* Coarsest level that stays within LOD_PIXEL_ERROR when the
+         * bounding sphere covers screen_size pixels */
+        size_t select_lod(float screen_size) const;
+
+        /* Packs the diffuse textures into one texture array so the whole
+         * model draws with a single binding. Fails when a mesh has no
+         * loaded diffuse texture or they differ in size or format. Drawing
+         * calls it once every texture of the model is loaded. */
+        bool build_material_array();
 
+        MeshBuffer buffer;
         std::vector<Mesh> meshes;
-        std::vector<Texture> textures_loaded;
+        std::vector<MeshBatch> batches;
+        std::unique_ptr<TextureArray> material_array;
+        /* Bounding sphere in model space */
+        glm::vec3 center{0.0f};
+        float radius{0.0f};
+        /* Largest error of each level over all meshes */
+        std::vector<float> lod_errors;
 
       private:
         std::string directory;
+        VertexFormat format;
+        bool material_array_tried{false};
 
+        void upload_meshes(const std::string &path,
+                           const std::vector<MeshSource> &sources);
+        void build_batches();
+        bool textures_resident() const;
+        void begin_draw(Shader &shader);
+        void bind_material(Shader &shader, const MeshBatch &batch);
         void load_model(std::string path);
-        void process_node(aiNode *node, const aiScene *scene);
-        Mesh process_mesh(aiMesh *mesh, const aiScene *scene);
-        std::vector<Texture> load_material_textures(aiMaterial *mat,
-                                                  aiTextureType type,
-                                                  std::string typeName);
+        bool load_cached(const std::string &path);
+        void process_node(aiNode *node, const aiScene *scene,
+                          std::vector<MeshData> &mesh_data,
+                          std::pmr::memory_resource *arena);
+        MeshData process_mesh(aiMesh *mesh, const aiScene *scene,
+                              std::pmr::memory_resource *arena);
+        void material_textures(aiMaterial *mat, aiTextureType type,
+                               std::string typeName,
+                               std::vector<TextureRef> &refs);
+        std::vector<Texture> load_textures(const std::vector<TextureRef> &refs);
 };
 
 #endif /* MODEL_H */
\ No newline at end of file
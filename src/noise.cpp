@@ -1,6 +1,6 @@
 #include "noise.hpp"
 
-static int permutation[] = {
+static const int permutation[] = {
         151, 160, 137, 91,  90,  15,  131, 13,  201, 95,  96,  53,  194, 233,
         7,   225, 140, 36,  103, 30,  69,  142, 8,   99,  37,  240, 21,  10,
         23,  190, 6,   148, 247, 120, 234, 75,  0,   26,  197, 62,  94,  252,
@@ -21,24 +21,29 @@ static int permutation[] = {
         205, 93,  222, 114, 67,  29,  24,  72,  243, 141, 128, 195, 78,  66,
         215, 61,  156, 180};
 
-void shuffle() {
-        unsigned seed =
-                std::chrono::system_clock::now().time_since_epoch().count();
+static void shuffle(int *table, unsigned seed) {
         std::default_random_engine gen(seed);
         std::uniform_int_distribution<int> dist{0, 255};
         for (int i = 255; i > 0; i--) {
                 int index = dist(gen);
-                int temp = permutation[i];
+                int temp = table[i];
 
-                permutation[i] = permutation[index];
-                permutation[index] = temp;
+                table[i] = table[index];
+                table[index] = temp;
         }
 }
 
-perlin::perlin() {
-        shuffle();
+perlin::perlin()
+        : perlin(std::chrono::system_clock::now().time_since_epoch().count()) {}
+
+perlin::perlin(unsigned seed) {
+        int table[256];
+        for (int i = 0; i < 256; i++) {
+                table[i] = permutation[i];
+        }
+        shuffle(table, seed);
         for (int i = 0; i < 256; i++) {
-                p[256 + i] = p[i] = permutation[i];
+                p[256 + i] = p[i] = table[i];
         }
 }
 
@@ -9,6 +9,8 @@
 class perlin {
       public:
         perlin();
+        /* Deterministic permutation, the same seed gives the same noise */
+        perlin(unsigned seed);
         /* Fractal Brownian Motion */
         float fbm_noise(float x, float y, int n_octaves);
         float noise(float x, float y);
@@ -0,0 +1,48 @@
+#ifndef PARALLEL_FOR_H
+#define PARALLEL_FOR_H
+
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <thread>
+#include <vector>
+
+/* Threads to use for a requested count, 0 or less uses every core */
+inline int thread_count(int threads) {
+        if (threads <= 0) {
+                threads = std::max(1u, std::thread::hardware_concurrency());
+        }
+        return threads;
+}
+
+/* Workers parallel_for runs count items on, always at least one */
+inline int parallel_workers(size_t count, int threads) {
+        return static_cast<int>(std::min<size_t>(
+                thread_count(threads), std::max<size_t>(count, 1)));
+}
+
+/**
+ * Calls work(i, worker) for every i in [0, count), handing items out in
+ * order to parallel_workers(count, threads) workers. The calling thread is
+ * worker 0, so worker indexes per-worker scratch or results.
+ */
+template <typename Work>
+void parallel_for(size_t count, int threads, Work work) {
+        std::atomic<size_t> next{0};
+        auto run = [&](int worker) {
+                for (size_t i = next++; i < count; i = next++) {
+                        work(i, worker);
+                }
+        };
+        int workers_count = parallel_workers(count, threads);
+        std::vector<std::thread> workers;
+        for (int i = 1; i < workers_count; i++) {
+                workers.emplace_back(run, i);
+        }
+        run(0);
+        for (std::thread &worker : workers) {
+                worker.join();
+        }
+}
+
+#endif /* PARALLEL_FOR_H */
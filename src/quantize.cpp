@@ -0,0 +1,83 @@
+#include "quantize.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <glm/gtc/packing.hpp>
+
+void expand_bounds(const Vertex *vertices, size_t count, glm::vec3 &min,
+                   glm::vec3 &max) {
+        for (size_t i = 0; i < count; i++) {
+                min = glm::min(min, vertices[i].position);
+                max = glm::max(max, vertices[i].position);
+        }
+}
+
+VertexQuantization quantization_for_bounds(glm::vec3 min, glm::vec3 max) {
+        VertexQuantization quantization;
+        if (min.x > max.x) {
+                /* Nothing was added to the box */
+                return quantization;
+        }
+        quantization.offset = min;
+        quantization.scale = max - min;
+        /* Flat boxes still need a scale the shader can multiply by */
+        for (int i = 0; i < 3; i++) {
+                if (quantization.scale[i] <= 0.0f) {
+                        quantization.scale[i] = 1.0f;
+                }
+        }
+        return quantization;
+}
+
+PackedVertex pack_vertex(const Vertex &vertex,
+                         const VertexQuantization &quantization) {
+        PackedVertex packed;
+        glm::vec3 unit = glm::clamp(
+                (vertex.position - quantization.offset) / quantization.scale,
+                0.0f, 1.0f);
+        for (int i = 0; i < 3; i++) {
+                packed.position[i] = std::lround(unit[i] * 65535.0f);
+        }
+        packed.position[3] = 0;
+        packed.normal = glm::packSnorm3x10_1x2(glm::vec4(vertex.normal, 0.0f));
+        packed.tex_coords[0] = glm::packHalf1x16(vertex.tex_coords.x);
+        packed.tex_coords[1] = glm::packHalf1x16(vertex.tex_coords.y);
+        return packed;
+}
+
+Vertex unpack_vertex(const PackedVertex &vertex,
+                     const VertexQuantization &quantization) {
+        Vertex unpacked;
+        glm::vec3 unit{vertex.position[0], vertex.position[1],
+                       vertex.position[2]};
+        unpacked.position =
+                quantization.offset + unit / 65535.0f * quantization.scale;
+        unpacked.normal = glm::vec3(glm::unpackSnorm3x10_1x2(vertex.normal));
+        unpacked.tex_coords = {glm::unpackHalf1x16(vertex.tex_coords[0]),
+                               glm::unpackHalf1x16(vertex.tex_coords[1])};
+        return unpacked;
+}
+
+void measure_quantization_error(const Vertex *vertices, size_t count,
+                                const VertexQuantization &quantization,
+                                QuantizationError &error) {
+        for (size_t i = 0; i < count; i++) {
+                const Vertex &v = vertices[i];
+                Vertex q = unpack_vertex(pack_vertex(v, quantization),
+                                         quantization);
+                error.position = std::max(
+                        error.position, glm::length(q.position - v.position));
+                error.tex_coord =
+                        std::max(error.tex_coord,
+                                 glm::length(q.tex_coords - v.tex_coords));
+
+                float length = glm::length(v.normal) * glm::length(q.normal);
+                if (length > 0.0f) {
+                        float cosine = glm::clamp(
+                                glm::dot(v.normal, q.normal) / length, -1.0f,
+                                1.0f);
+                        error.normal = std::max(
+                                error.normal, glm::degrees(std::acos(cosine)));
+                }
+        }
+}
@@ -0,0 +1,39 @@
+#ifndef QUANTIZE_H
+#define QUANTIZE_H
+
+#include <cstddef>
+
+#include "vertex.hpp"
+
+/**
+ * Conversion between Vertex and PackedVertex. Positions are stored relative
+ * to a box that has to contain every vertex sharing the quantization, so
+ * it is usually built from all meshes of a model.
+ */
+
+/* Largest error seen, in model units for positions and texture coordinates
+ * and in degrees for normals */
+struct QuantizationError {
+        float position{0.0f};
+        float normal{0.0f};
+        float tex_coord{0.0f};
+};
+
+/* Grows min and max to contain the vertices */
+void expand_bounds(const Vertex *vertices, size_t count, glm::vec3 &min,
+                   glm::vec3 &max);
+
+VertexQuantization quantization_for_bounds(glm::vec3 min, glm::vec3 max);
+
+PackedVertex pack_vertex(const Vertex &vertex,
+                         const VertexQuantization &quantization);
+
+Vertex unpack_vertex(const PackedVertex &vertex,
+                     const VertexQuantization &quantization);
+
+/* Packs and unpacks every vertex, keeping the worst error in error */
+void measure_quantization_error(const Vertex *vertices, size_t count,
+                                const VertexQuantization &quantization,
+                                QuantizationError &error);
+
+#endif /* QUANTIZE_H */
@@ -0,0 +1,85 @@
+#include "renderer.hpp"
+#include "gl_state.hpp"
+#include "gl_stats.hpp"
+#include "terrain.hpp"
+#include "trace.hpp"
+#include "viewshed.hpp"
+
+#include <string>
+
+GLuint create_heightmap_texture(const Heightmap &map) {
+        GLuint texture;
+        glGenTextures(1, &texture);
+        GLState::instance().bind_texture(GL_TEXTURE_2D, texture);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER,
+                        GL_LINEAR_MIPMAP_LINEAR);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+
+        TRACE_SCOPE("upload_heightmap");
+        glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+        glTexImage2D(GL_TEXTURE_2D, 0, GL_DEPTH_COMPONENT, map.width,
+                     map.height, 0, GL_DEPTH_COMPONENT, GL_UNSIGNED_BYTE,
+                     map.data.data());
+        GLStats::instance().count_upload(map.data.size());
+        glGenerateMipmap(GL_TEXTURE_2D);
+        return texture;
+}
+
+void update_heightmap_texture(GLuint texture, const Heightmap &map) {
+        TRACE_SCOPE("upload_heightmap");
+        GLState::instance().bind_texture(GL_TEXTURE_2D, texture);
+        glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+        glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, map.width, map.height,
+                        GL_DEPTH_COMPONENT, GL_UNSIGNED_BYTE, map.data.data());
+        GLStats::instance().count_upload(map.data.size());
+        glGenerateMipmap(GL_TEXTURE_2D);
+}
+
+GLuint create_visibility_texture(const VisibilityMask &mask) {
+        GLuint texture;
+        glGenTextures(1, &texture);
+        GLState::instance().bind_texture(GL_TEXTURE_2D, texture);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+        /* Integer textures can't be filtered */
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+
+        TRACE_SCOPE("upload_visibility");
+        glTexImage2D(GL_TEXTURE_2D, 0, GL_R32UI, mask.words_per_row,
+                     mask.height, 0, GL_RED_INTEGER, GL_UNSIGNED_INT,
+                     mask.words.data());
+        GLStats::instance().count_upload(mask.words.size() *
+                                         sizeof(uint32_t));
+        return texture;
+}
+
+void update_visibility_texture(GLuint texture, const VisibilityMask &mask) {
+        TRACE_SCOPE("upload_visibility");
+        GLState::instance().bind_texture(GL_TEXTURE_2D, texture);
+        glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, mask.words_per_row,
+                        mask.height, GL_RED_INTEGER, GL_UNSIGNED_INT,
+                        mask.words.data());
+        GLStats::instance().count_upload(mask.words.size() *
+                                         sizeof(uint32_t));
+}
+
+void set_terrain_uniforms(Shader &shader) {
+        shader.use();
+        shader.set_uniform("band_count", terrain_band_count);
+        for (int i = 0; i < terrain_band_count; i++) {
+                std::string index = "[" + std::to_string(i) + "]";
+                glm::vec3 color = terrain_bands[i].color;
+                shader.set_uniform(("band_heights" + index).c_str(),
+                                   terrain_bands[i].max_height);
+                shader.set_uniform(("band_colors" + index).c_str(), color);
+        }
+        shader.set_uniform("shadow_brightness", SHADOW_BRIGHTNESS);
+        shader.set_uniform("steps", SHADOW_STEPS);
+        /* Even unused, an unsigned sampler left on unit 0 next to the
+         * heightmap fails every draw */
+        shader.set_uniform("viewshed", VIEWSHED_UNIT);
+        shader.set_uniform("show_viewshed", 0);
+}
@@ -0,0 +1,38 @@
+#ifndef RENDERER_H
+#define RENDERER_H
+
+#include <glad/glad.h>
+
+#include "heightmap.hpp"
+#include "shader.hpp"
+
+class VisibilityMask;
+
+/*
+ * GL side of the map. The heightmap, noise and shading code lives in
+ * libmapsim without any GL or GLFW dependency, everything here needs a
+ * current context.
+ */
+
+/* Creates a clamped, mipmapped texture holding the heightmap */
+GLuint create_heightmap_texture(const Heightmap &map);
+
+/* Replaces the contents of a texture made by create_heightmap_texture */
+void update_heightmap_texture(GLuint texture, const Heightmap &map);
+
+/* Texture unit StepShadow.fs reads the viewshed overlay from */
+const GLuint VIEWSHED_UNIT = 1;
+
+/* Creates an R32UI texture holding the mask's words as they are, a texel
+ * for every 32 map texels along x. StepShadow.fs darkens what the mask
+ * leaves out while show_viewshed is set. */
+GLuint create_visibility_texture(const VisibilityMask &mask);
+
+/* Replaces the contents of a texture made by create_visibility_texture */
+void update_visibility_texture(GLuint texture, const VisibilityMask &mask);
+
+/* Uploads the terrain band table and shadow settings to StepShadow.fs, with
+ * the viewshed overlay on VIEWSHED_UNIT and switched off */
+void set_terrain_uniforms(Shader &shader);
+
+#endif /* RENDERER_H */
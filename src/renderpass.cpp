@@ -0,0 +1,86 @@
+#include "renderpass.hpp"
+#include "gl_state.hpp"
+#include "gl_stats.hpp"
+
+RenderTarget::RenderTarget(int width, int height, GLenum internal_format)
+        : internal_format{internal_format} {
+        glGenTextures(1, &color);
+        GLState::instance().bind_texture(GL_TEXTURE_2D, color);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+
+        glGenFramebuffers(1, &fbo);
+        resize(width, height);
+}
+
+RenderTarget::~RenderTarget() {
+        GLState::instance().delete_framebuffer(fbo);
+        GLState::instance().delete_texture(color);
+}
+
+void RenderTarget::resize(int width, int height) {
+        if (width == this->width && height == this->height) {
+                return;
+        }
+        this->width = width;
+        this->height = height;
+
+        GLState &state = GLState::instance();
+        state.bind_texture(GL_TEXTURE_2D, color);
+        glTexImage2D(GL_TEXTURE_2D, 0, internal_format, width, height, 0,
+                     GL_RGBA, GL_UNSIGNED_BYTE, NULL);
+
+        state.bind_framebuffer(fbo);
+        glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0,
+                               GL_TEXTURE_2D, color, 0);
+        if (glCheckFramebufferStatus(GL_FRAMEBUFFER) !=
+            GL_FRAMEBUFFER_COMPLETE) {
+                std::cout << "ERROR::FRAMEBUFFER::INCOMPLETE\n";
+        }
+}
+
+FullscreenPass::FullscreenPass(const char *fragment_path)
+        : shader{"src/shaders/Fullscreen.vs", fragment_path} {
+        glGenVertexArrays(1, &empty_vao);
+}
+
+FullscreenPass::~FullscreenPass() {
+        GLState::instance().delete_vertex_array(empty_vao);
+}
+
+void FullscreenPass::set_input(const char *sampler, GLuint unit,
+                               GLuint texture) {
+        shader.use();
+        shader.set_uniform(sampler, unit);
+        for (Input &input : inputs) {
+                if (input.unit == unit) {
+                        input.texture = texture;
+                        return;
+                }
+        }
+        inputs.push_back({unit, texture});
+}
+
+void FullscreenPass::draw(const RenderTarget &target) {
+        GLState::instance().bind_framebuffer(target.fbo);
+        glViewport(0, 0, target.width, target.height);
+        draw_triangle();
+}
+
+void FullscreenPass::draw_to_screen(int width, int height) {
+        GLState::instance().bind_framebuffer(0);
+        glViewport(0, 0, width, height);
+        draw_triangle();
+}
+
+void FullscreenPass::draw_triangle() {
+        GLState &state = GLState::instance();
+        shader.use();
+        for (const Input &input : inputs) {
+                state.bind_texture(input.unit, GL_TEXTURE_2D, input.texture);
+        }
+        state.bind_vertex_array(empty_vao);
+        draw_arrays(GL_TRIANGLES, 0, 3);
+}
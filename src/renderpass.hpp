@@ -0,0 +1,77 @@
+#ifndef RENDERPASS_H
+#define RENDERPASS_H
+
+#include <glad/glad.h>
+
+#include <vector>
+
+#include "shader.hpp"
+
+/**
+ * Color texture with a framebuffer around it, used as the output of one
+ * pass and the input of the next.
+ */
+class RenderTarget {
+      public:
+        GLuint fbo{};
+        GLuint color{};
+        int width{};
+        int height{};
+
+        RenderTarget(int width, int height, GLenum internal_format = GL_RGBA8);
+        ~RenderTarget();
+
+        RenderTarget(const RenderTarget &) = delete;
+        RenderTarget &operator=(const RenderTarget &) = delete;
+
+        /* Reallocates the color texture, a no-op when the size is unchanged */
+        void resize(int width, int height);
+
+      private:
+        GLenum internal_format;
+};
+
+/**
+ * A fragment shader run over the whole viewport.
+ *
+ * Passes draw a single triangle that covers the screen, its corners are
+ * generated from gl_VertexID in Fullscreen.vs so no vertex buffer is needed.
+ * Each pass owns the empty VAO it draws with, created along with it, which
+ * means a frame made of passes creates no GL objects and uploads no
+ * buffers.
+ *
+ *      FullscreenPass shadow{"src/shaders/StepShadow.fs"};
+ *      shadow.set_input("perlin_map", 0, perlin_map);
+ *      shadow.draw(target);
+ *      overlay.set_input("scene", 0, target.color);
+ *      overlay.draw_to_screen(width, height);
+ */
+class FullscreenPass {
+      public:
+        Shader shader;
+
+        FullscreenPass(const char *fragment_path);
+        ~FullscreenPass();
+
+        FullscreenPass(const FullscreenPass &) = delete;
+        FullscreenPass &operator=(const FullscreenPass &) = delete;
+
+        /* Points sampler at unit and binds texture there for every draw */
+        void set_input(const char *sampler, GLuint unit, GLuint texture);
+
+        void draw(const RenderTarget &target);
+        void draw_to_screen(int width, int height);
+
+      private:
+        struct Input {
+                GLuint unit;
+                GLuint texture;
+        };
+        std::vector<Input> inputs;
+        /* Core profile still wants a VAO bound even with no attributes */
+        GLuint empty_vao{};
+
+        void draw_triangle();
+};
+
+#endif /* RENDERPASS_H */
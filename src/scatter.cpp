@@ -0,0 +1,246 @@
+#include "scatter.hpp"
+#include "parallel_for.hpp"
+#include "trace.hpp"
+
+#include <glm/gtc/matrix_transform.hpp>
+
+#include <algorithm>
+#include <cmath>
+#include <random>
+
+/* Mixes seed and n into an independent 32 bit stream id, splitmix64 */
+static uint32_t mix(uint64_t seed, uint64_t n) {
+        uint64_t z = seed * 0x9E3779B97F4A7C15ull + n + 0x632BE59BD9B4E019ull;
+        z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ull;
+        z = (z ^ (z >> 27)) * 0x94D049BB133111EBull;
+        return static_cast<uint32_t>(z ^ (z >> 31));
+}
+
+static float unit_float(uint32_t bits) {
+        return (bits >> 8) * (1.0f / 16777216.0f);
+}
+
+namespace {
+
+/* Background grid shared by all tiles, a cell is empty while x < 0 */
+struct PoissonGrid {
+        float cell;
+        int width;
+        int height;
+        std::vector<glm::vec2> cells;
+
+        glm::vec2 &at(int x, int y) {
+                return cells[static_cast<size_t>(y) * width + x];
+        }
+
+        /* Clamped, p / cell may round up to the edge */
+        glm::vec2 &cell_of(glm::vec2 p) {
+                return at(std::min(static_cast<int>(p.x / cell), width - 1),
+                          std::min(static_cast<int>(p.y / cell), height - 1));
+        }
+
+        bool fits(glm::vec2 p, float min_distance_sq) {
+                int cx = std::min(static_cast<int>(p.x / cell), width - 1);
+                int cy = std::min(static_cast<int>(p.y / cell), height - 1);
+                if (at(cx, cy).x >= 0.0f) {
+                        return false;
+                }
+                int x0 = std::max(cx - 2, 0), x1 = std::min(cx + 2, width - 1);
+                int y0 = std::max(cy - 2, 0), y1 = std::min(cy + 2, height - 1);
+                for (int y = y0; y <= y1; y++) {
+                        for (int x = x0; x <= x1; x++) {
+                                glm::vec2 q = at(x, y);
+                                glm::vec2 d = q - p;
+                                if (q.x >= 0.0f &&
+                                    glm::dot(d, d) < min_distance_sq) {
+                                        return false;
+                                }
+                        }
+                }
+                return true;
+        }
+};
+
+} // namespace
+
+/* Bridson's dart throwing inside one tile. Once the active list runs dry a
+ * few more random throws pick up pockets it couldn't reach. */
+static void fill_tile(PoissonGrid &grid, glm::vec2 lo, glm::vec2 hi,
+                      float r, uint32_t stream,
+                      std::vector<glm::vec2> &points) {
+        std::mt19937 rng{stream};
+        std::uniform_real_distribution<float> unit{0.0f, 1.0f};
+        std::vector<glm::vec2> active;
+        float r_sq = r * r;
+        const float turn = 6.2831853f / SCATTER_CANDIDATES;
+        const glm::vec2 step{std::cos(turn), std::sin(turn)};
+        auto accept = [&](glm::vec2 p) {
+                grid.cell_of(p) = p;
+                points.push_back(p);
+                active.push_back(p);
+        };
+
+        int misses = 0;
+        while (misses < SCATTER_CANDIDATES) {
+                glm::vec2 seed =
+                        lo + (hi - lo) * glm::vec2(unit(rng), unit(rng));
+                if (!grid.fits(seed, r_sq)) {
+                        misses++;
+                        continue;
+                }
+                misses = 0;
+                accept(seed);
+                while (!active.empty()) {
+                        size_t pick = rng() % active.size();
+                        glm::vec2 center = active[pick];
+                        bool found = false;
+                        /* Evenly spaced candidates just outside r, from a
+                         * random start, pack tighter than random ones in
+                         * the annulus and need one sin and cos */
+                        float angle = unit(rng) * 6.2831853f;
+                        glm::vec2 offset = r * 1.0001f *
+                                           glm::vec2(std::cos(angle),
+                                                     std::sin(angle));
+                        for (int k = 0; k < SCATTER_CANDIDATES; k++) {
+                                offset = glm::vec2(
+                                        offset.x * step.x - offset.y * step.y,
+                                        offset.x * step.y + offset.y * step.x);
+                                glm::vec2 p = center + offset;
+                                if (p.x < lo.x || p.y < lo.y || p.x >= hi.x ||
+                                    p.y >= hi.y || !grid.fits(p, r_sq)) {
+                                        continue;
+                                }
+                                accept(p);
+                                found = true;
+                                break;
+                        }
+                        if (!found) {
+                                active[pick] = active.back();
+                                active.pop_back();
+                        }
+                }
+        }
+}
+
+std::vector<glm::vec2> poisson_disk(float width, float height,
+                                    float min_distance, unsigned seed,
+                                    int threads, const TileFilter &skip_tile) {
+        TRACE_FUNCTION();
+        PoissonGrid grid;
+        grid.cell = min_distance / std::sqrt(2.0f);
+        grid.width =
+                std::max(1, static_cast<int>(std::ceil(width / grid.cell)));
+        grid.height =
+                std::max(1, static_cast<int>(std::ceil(height / grid.cell)));
+        grid.cells.assign(static_cast<size_t>(grid.width) * grid.height,
+                          glm::vec2(-1.0f));
+
+        int tiles_x =
+                (grid.width + SCATTER_TILE_CELLS - 1) / SCATTER_TILE_CELLS;
+        int tiles_y =
+                (grid.height + SCATTER_TILE_CELLS - 1) / SCATTER_TILE_CELLS;
+        std::vector<std::vector<glm::vec2>> tile_points(
+                static_cast<size_t>(tiles_x) * tiles_y);
+
+        float tile_size = SCATTER_TILE_CELLS * grid.cell;
+        for (int parity = 0; parity < 4; parity++) {
+                std::vector<int> tiles;
+                for (int ty = parity / 2; ty < tiles_y; ty += 2) {
+                        for (int tx = parity % 2; tx < tiles_x; tx += 2) {
+                                tiles.push_back(ty * tiles_x + tx);
+                        }
+                }
+                parallel_for(tiles.size(), threads, [&](size_t i, int) {
+                        TRACE_SCOPE("poisson_tile");
+                        int tile = tiles[i];
+                        glm::vec2 lo{(tile % tiles_x) * tile_size,
+                                     (tile / tiles_x) * tile_size};
+                        glm::vec2 hi = glm::min(lo + tile_size,
+                                                glm::vec2(width, height));
+                        if (skip_tile && skip_tile(lo, hi)) {
+                                return;
+                        }
+                        fill_tile(grid, lo, hi, min_distance, mix(seed, tile),
+                                  tile_points[tile]);
+                });
+        }
+
+        std::vector<glm::vec2> points;
+        for (const std::vector<glm::vec2> &tile : tile_points) {
+                points.insert(points.end(), tile.begin(), tile.end());
+        }
+        return points;
+}
+
+float terrain_slope(const Heightmap &map, float x, float y) {
+        float du = 1.0f / map.width, dv = 1.0f / map.height;
+        float u = x * du, v = y * dv;
+        glm::vec2 gradient{map.sample(u + du, v) - map.sample(u - du, v),
+                           map.sample(u, v + dv) - map.sample(u, v - dv)};
+        return glm::length(gradient) * 0.5f * TERRAIN_HEIGHT_SCALE;
+}
+
+std::vector<ScatterInstance>
+scatter_instances(const Heightmap &map, const ScatterSettings &settings) {
+        TRACE_FUNCTION();
+        /* Bilinear samples stay within the texels around the tile */
+        auto outside_band = [&](glm::vec2 lo, glm::vec2 hi) {
+                int x0 = std::max(static_cast<int>(lo.x) - 1, 0);
+                int y0 = std::max(static_cast<int>(lo.y) - 1, 0);
+                int x1 = std::min(static_cast<int>(hi.x) + 1, map.width - 1);
+                int y1 = std::min(static_cast<int>(hi.y) + 1, map.height - 1);
+                for (int y = y0; y <= y1; y++) {
+                        for (int x = x0; x <= x1; x++) {
+                                float h = map.at(x, y) / 255.0f;
+                                if (h >= settings.min_height &&
+                                    h <= settings.max_height) {
+                                        return false;
+                                }
+                        }
+                }
+                return true;
+        };
+        std::vector<glm::vec2> points =
+                poisson_disk(map.width, map.height, settings.min_distance,
+                             settings.seed, settings.threads, outside_band);
+
+        std::vector<ScatterInstance> instances;
+        for (size_t i = 0; i < points.size(); i++) {
+                glm::vec2 p = points[i];
+                float height = map.sample(p.x / map.width, p.y / map.height);
+                if (height < settings.min_height ||
+                    height > settings.max_height ||
+                    terrain_slope(map, p.x, p.y) > settings.max_slope) {
+                        continue;
+                }
+                uint32_t bits = mix(settings.seed, i);
+                float t = unit_float(mix(bits, 1));
+                instances.push_back(
+                        {{p.x, height * TERRAIN_HEIGHT_SCALE, p.y},
+                         unit_float(bits) * 6.2831853f,
+                         settings.min_scale +
+                                 (settings.max_scale - settings.min_scale) *
+                                         t});
+        }
+
+        /* Points come tile by tile, an even stride keeps every tile */
+        size_t count = instances.size();
+        if (count > settings.max_instances) {
+                std::vector<ScatterInstance> kept;
+                kept.reserve(settings.max_instances);
+                for (size_t i = 0; i < settings.max_instances; i++) {
+                        kept.push_back(
+                                instances[i * count / settings.max_instances]);
+                }
+                instances.swap(kept);
+        }
+        return instances;
+}
+
+glm::mat4 instance_transform(const ScatterInstance &instance) {
+        glm::mat4 transform = glm::translate(glm::mat4(1.0f),
+                                             instance.position);
+        transform = glm::rotate(transform, instance.yaw,
+                                glm::vec3(0.0f, 1.0f, 0.0f));
+        return glm::scale(transform, glm::vec3(instance.scale));
+}
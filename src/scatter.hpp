@@ -0,0 +1,77 @@
+#ifndef SCATTER_H
+#define SCATTER_H
+
+#include <glm/glm.hpp>
+
+#include <functional>
+#include <vector>
+
+#include "heightmap.hpp"
+#include "terrain.hpp"
+
+/**
+ * Placement of props, like rocks, over the terrain.
+ *
+ * poisson_disk covers a rectangle with points no closer than min_distance
+ * using Bridson's algorithm on a background grid of r / sqrt(2) cells, so
+ * each cell holds at most one point and a candidate checks a 5x5 block.
+ * Candidates sit on a circle just outside r rather than anywhere in the
+ * annulus, which packs tighter with fewer of them.
+ *
+ * The grid is cut into tiles of SCATTER_TILE_CELLS cells. Tiles of the same
+ * parity in x and y are a whole tile apart and can't see each other's
+ * points, so the four parity classes run one after another and the tiles
+ * in each run in parallel. Every tile has its own random stream, which
+ * makes the result independent of the thread count.
+ *
+ * scatter_instances keeps the points whose terrain lies in a height band
+ * and isn't too steep, and gives each a random yaw and scale. Tiles with no
+ * texel in the band, open sea on most maps, are skipped outright. Positions
+ * are in terrain world units: one unit per texel along x and z, with map
+ * rows running along +z, and TERRAIN_HEIGHT_SCALE for a full height.
+ */
+
+const int SCATTER_TILE_CELLS = 32;
+const int SCATTER_CANDIDATES = 12;
+
+struct ScatterSettings {
+        /* In texels */
+        float min_distance{4.0f};
+        /* Height band, as normalized heights */
+        float min_height{0.1f};
+        float max_height{1.0f};
+        /* Rise over run in world units, 1 is 45 degrees */
+        float max_slope{1.0f};
+        float min_scale{0.5f};
+        float max_scale{1.5f};
+        /* Points past this are thinned out evenly over the map */
+        size_t max_instances{100000};
+        unsigned seed{0};
+        /* 0 uses every core */
+        int threads{0};
+};
+
+struct ScatterInstance {
+        glm::vec3 position;
+        float yaw;
+        float scale;
+};
+
+/* Tiles covering [lo, hi) for which skip_tile returns true stay empty */
+using TileFilter = std::function<bool(glm::vec2 lo, glm::vec2 hi)>;
+
+std::vector<glm::vec2> poisson_disk(float width, float height,
+                                    float min_distance, unsigned seed,
+                                    int threads = 0,
+                                    const TileFilter &skip_tile = {});
+
+/* Rise over run of the terrain at texel coordinates x, y */
+float terrain_slope(const Heightmap &map, float x, float y);
+
+std::vector<ScatterInstance> scatter_instances(const Heightmap &map,
+                                               const ScatterSettings &settings);
+
+/* Model matrix of an instance, yaw about +y then uniform scale */
+glm::mat4 instance_transform(const ScatterInstance &instance);
+
+#endif /* SCATTER_H */
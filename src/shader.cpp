@@ -1,6 +1,10 @@
 #include "shader.hpp"
+#include "gl_state.hpp"
+#include "gl_stats.hpp"
+#include "trace.hpp"
 
 Shader::Shader(const char *vertex_path, const char *fragment_path) {
+        TRACE_SCOPE("Shader::Shader");
         std::string vertex_contents = read_glsl_shader(vertex_path);
         std::string fragment_contents = read_glsl_shader(fragment_path);
         GLuint vertex_shader = compile_shader(vertex_contents.c_str(), VERTEX);
@@ -22,6 +26,7 @@ Shader::Shader(const char *vertex_path, const char *fragment_path) {
 }
 
 Shader::Shader(const char *vertex_path, const char *fragment_path, const char *geometry_path) {
+        TRACE_SCOPE("Shader::Shader");
         std::string vertex_contents = read_glsl_shader(vertex_path);
         std::string fragment_contents = read_glsl_shader(fragment_path);
         std::string geometry_contents = read_glsl_shader(geometry_path);
@@ -46,6 +51,32 @@ Shader::Shader(const char *vertex_path, const char *fragment_path, const char *g
         glDeleteShader(geometry_shader);
 }
 
+Shader::Shader(const char *vertex_path, const char *geometry_path,
+               const char *const *varyings, GLsizei varying_count) {
+        TRACE_SCOPE("Shader::Shader");
+        std::string vertex_contents = read_glsl_shader(vertex_path);
+        std::string geometry_contents = read_glsl_shader(geometry_path);
+        GLuint vertex_shader = compile_shader(vertex_contents.c_str(), VERTEX);
+        GLuint geometry_shader = compile_shader(geometry_contents.c_str(), GEOMETRY);
+
+        id = glCreateProgram();
+        glAttachShader(id, vertex_shader);
+        glAttachShader(id, geometry_shader);
+        /* Only takes effect at link time */
+        glTransformFeedbackVaryings(id, varying_count, varyings,
+                                    GL_INTERLEAVED_ATTRIBS);
+        glLinkProgram(id);
+        int success;
+        char infoLog[512];
+        glGetProgramiv(id, GL_LINK_STATUS, &success);
+        if (!success) {
+                glGetProgramInfoLog(id, 512, NULL, infoLog);
+                std::cout << "ERROR::SHADER::PROGRAM::LINKING_FAILED\n" << infoLog << std::endl;
+        }
+        glDeleteShader(vertex_shader);
+        glDeleteShader(geometry_shader);
+}
+
 std::string Shader::read_glsl_shader(const char *path) {
         std::ifstream glsl_file;
         glsl_file.open(path);
@@ -87,38 +118,58 @@ GLuint Shader::compile_shader(const char *shader_contents, ShaderType type) {
 }
 
 void Shader::use() {
-        glUseProgram(id);
+        GLState::instance().use_program(id);
 }
 
 void Shader::set_uniform(const char *name, int i) const {
+        GLStats::instance().frame.uniform_updates++;
         glUniform1i(glGetUniformLocation(id, name), i);
 }
 
 void Shader::set_uniform(const char *name, unsigned int i) const {
+        GLStats::instance().frame.uniform_updates++;
         glUniform1i(glGetUniformLocation(id, name), i);
 }
 
 void Shader::set_uniform(const char *name, float f) const {
+        GLStats::instance().frame.uniform_updates++;
         glUniform1f(glGetUniformLocation(id, name), f);
 }
 
 void Shader::set_uniform(const char *name, float x, float y) const {
+        GLStats::instance().frame.uniform_updates++;
         glUniform2f(glGetUniformLocation(id, name), x, y);
 }
 
 void Shader::set_uniform(const char *name, glm::vec2 &vec) const {
+        GLStats::instance().frame.uniform_updates++;
         glUniform2fv(glGetUniformLocation(id, name), 1, &vec[0]);
 }
 
 void Shader::set_uniform(const char *name, float x, float y, float z) const {
+        GLStats::instance().frame.uniform_updates++;
         glUniform3f(glGetUniformLocation(id, name), x, y, z);
 }
 
 void Shader::set_uniform(const char *name, glm::vec3 &vec) const {
+        GLStats::instance().frame.uniform_updates++;
         glUniform3fv(glGetUniformLocation(id, name), 1, &vec[0]);
 }
 
 
 void Shader::set_uniform(const char *name, glm::mat4 &mat) const {
+        GLStats::instance().frame.uniform_updates++;
         glUniformMatrix4fv(glGetUniformLocation(id, name), 1, GL_FALSE, &mat[0][0]);
 }
+
+void Shader::set_uniform(const char *name, const float *values,
+                         GLsizei count) const {
+        GLStats::instance().frame.uniform_updates++;
+        glUniform1fv(glGetUniformLocation(id, name), count, values);
+}
+
+void Shader::set_uniform(const char *name, const glm::vec4 *values,
+                         GLsizei count) const {
+        GLStats::instance().frame.uniform_updates++;
+        glUniform4fv(glGetUniformLocation(id, name), count, &values[0][0]);
+}
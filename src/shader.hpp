@@ -21,6 +21,10 @@ public:
 
         Shader(const char *vertex_path, const char *fragment_path);
         Shader(const char *vertex_path, const char *fragment_path, const char *geometry_path);
+        /* No fragment stage, the outputs named in varyings are captured
+         * interleaved with transform feedback */
+        Shader(const char *vertex_path, const char *geometry_path,
+               const char *const *varyings, GLsizei varying_count);
 
         void use();
 
@@ -32,6 +36,10 @@ public:
         void set_uniform(const char *name, float x, float y, float z) const;
         void set_uniform(const char *name, glm::vec3 &vec) const;
         void set_uniform(const char *name, glm::mat4 &mat) const;
+        void set_uniform(const char *name, const float *values,
+                         GLsizei count) const;
+        void set_uniform(const char *name, const glm::vec4 *values,
+                         GLsizei count) const;
 private:
         std::string read_glsl_shader(const char *path);
         GLuint compile_shader(const char *shader_contents, ShaderType type);
@@ -0,0 +1,54 @@
+#version 330 core
+// The shared grid, in [0, 1] over a node
+layout (location = 0) in vec2 grid_pos;
+
+uniform sampler2D heightmap;
+uniform vec2 map_size;
+uniform float height_scale;
+// Quads per side of the grid, CDLOD_GRID
+uniform float grid_size;
+
+uniform vec2 node_offset;
+uniform float node_size;
+// Distances over which the node morphs into its parent's grid
+uniform vec2 morph_range;
+
+uniform vec3 camera_position;
+uniform mat4 view;
+uniform mat4 projection;
+
+out float height;
+out vec3 normal;
+
+// Normalized, texel centers sit on whole world units
+float height_at(vec2 xz) {
+        return textureLod(heightmap, (xz + 0.5) / map_size, 0.0).r;
+}
+
+void main () {
+        vec2 xz = node_offset + grid_pos * node_size;
+        vec3 position = vec3(xz.x, height_at(xz) * height_scale, xz.y);
+        float morph = 0.0;
+        if (morph_range.y > morph_range.x) {
+                morph = clamp((distance(position, camera_position) -
+                               morph_range.x) /
+                              (morph_range.y - morph_range.x), 0.0, 1.0);
+        }
+        // Odd vertices slide onto their even neighbour, which at full
+        // morph leaves the grid of the next level
+        vec2 odd = fract(grid_pos * grid_size * 0.5) * 2.0 / grid_size;
+        xz = node_offset + (grid_pos - odd * morph) * node_size;
+        height = height_at(xz);
+
+        // Central differences over the spacing of the node's vertices
+        float spacing = node_size / grid_size;
+        float left = height_at(xz - vec2(spacing, 0.0));
+        float right = height_at(xz + vec2(spacing, 0.0));
+        float down = height_at(xz - vec2(0.0, spacing));
+        float up = height_at(xz + vec2(0.0, spacing));
+        normal = vec3((left - right) * height_scale, 2.0 * spacing,
+                      (down - up) * height_scale);
+
+        gl_Position = projection * view *
+                      vec4(xz.x, height * height_scale, xz.y, 1.0);
+}
@@ -0,0 +1,59 @@
+#version 330 core
+// Vertex of the level grid, 0 to grid_size along each side
+layout (location = 0) in vec2 grid_pos;
+
+// One layer per level, wrapping around, see clipmap.hpp
+uniform sampler2DArray clipmaps;
+uniform float texels;
+uniform float grid_size;
+uniform int level;
+uniform int levels;
+// Level texel of the first vertex
+uniform vec2 origin;
+uniform float height_scale;
+
+uniform mat4 view;
+uniform mat4 projection;
+
+out float height;
+out vec3 normal;
+
+// Normalized height at a level texel, between texels when it isn't whole
+float height_at(vec2 texel, int layer) {
+        vec2 wrapped = mod(texel, texels) + 0.5;
+        return texture(clipmaps, vec3(wrapped / texels, layer)).r;
+}
+
+// Unnormalized, from central differences one texel of layer apart
+vec3 normal_at(vec2 texel, int layer) {
+        float left = height_at(texel - vec2(1.0, 0.0), layer);
+        float right = height_at(texel + vec2(1.0, 0.0), layer);
+        float down = height_at(texel - vec2(0.0, 1.0), layer);
+        float up = height_at(texel + vec2(0.0, 1.0), layer);
+        return vec3((left - right) * height_scale, 2.0 * exp2(float(layer)),
+                    (down - up) * height_scale);
+}
+
+void main () {
+        vec2 texel = origin + grid_pos;
+        height = height_at(texel, level);
+        normal = normalize(normal_at(texel, level));
+
+        // The outer tenth of the level fades into the next one, so its
+        // border vertices sit exactly on the coarser grid
+        float blend = grid_size / 10.0;
+        vec2 from_center = abs(grid_pos - grid_size * 0.5);
+        float alpha = clamp((max(from_center.x, from_center.y) -
+                             (grid_size * 0.5 - blend - 1.0)) / blend,
+                            0.0, 1.0);
+        if (level + 1 < levels && alpha > 0.0) {
+                vec2 coarse = texel * 0.5;
+                height = mix(height, height_at(coarse, level + 1), alpha);
+                normal = mix(normal, normalize(normal_at(coarse, level + 1)),
+                             alpha);
+        }
+
+        vec2 xz = texel * exp2(float(level));
+        gl_Position = projection * view *
+                      vec4(xz.x, height * height_scale, xz.y, 1.0);
+}
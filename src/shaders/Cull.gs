@@ -0,0 +1,17 @@
+#version 330 core
+// Passes on the points Cull.vs kept, transform feedback captures
+// visible_instance of each into the buffer of the level being culled
+layout (points) in;
+layout (points, max_vertices = 1) out;
+
+flat in uint instance[];
+flat in int keep[];
+
+flat out uint visible_instance;
+
+void main () {
+        if (keep[0] != 0) {
+                visible_instance = instance[0];
+                EmitVertex();
+        }
+}
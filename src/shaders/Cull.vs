@@ -0,0 +1,57 @@
+#version 330 core
+// One point per instance, no vertex attributes: the instance is gl_VertexID
+// and its transform comes from the same buffer texture as in Scatter.vs
+
+// Keep in sync with CULL_MAX_LODS
+const int MAX_LODS = 8;
+
+uniform samplerBuffer instance_transforms;
+// Left, right, bottom, top, near, far, normals facing inwards
+uniform vec4 planes[6];
+uniform vec3 camera_position;
+// Bounding sphere in model space, radius in w
+uniform vec4 bounds;
+uniform float viewport_height;
+// Pixels covered by one world unit at distance one
+uniform float pixel_scale;
+uniform float lod_errors[MAX_LODS];
+uniform int lod_count;
+uniform float max_pixel_error;
+// The level this pass writes out
+uniform int lod;
+
+flat out uint instance;
+flat out int keep;
+
+void main () {
+        int texel = gl_VertexID * 3;
+        vec4 row0 = texelFetch(instance_transforms, texel);
+        vec4 row1 = texelFetch(instance_transforms, texel + 1);
+        vec4 row2 = texelFetch(instance_transforms, texel + 2);
+        vec4 center = vec4(bounds.xyz, 1.0);
+        vec3 world = vec3(dot(row0, center), dot(row1, center),
+                          dot(row2, center));
+        // Uniform scale, the length of any column of the rotation
+        float scale = length(vec3(row0.x, row1.x, row2.x));
+        float radius = bounds.w * scale;
+
+        bool visible = true;
+        for (int i = 0; i < 6; i++) {
+                visible = visible &&
+                          dot(planes[i].xyz, world) + planes[i].w >= -radius;
+        }
+
+        // Same choice as Model::select_lod, errors are in model units
+        float distance = length(world - camera_position);
+        float pixels_per_unit = distance <= radius
+                ? viewport_height / (2.0 * bounds.w)
+                : scale * pixel_scale / distance;
+        int level = 0;
+        while (level + 1 < lod_count &&
+               lod_errors[level + 1] * pixels_per_unit <= max_pixel_error) {
+                level++;
+        }
+
+        instance = uint(gl_VertexID);
+        keep = visible && level == lod ? 1 : 0;
+}
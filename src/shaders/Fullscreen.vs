@@ -0,0 +1,9 @@
+#version 330 core
+out vec2 tex_coords;
+
+/* One triangle covering the screen, corners (0,0) (2,0) (0,2) in uv */
+void main () {
+        vec2 uv = vec2((gl_VertexID << 1) & 2, gl_VertexID & 2);
+        tex_coords = uv;
+        gl_Position = vec4(uv * 2.0 - 1.0, 0.0, 1.0);
+}
@@ -0,0 +1,20 @@
+#version 330 core
+in vec3 frag_normal;
+in vec2 tex_coords;
+
+uniform sampler2D texture_diffuse1;
+// Set when the model's diffuse textures are layers of one array
+uniform bool use_material_array;
+uniform sampler2DArray material_array;
+uniform float material_layer;
+uniform vec3 sun_dir;
+
+out vec4 frag_color;
+
+void main () {
+        float light = max(dot(normalize(frag_normal), normalize(sun_dir)), 0.0);
+        vec3 color = use_material_array
+                ? texture(material_array, vec3(tex_coords, material_layer)).rgb
+                : texture(texture_diffuse1, tex_coords).rgb;
+        frag_color = vec4(color * (0.3 + 0.7 * light), 1.0);
+}
@@ -0,0 +1,21 @@
+#version 330 core
+layout (location = 0) in vec3 pos;
+layout (location = 1) in vec3 normal;
+layout (location = 2) in vec2 tex_c;
+
+uniform mat4 model;
+uniform mat4 view;
+uniform mat4 projection;
+// Undoes position quantization, zero and one for float vertices
+uniform vec3 position_offset;
+uniform vec3 position_scale;
+
+out vec3 frag_normal;
+out vec2 tex_coords;
+
+void main () {
+        vec3 position = position_offset + pos * position_scale;
+        frag_normal = mat3(model) * normal;
+        tex_coords = tex_c;
+        gl_Position = projection * view * model * vec4(position, 1.0);
+}
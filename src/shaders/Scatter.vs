@@ -0,0 +1,35 @@
+#version 330 core
+layout (location = 0) in vec3 pos;
+layout (location = 1) in vec3 normal;
+layout (location = 2) in vec2 tex_c;
+// Index of the instance's transform, see InstanceBuffer
+layout (location = 3) in uint instance;
+
+// Three texels per instance, the rows of its model matrix
+uniform samplerBuffer instance_transforms;
+
+uniform mat4 view;
+uniform mat4 projection;
+// Undoes position quantization, zero and one for float vertices
+uniform vec3 position_offset;
+uniform vec3 position_scale;
+
+out vec3 frag_normal;
+out vec2 tex_coords;
+
+void main () {
+        int texel = int(instance) * 3;
+        vec4 model_row0 = texelFetch(instance_transforms, texel);
+        vec4 model_row1 = texelFetch(instance_transforms, texel + 1);
+        vec4 model_row2 = texelFetch(instance_transforms, texel + 2);
+        vec4 position = vec4(position_offset + pos * position_scale, 1.0);
+        vec3 world = vec3(dot(model_row0, position),
+                          dot(model_row1, position),
+                          dot(model_row2, position));
+        // Rotation and uniform scale only, normalized in Model.fs
+        mat3 rotation = transpose(mat3(model_row0.xyz, model_row1.xyz,
+                                       model_row2.xyz));
+        frag_normal = rotation * normal;
+        tex_coords = tex_c;
+        gl_Position = projection * view * vec4(world, 1.0);
+}
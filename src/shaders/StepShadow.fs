@@ -4,26 +4,36 @@ in vec2 tex_coords;
 uniform sampler2D perlin_map;
 uniform vec3 sun_dir;
 
-out vec4 FragColor;
+/* Filled from terrain_bands in terrain.cpp */
+const int MAX_TERRAIN_BANDS = 8;
+uniform int band_count;
+uniform float band_heights[MAX_TERRAIN_BANDS];
+uniform vec3 band_colors[MAX_TERRAIN_BANDS];
+
+uniform float shadow_brightness;
+uniform float steps;
 
+/* Viewshed bitmask, bit x % 32 of texel x / 32 is map texel x */
+uniform usampler2D viewshed;
+uniform bool show_viewshed;
 
-float shadow_brightness = 0.5;
-float steps = 200.0;
+out vec4 FragColor;
+
+vec3 terrain_color(float height) {
+        if (height <= band_heights[0]) {
+                return band_colors[0];
+        }
+        for (int i = 1; i < band_count - 1; i++) {
+                if (height < band_heights[i]) {
+                        return band_colors[i];
+                }
+        }
+        return band_colors[band_count - 1];
+}
 
 void main () {
         float height = texture(perlin_map, tex_coords).r;
-        vec3 color;
-        if (height == 0.0) {
-                color = vec3(0.18, 0.67, 0.84);
-        } else if (height < 0.1) {
-                color = vec3(0.95, 0.89, 0.64);
-        } else if (height < 0.3) {
-                color = vec3(0.33, .78, 0.33);
-        } else if (height < 0.5) {
-                color = vec3(0.09, 0.63, 0.08);
-        } else {
-                color = vec3(0.83,0.84, 0.81);
-        }
+        vec3 color = terrain_color(height);
 
         vec3 cur_pos = vec3(tex_coords.x, tex_coords.y, height);        
         vec3 step_dir = sun_dir/steps;
@@ -44,5 +54,15 @@ void main () {
                 }
         }
 
+        if (show_viewshed) {
+                ivec2 texel = ivec2(tex_coords *
+                                    vec2(textureSize(perlin_map, 0)));
+                uint word = texelFetch(viewshed,
+                                       ivec2(texel.x >> 5, texel.y), 0).r;
+                if (((word >> uint(texel.x & 31)) & 1u) == 0u) {
+                        color *= 0.35;
+                }
+        }
+
         FragColor = vec4(color, 1.0);
 }
\ No newline at end of file
@@ -0,0 +1,38 @@
+#version 330 core
+// Normalized height and an unnormalized world space normal
+in float height;
+in vec3 normal;
+
+// As StepShadow.fs takes it, pointing away from the sun in map space
+uniform vec3 sun_dir;
+
+/* Filled from terrain_bands in terrain.cpp */
+const int MAX_TERRAIN_BANDS = 8;
+uniform int band_count;
+uniform float band_heights[MAX_TERRAIN_BANDS];
+uniform vec3 band_colors[MAX_TERRAIN_BANDS];
+
+// Light of faces turned away from the sun
+uniform float shadow_brightness;
+
+out vec4 FragColor;
+
+vec3 terrain_color(float height) {
+        if (height <= band_heights[0]) {
+                return band_colors[0];
+        }
+        for (int i = 1; i < band_count - 1; i++) {
+                if (height < band_heights[i]) {
+                        return band_colors[i];
+                }
+        }
+        return band_colors[band_count - 1];
+}
+
+void main () {
+        // Map space is x, y along the rows and z up, world is x, y up, z
+        vec3 to_sun = normalize(-vec3(sun_dir.x, sun_dir.z, sun_dir.y));
+        float light = mix(shadow_brightness, 1.0,
+                          max(dot(normalize(normal), to_sun), 0.0));
+        FragColor = vec4(terrain_color(height) * light, 1.0);
+}
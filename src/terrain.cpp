@@ -0,0 +1,64 @@
+#include "terrain.hpp"
+#include "trace.hpp"
+
+const TerrainBand terrain_bands[] = {
+        {0.0f, {0.18f, 0.67f, 0.84f}}, // water
+        {0.1f, {0.95f, 0.89f, 0.64f}}, // sand
+        {0.3f, {0.33f, 0.78f, 0.33f}}, // grass
+        {0.5f, {0.09f, 0.63f, 0.08f}}, // forest
+        {1.0f, {0.83f, 0.84f, 0.81f}}, // snow
+};
+const int terrain_band_count = sizeof(terrain_bands) / sizeof(TerrainBand);
+
+static_assert(sizeof(terrain_bands) / sizeof(TerrainBand) <= MAX_TERRAIN_BANDS,
+              "StepShadow.fs only has room for MAX_TERRAIN_BANDS bands");
+
+glm::vec3 terrain_color(float height) {
+        if (height <= terrain_bands[0].max_height) {
+                return terrain_bands[0].color;
+        }
+        for (int i = 1; i < terrain_band_count - 1; i++) {
+                if (height < terrain_bands[i].max_height) {
+                        return terrain_bands[i].color;
+                }
+        }
+        return terrain_bands[terrain_band_count - 1].color;
+}
+
+void shade_map(const Heightmap &map, glm::vec3 sun_dir, unsigned char *rgb,
+               int out_width, int out_height) {
+        TRACE_FUNCTION();
+        glm::vec3 step_dir = sun_dir / SHADOW_STEPS;
+        for (int row = 0; row < out_height; row++) {
+                /* Texture v runs bottom up, image rows run top down */
+                float v = (out_height - 1 - row + 0.5f) / out_height;
+                for (int col = 0; col < out_width; col++) {
+                        float u = (col + 0.5f) / out_width;
+                        float height = map.sample(u, v);
+                        glm::vec3 color = terrain_color(height);
+
+                        glm::vec3 cur_pos{u, v, height};
+                        for (float i = 0.0f; i < SHADOW_STEPS; i++) {
+                                cur_pos -= step_dir;
+                                if (cur_pos.x < 0.0f || cur_pos.y < 0.0f) {
+                                        break;
+                                }
+                                float h = map.sample(cur_pos.x, cur_pos.y);
+                                if (h > cur_pos.z) {
+                                        color *= SHADOW_BRIGHTNESS;
+                                        break;
+                                }
+                                if (cur_pos.z > 1.0f) {
+                                        break;
+                                }
+                        }
+
+                        unsigned char *pixel =
+                                &rgb[(static_cast<size_t>(row) * out_width +
+                                      col) * 3];
+                        pixel[0] = color.r * 255.0f + 0.5f;
+                        pixel[1] = color.g * 255.0f + 0.5f;
+                        pixel[2] = color.b * 255.0f + 0.5f;
+                }
+        }
+}
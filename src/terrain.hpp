@@ -0,0 +1,42 @@
+#ifndef TERRAIN_H
+#define TERRAIN_H
+
+#include <glm/glm.hpp>
+
+#include "heightmap.hpp"
+
+/**
+ * Height bands used to color the map. A height at or below the first band
+ * is water, otherwise the first band whose max_height is above the height
+ * is used, and anything higher gets the last band's color.
+ *
+ * The table is uploaded to StepShadow.fs as uniforms, so the CPU shading
+ * below and the GPU path always agree.
+ */
+struct TerrainBand {
+        float max_height;
+        glm::vec3 color;
+};
+
+const int MAX_TERRAIN_BANDS = 8;
+extern const TerrainBand terrain_bands[];
+extern const int terrain_band_count;
+
+const float SHADOW_BRIGHTNESS = 0.5f;
+const float SHADOW_STEPS = 200.0f;
+
+/* The 3D terrain spans one world unit per texel, a normalized height of 1
+ * is this many units high */
+const float TERRAIN_HEIGHT_SCALE = 64.0f;
+
+glm::vec3 terrain_color(float height);
+
+/**
+ * CPU version of StepShadow.fs. Colors each pixel by height band and darkens
+ * it if a march towards the sun hits higher terrain. rgb receives
+ * out_width * out_height * 3 bytes, top row first.
+ */
+void shade_map(const Heightmap &map, glm::vec3 sun_dir, unsigned char *rgb,
+               int out_width, int out_height);
+
+#endif /* TERRAIN_H */
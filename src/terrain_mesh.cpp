@@ -0,0 +1,252 @@
+#include "terrain_mesh.hpp"
+#include "parallel_for.hpp"
+#include "terrain.hpp"
+#include "trace.hpp"
+
+#include <algorithm>
+#include <cmath>
+
+namespace {
+
+/* The map seen as a grid of vertices, clamped to the last row and column */
+struct RtinGrid {
+        const Heightmap &map;
+        int size;
+
+        float height(int x, int z) const {
+                return map.at(std::min(x, map.width - 1),
+                              std::min(z, map.height - 1));
+        }
+
+        /* Largest distance between the plane of triangle a, b, c and the
+         * vertices on or inside it */
+        float deviation(glm::ivec2 a, glm::ivec2 b, glm::ivec2 c) const {
+                glm::ivec2 lo = glm::min(glm::min(a, b), c);
+                glm::ivec2 hi = glm::max(glm::max(a, b), c);
+                glm::ivec2 u = b - a, v = c - a;
+                int area = u.x * v.y - u.y * v.x;
+                int sign = area < 0 ? -1 : 1;
+                area *= sign;
+                float ha = height(a.x, a.y);
+                float du = (height(b.x, b.y) - ha) / area;
+                float dv = (height(c.x, c.y) - ha) / area;
+                float worst = 0.0f;
+                for (int z = lo.y; z <= hi.y; z++) {
+                        for (int x = lo.x; x <= hi.x; x++) {
+                                /* Barycentric weights of b and c times
+                                 * twice the area */
+                                glm::ivec2 w{x - a.x, z - a.y};
+                                int wb = sign * (w.x * v.y - w.y * v.x);
+                                int wc = sign * (u.x * w.y - u.y * w.x);
+                                if (wb < 0 || wc < 0 || wb + wc > area) {
+                                        continue;
+                                }
+                                float plane = ha + du * wb + dv * wc;
+                                worst = std::max(
+                                        worst,
+                                        std::abs(height(x, z) - plane));
+                        }
+                }
+                return worst;
+        }
+};
+
+} // namespace
+
+int rtin_grid_size(const Heightmap &map) {
+        int n = 2;
+        while (n < std::max(map.width, map.height) - 1) {
+                n *= 2;
+        }
+        return n + 1;
+}
+
+std::vector<float> rtin_errors(const Heightmap &map, int threads) {
+        TRACE_FUNCTION();
+        RtinGrid grid{map, rtin_grid_size(map)};
+        const int n = grid.size - 1;
+        std::vector<float> errors(static_cast<size_t>(grid.size) * grid.size,
+                                  0.0f);
+        auto error = [&](int x, int z) -> float & {
+                return errors[static_cast<size_t>(z) * grid.size + x];
+        };
+
+        for (int s = 2; s <= n; s *= 2) {
+                const int h = s / 2, q = s / 4;
+                /* Edge midpoints of squares of size s. The triangles on the
+                 * edge have their right angle at the centre of the squares
+                 * either side, and split into ones on the diagonals of the
+                 * four squares of size h around the midpoint. */
+                auto edge = [&](glm::ivec2 m, glm::ivec2 half) {
+                        glm::ivec2 side{half.y, half.x};
+                        float e = 0.0f;
+                        if (m.x - side.x >= 0 && m.y - side.y >= 0) {
+                                e = grid.deviation(m - half, m + half,
+                                                   m - side);
+                        }
+                        if (m.x + side.x <= n && m.y + side.y <= n) {
+                                e = std::max(e, grid.deviation(m - half,
+                                                               m + half,
+                                                               m + side));
+                        }
+                        if (q > 0) {
+                                for (int dz = -q; dz <= q; dz += 2 * q) {
+                                        for (int dx = -q; dx <= q;
+                                             dx += 2 * q) {
+                                                int cx = m.x + dx;
+                                                int cz = m.y + dz;
+                                                if (cx > 0 && cz > 0 &&
+                                                    cx < n && cz < n) {
+                                                        e = std::max(
+                                                                e,
+                                                                error(cx, cz));
+                                                }
+                                        }
+                                }
+                        }
+                        error(m.x, m.y) = e;
+                };
+                /* Rows of edges along x alternate with rows along z */
+                parallel_for(n / h + 1, threads, [&](int row, int) {
+                        TRACE_SCOPE("rtin_edges");
+                        int z = row * h;
+                        if (row % 2 == 0) {
+                                for (int x = h; x < n; x += s) {
+                                        edge({x, z}, {h, 0});
+                                }
+                        } else {
+                                for (int x = 0; x <= n; x += s) {
+                                        edge({x, z}, {0, h});
+                                }
+                        }
+                });
+
+                /* Centres of squares of size s. The diagonal goes through
+                 * the centre of the square of size 2s around it, which
+                 * flips with the parity of the square, and the triangles
+                 * on it split into ones on the square's edges. */
+                parallel_for(n / s, threads, [&](int j, int) {
+                        TRACE_SCOPE("rtin_centres");
+                        int z = j * s + h;
+                        for (int i = 0; i < n / s; i++) {
+                                int x = i * s + h;
+                                int flip = (i + j) % 2 ? -1 : 1;
+                                glm::ivec2 m{x, z};
+                                glm::ivec2 half{h * flip, h};
+                                glm::ivec2 other{h * flip, -h};
+                                float e = std::max(
+                                        grid.deviation(m - half, m + half,
+                                                       m + other),
+                                        grid.deviation(m - half, m + half,
+                                                       m - other));
+                                e = std::max({e, error(x - h, z),
+                                              error(x + h, z), error(x, z - h),
+                                              error(x, z + h)});
+                                error(x, z) = e;
+                        }
+                });
+        }
+        return errors;
+}
+
+namespace {
+
+/* Cuts one tile out of the error grid */
+struct TileBuilder {
+        const RtinGrid &grid;
+        const std::vector<float> &errors;
+        float max_error;
+        TerrainMeshTile &tile;
+        int tile_size;
+        /* Tile vertex index of each grid vertex in the tile, -1 if unused */
+        std::vector<int> vertex_of;
+
+        unsigned int vertex(int x, int z) {
+                int &index = vertex_of[(z - tile.z) * (tile_size + 1) +
+                                       x - tile.x];
+                if (index < 0) {
+                        const float scale = TERRAIN_HEIGHT_SCALE / 255.0f;
+                        const Heightmap &map = grid.map;
+                        /* Central differences, one sided at the edges */
+                        int x0 = std::max(x - 1, 0);
+                        int x1 = std::min(x + 1, grid.size - 1);
+                        int z0 = std::max(z - 1, 0);
+                        int z1 = std::min(z + 1, grid.size - 1);
+                        glm::vec3 normal = glm::normalize(glm::vec3(
+                                (grid.height(x0, z) - grid.height(x1, z)) *
+                                        scale / (x1 - x0),
+                                1.0f,
+                                (grid.height(x, z0) - grid.height(x, z1)) *
+                                        scale / (z1 - z0)));
+                        index = static_cast<int>(tile.vertices.size());
+                        tile.vertices.push_back(
+                                {{static_cast<float>(x),
+                                  grid.height(x, z) * scale,
+                                  static_cast<float>(z)},
+                                 normal,
+                                 {(x + 0.5f) / map.width,
+                                  (z + 0.5f) / map.height}});
+                }
+                return static_cast<unsigned int>(index);
+        }
+
+        /* a and b end the hypotenuse, c is the right angle */
+        void triangle(glm::ivec2 a, glm::ivec2 b, glm::ivec2 c) {
+                glm::ivec2 m = (a + b) / 2;
+                glm::ivec2 leg = glm::abs(a - c);
+                if (leg.x + leg.y > 1 &&
+                    errors[static_cast<size_t>(m.y) * grid.size + m.x] >
+                            max_error) {
+                        triangle(c, a, m);
+                        triangle(b, c, m);
+                        return;
+                }
+                /* Counter clockwise seen from +y, looking down on x and z */
+                glm::ivec2 u = b - a, v = c - a;
+                if (u.y * v.x - u.x * v.y < 0) {
+                        std::swap(b, c);
+                }
+                tile.indices.push_back(vertex(a.x, a.y));
+                tile.indices.push_back(vertex(b.x, b.y));
+                tile.indices.push_back(vertex(c.x, c.y));
+        }
+};
+
+} // namespace
+
+std::vector<TerrainMeshTile>
+build_terrain_mesh(const Heightmap &map, const TerrainMeshSettings &settings) {
+        TRACE_FUNCTION();
+        std::vector<float> errors = rtin_errors(map, settings.threads);
+        RtinGrid grid{map, rtin_grid_size(map)};
+        const int n = grid.size - 1;
+        const int size = std::min(settings.tile_size, n);
+        const int tiles_x = (map.width + size - 2) / size;
+        const int tiles_z = (map.height + size - 2) / size;
+        const float max_error =
+                settings.max_error * 255.0f / TERRAIN_HEIGHT_SCALE;
+
+        std::vector<TerrainMeshTile> tiles(static_cast<size_t>(tiles_x) *
+                                           tiles_z);
+        parallel_for(tiles.size(), settings.threads, [&](int i, int) {
+                TRACE_SCOPE("terrain_mesh_tile");
+                TerrainMeshTile &tile = tiles[i];
+                tile.x = i % tiles_x * size;
+                tile.z = i / tiles_x * size;
+                TileBuilder builder{grid, errors, max_error, tile, size,
+                                    std::vector<int>((size + 1) * (size + 1),
+                                                     -1)};
+                glm::ivec2 lo{tile.x, tile.z}, hi = lo + size;
+                /* Same diagonal as the pass of the centres */
+                if ((tile.x / size + tile.z / size) % 2 == 0) {
+                        builder.triangle(lo, hi, {hi.x, lo.y});
+                        builder.triangle(hi, lo, {lo.x, hi.y});
+                } else {
+                        builder.triangle({hi.x, lo.y}, {lo.x, hi.y}, lo);
+                        builder.triangle({lo.x, hi.y}, {hi.x, lo.y}, hi);
+                }
+                optimize_vertex_cache(tile.indices, tile.vertices.size());
+                optimize_vertex_fetch(tile.vertices, tile.indices);
+        });
+        return tiles;
+}
@@ -0,0 +1,71 @@
+#ifndef TERRAIN_MESH_H
+#define TERRAIN_MESH_H
+
+#include <vector>
+
+#include "heightmap.hpp"
+#include "meshopt.hpp"
+
+/**
+ * Static terrain meshes that follow the heightmap to within a vertical
+ * error, with large triangles where the ground is flat.
+ *
+ * The triangulation is a right-triangulated irregular network (RTIN): the
+ * map is treated as a grid of n + 1 vertices a side, n a power of two
+ * covering the map, and triangles are split in half across their
+ * hypotenuse. Every split adds the hypotenuse midpoint, so a midpoint's
+ * error is the largest of how far the map strays from the two triangles on
+ * that hypotenuse, over every texel they cover, and of the errors of the
+ * midpoints below it. Splitting wherever that error is over the limit
+ * keeps every texel within it and, since both triangles on a hypotenuse
+ * look at the same midpoint, leaves no T-junctions. Measuring whole
+ * triangles rather than only the midpoint costs a pass over the map per
+ * level, but the bound holds everywhere instead of only at vertices.
+ *
+ * Midpoints come in passes, from the edges of 2 texel squares up to the
+ * centre of the map, and each pass only reads the one before, so a pass
+ * runs in parallel over its rows. The mesh is then cut out tile by tile,
+ * also in parallel. Every split above tile size is taken, so each tile is
+ * at least two triangles, and tiles agree on their shared edges because
+ * they read the same errors.
+ *
+ * Each tile is a vertex and index list ready for Mesh, in terrain world
+ * units as in scatter.hpp, with its triangles in vertex cache order and
+ * wound counter clockwise seen from above. Texture coordinates are texel
+ * centres over the map, the way the heightmap texture is sampled.
+ */
+
+const int TERRAIN_MESH_TILE = 64;
+
+struct TerrainMeshSettings {
+        /* Largest height difference to the map, in world units. A step
+         * of the 8 bit map is TERRAIN_HEIGHT_SCALE / 255. */
+        float max_error{0.5f};
+        /* Power of two, in texels */
+        int tile_size{TERRAIN_MESH_TILE};
+        /* 0 uses every core */
+        int threads{0};
+};
+
+struct TerrainMeshTile {
+        /* Corner with the lowest x and z, in world units */
+        int x;
+        int z;
+        VertexList vertices;
+        IndexList indices;
+};
+
+/**
+ * RTIN errors of every grid vertex, in 8 bit height steps, row major with
+ * rtin_grid_size(map) vertices a row. Vertices past the map edge repeat
+ * the last row and column.
+ */
+int rtin_grid_size(const Heightmap &map);
+std::vector<float> rtin_errors(const Heightmap &map, int threads = 0);
+
+/* Tiles covering the map, skipping those that start past its edge */
+std::vector<TerrainMeshTile>
+build_terrain_mesh(const Heightmap &map,
+                   const TerrainMeshSettings &settings = {});
+
+#endif /* TERRAIN_MESH_H */
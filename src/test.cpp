@@ -1,6 +1,33 @@
+#include <algorithm>
+#include <array>
+#include <chrono>
+#include <cmath>
+#include <filesystem>
+#include <fstream>
 #include <iostream>
+#include <map>
+#include <memory_resource>
+#include <new>
+#include <random>
 
+#include <glm/gtc/matrix_transform.hpp>
+
+#include "cdlod.hpp"
+#include "clipmap.hpp"
+#include "frustum.hpp"
+#include "height_query.hpp"
+#include "height_source.hpp"
+#include "heightmap.hpp"
+#include "material_layers.hpp"
+#include "meshopt.hpp"
 #include "noise.hpp"
+#include "quantize.hpp"
+#include "scatter.hpp"
+#include "terrain.hpp"
+#include "terrain_mesh.hpp"
+#include "texture_bake.hpp"
+#include "tiled_heightmap.hpp"
+#include "viewshed.hpp"
 
 int test_perlin_noise() {
         perlin p{};
@@ -24,7 +51,1031 @@ int test_perlin_noise() {
         return 0;
 }
 
+int test_heightmap_seed() {
+        Heightmap a = create_heightmap(256, 256, 42);
+        Heightmap b = create_heightmap(256, 256, 42);
+        Heightmap c = create_heightmap(256, 256, 43);
+        if (a.data != b.data) {
+                std::cout << "Same seed produced different heightmaps\n";
+                return 1;
+        }
+        if (a.data == c.data) {
+                std::cout << "Different seeds produced the same heightmap\n";
+                return 1;
+        }
+        if (a.at(0, 0) != 0) {
+                std::cout << "Island falloff left land in the corner\n";
+                return 1;
+        }
+
+        std::vector<unsigned char> rgb(64 * 64 * 3);
+        shade_map(a, glm::normalize(glm::vec3{1.0, 0.0, -1.0}), rgb.data(),
+                  64, 64);
+        glm::vec3 water = terrain_color(0.0f) * 255.0f + 0.5f;
+        if (rgb[0] != (unsigned char)water.r) {
+                std::cout << "Corner of the shaded map is not water\n";
+                return 1;
+        }
+        return 0;
+}
+
+/* Unwelded grid with shuffled triangles, the worst case for the cache. The
+ * arena has no upstream, so any allocation outside it throws. */
+int test_mesh_optimization() {
+        const int n = 64;
+        std::vector<unsigned char> buffer(16 << 20);
+        std::pmr::monotonic_buffer_resource arena{
+                buffer.data(), buffer.size(), std::pmr::null_memory_resource()};
+        VertexList vertices{&arena};
+        std::vector<unsigned int> triangles;
+        for (int y = 0; y < n; y++) {
+                for (int x = 0; x < n; x++) {
+                        glm::vec3 corners[4] = {{x, y, 0}, {x + 1, y, 0},
+                                                {x, y + 1, 0},
+                                                {x + 1, y + 1, 0}};
+                        int quad[6] = {0, 1, 2, 2, 1, 3};
+                        for (int i : quad) {
+                                triangles.push_back(vertices.size());
+                                vertices.push_back({corners[i], {0, 0, 1},
+                                                    {corners[i].x / n,
+                                                     corners[i].y / n}});
+                        }
+                }
+        }
+        std::vector<unsigned int> order(triangles.size() / 3);
+        for (size_t i = 0; i < order.size(); i++) {
+                order[i] = i;
+        }
+        std::shuffle(order.begin(), order.end(), std::mt19937{1});
+        IndexList indices{&arena};
+        indices.reserve(triangles.size());
+        for (unsigned int t : order) {
+                indices.insert(indices.end(), &triangles[t * 3],
+                               &triangles[t * 3 + 3]);
+        }
+
+        MeshOptStats stats;
+        try {
+                stats = optimize_mesh(vertices, indices);
+        } catch (const std::bad_alloc &) {
+                std::cout << "Mesh optimization allocated outside its arena\n";
+                return 1;
+        }
+        std::cout << "Mesh optimization: " << stats.vertices_before << " -> "
+                  << stats.vertices_after << " vertices, ACMR "
+                  << stats.acmr_before << " -> " << stats.acmr_after << "\n";
+        if (stats.vertices_after != (n + 1) * (n + 1)) {
+                std::cout << "Welding left duplicate vertices\n";
+                return 1;
+        }
+        if (indices.size() != order.size() * 3 || stats.acmr_after > 1.0f) {
+                std::cout << "Vertex cache optimization failed\n";
+                return 1;
+        }
+        return 0;
+}
+
+/* A closed sphere has no jumps in its walk, its clusters have to come
+ * from the cache and the overdraw sort has to move them */
+int test_overdraw_clusters() {
+        const int rings = 64, segments = 128;
+        VertexList vertices;
+        IndexList indices;
+        for (int r = 0; r <= rings; r++) {
+                for (int s = 0; s <= segments; s++) {
+                        float theta = 3.14159265f * r / rings;
+                        float phi = 2.0f * 3.14159265f * s / segments;
+                        glm::vec3 p(std::sin(theta) * std::cos(phi),
+                                    std::cos(theta),
+                                    std::sin(theta) * std::sin(phi));
+                        vertices.push_back({p, p, {0.0f, 0.0f}});
+                }
+        }
+        for (int r = 0; r < rings; r++) {
+                for (int s = 0; s < segments; s++) {
+                        unsigned int a = r * (segments + 1) + s;
+                        unsigned int b = a + segments + 1;
+                        for (unsigned int i : {a, b, a + 1, a + 1, b, b + 1}) {
+                                indices.push_back(i);
+                        }
+                }
+        }
+        auto sorted_triangles = [](const IndexList &list) {
+                std::vector<std::array<unsigned int, 3>> triangles;
+                for (size_t i = 0; i < list.size(); i += 3) {
+                        std::array<unsigned int, 3> t{list[i], list[i + 1],
+                                                      list[i + 2]};
+                        std::rotate(t.begin(),
+                                    std::min_element(t.begin(), t.end()),
+                                    t.end());
+                        triangles.push_back(t);
+                }
+                std::sort(triangles.begin(), triangles.end());
+                return triangles;
+        };
+        auto expected = sorted_triangles(indices);
+
+        std::pmr::vector<size_t> clusters =
+                optimize_vertex_cache(indices, vertices.size());
+        IndexList tipsified = indices;
+        optimize_overdraw(vertices, indices, clusters);
+        float acmr = compute_acmr(indices, vertices.size());
+        std::cout << "Overdraw clusters: " << clusters.size() << " for "
+                  << indices.size() / 3 << " triangles, ACMR " << acmr
+                  << "\n";
+        if (clusters.size() < 2 || indices == tipsified) {
+                std::cout << "Overdraw optimization left the sphere alone\n";
+                return 1;
+        }
+        if (sorted_triangles(indices) != expected || acmr > 1.0f) {
+                std::cout << "Overdraw optimization broke the sphere\n";
+                return 1;
+        }
+        return 0;
+}
+
+/* Shared textures get one layer, a missing or mismatched one fails */
+int test_material_layers() {
+        struct Image {
+                int width;
+                int height;
+        };
+        auto same_size = [](const Image &a, const Image &b) {
+                return a.width == b.width && a.height == b.height;
+        };
+        Image a{256, 256}, b{256, 256}, small{64, 64};
+        std::vector<const Image *> layers;
+        std::vector<int> mesh_layers;
+        bool shared = assign_material_layers<Image>({&a, &b, &a, &b, &a},
+                                                    same_size, layers,
+                                                    mesh_layers);
+        if (!shared || layers != std::vector<const Image *>{&a, &b} ||
+            mesh_layers != std::vector<int>{0, 1, 0, 1, 0}) {
+                std::cout << "Material layers not shared\n";
+                return 1;
+        }
+        if (assign_material_layers<Image>({&a, NULL}, same_size, layers,
+                                          mesh_layers) ||
+            assign_material_layers<Image>({&a, &small}, same_size, layers,
+                                          mesh_layers) ||
+            assign_material_layers<Image>({}, same_size, layers,
+                                          mesh_layers)) {
+                std::cout << "Material layers accepted unusable textures\n";
+                return 1;
+        }
+        return 0;
+}
+
+/* Rolling hills as a welded grid, each level has to shrink and stay close */
+int test_lod_chain() {
+        const int n = 64;
+        VertexList vertices;
+        IndexList indices;
+        for (int y = 0; y <= n; y++) {
+                for (int x = 0; x <= n; x++) {
+                        float height = std::sin(x * 0.2f) * std::cos(y * 0.15f);
+                        vertices.push_back({{x, y, height}, {0, 0, 1},
+                                            {float(x) / n, float(y) / n}});
+                }
+        }
+        for (int y = 0; y < n; y++) {
+                for (int x = 0; x < n; x++) {
+                        unsigned int i = y * (n + 1) + x;
+                        unsigned int quad[6] = {i, i + 1, i + n + 1,
+                                                i + n + 1, i + 1, i + n + 2};
+                        indices.insert(indices.end(), quad, quad + 6);
+                }
+        }
+        std::vector<LodLevel> levels = build_lod_chain(vertices, indices);
+
+        std::cout << "LOD chain:";
+        for (const LodLevel &level : levels) {
+                std::cout << " " << level.index_count / 3 << " ("
+                          << level.error << ")";
+        }
+        std::cout << "\n";
+        if (levels.size() < 3) {
+                std::cout << "LOD chain too short\n";
+                return 1;
+        }
+        for (size_t i = 1; i < levels.size(); i++) {
+                if (levels[i].index_count > levels[i - 1].index_count * 3 / 4 ||
+                    levels[i].error < levels[i - 1].error ||
+                    levels[i].error > 1.0f) {
+                        std::cout << "LOD level " << i << " is wrong\n";
+                        return 1;
+                }
+        }
+        for (unsigned int index : indices) {
+                if (index >= vertices.size()) {
+                        std::cout << "LOD index out of range\n";
+                        return 1;
+                }
+        }
+        return 0;
+}
+
+/* Packed vertices have to stay within one step of the 16 bit grid */
+int test_vertex_quantization() {
+        std::mt19937 rng{2};
+        std::uniform_real_distribution<float> unit{-1.0f, 1.0f};
+        std::vector<Vertex> vertices(1000);
+        glm::vec3 min{INFINITY}, max{-INFINITY};
+        for (Vertex &v : vertices) {
+                v.position = {unit(rng) * 50.0f, unit(rng) * 2.0f, unit(rng)};
+                v.normal = glm::normalize(
+                        glm::vec3{unit(rng), unit(rng), unit(rng)} + 0.01f);
+                v.tex_coords = {unit(rng) * 0.5f + 0.5f, unit(rng) * 0.5f + 0.5f};
+        }
+        expand_bounds(vertices.data(), vertices.size(), min, max);
+        VertexQuantization quantization = quantization_for_bounds(min, max);
+        QuantizationError error;
+        measure_quantization_error(vertices.data(), vertices.size(),
+                                   quantization, error);
+        std::cout << "Vertex quantization: " << sizeof(Vertex) << " -> "
+                  << sizeof(PackedVertex) << " bytes, position error "
+                  << error.position << ", normal error " << error.normal
+                  << " degrees, texture coordinate error " << error.tex_coord
+                  << "\n";
+        if (sizeof(PackedVertex) * 2 != sizeof(Vertex) ||
+            error.position > glm::length(max - min) / 65535.0f ||
+            error.normal > 0.25f || error.tex_coord > 0.001f) {
+                std::cout << "Vertex quantization error too large\n";
+                return 1;
+        }
+        return 0;
+}
+
+/* Smooth gradients should survive every format, and the baked file has to
+ * round trip until its source changes */
+int test_texture_compression() {
+        const int width = 64, height = 48;
+        std::vector<unsigned char> pixels(width * height * 4);
+        for (int y = 0; y < height; y++) {
+                for (int x = 0; x < width; x++) {
+                        unsigned char *p = &pixels[(y * width + x) * 4];
+                        p[0] = x * 4;
+                        p[1] = y * 5;
+                        p[2] = (x + y) * 2;
+                        p[3] = 255 - x * 2;
+                }
+        }
+
+        for (int channels = 1; channels <= 4; channels++) {
+                std::vector<unsigned char> image(width * height * channels);
+                for (int i = 0; i < width * height; i++) {
+                        for (int c = 0; c < channels; c++) {
+                                image[i * channels + c] = pixels[i * 4 + c];
+                        }
+                }
+                CompressedTexture texture =
+                        compress_texture(image.data(), width, height, channels);
+
+                double error = 0.0;
+                const CompressedLevel &level = texture.levels[0];
+                size_t size = block_size(texture.format);
+                for (size_t b = 0; b < level.data.size() / size; b++) {
+                        unsigned char rgba[64];
+                        decode_block(texture.format, &level.data[b * size],
+                                     rgba);
+                        int bx = b % (width / 4), by = b / (width / 4);
+                        for (int i = 0; i < 16; i++) {
+                                int x = bx * 4 + i % 4, y = by * 4 + i / 4;
+                                for (int c = 0; c < channels; c++) {
+                                        int channel = channels == 4 || c < 3
+                                                              ? c
+                                                              : 3;
+                                        double d = rgba[i * 4 + channel] -
+                                                   image[(y * width + x) *
+                                                                 channels +
+                                                         c];
+                                        error += d * d;
+                                }
+                        }
+                }
+                error = std::sqrt(error / (width * height * channels));
+                std::cout << "Texture compression, " << channels
+                          << " channels: " << texture.levels.size()
+                          << " levels, RMS error " << error << "\n";
+                if (texture.levels.size() != 7 ||
+                    texture.levels.back().width != 1 || error > 4.0) {
+                        std::cout << "Texture compression failed\n";
+                        return 1;
+                }
+        }
+
+        std::string source = (std::filesystem::temp_directory_path() /
+                              "mapsim_test_texture.png")
+                                     .string();
+        { std::ofstream{source} << "source"; }
+        CompressedTexture texture =
+                compress_texture(pixels.data(), width, height, 4);
+        CompressedTexture read, stale;
+        bool round_trip = write_ktx(source, texture) && read_ktx(source, read) &&
+                          read.format == texture.format &&
+                          read.levels.size() == texture.levels.size() &&
+                          read.levels[3].data == texture.levels[3].data &&
+                          !std::filesystem::exists(baked_texture_path(source) +
+                                                   ".tmp");
+
+        /* A driver without S3TC decodes the source of a BC1 file instead,
+         * the file stays for drivers that have it */
+        std::vector<unsigned char> rgb(width * height * 3, 100);
+        CompressedTexture bc1 = compress_texture(rgb.data(), width, height, 3);
+        CompressedTexture without_s3tc, with_s3tc;
+        bool s3tc_skipped =
+                bc1.format == BlockFormat::BC1 && write_ktx(source, bc1) &&
+                !read_baked_texture(source, false, without_s3tc) &&
+                without_s3tc.levels.empty() &&
+                read_baked_texture(source, true, with_s3tc) &&
+                with_s3tc.format == BlockFormat::BC1;
+
+        { std::ofstream{source} << "changed source"; }
+        bool rebuilt = !read_ktx(source, stale);
+        std::filesystem::remove(source);
+        std::filesystem::remove(baked_texture_path(source));
+        if (!round_trip || !rebuilt) {
+                std::cout << "Baked texture cache failed\n";
+                return 1;
+        }
+        if (!s3tc_skipped) {
+                std::cout << "Baked S3TC texture used without S3TC\n";
+                return 1;
+        }
+        return 0;
+}
+
+/* Points must keep their distance and not depend on the thread count,
+ * instances must respect the filters */
+int test_scatter() {
+        const float r = 3.0f;
+        std::vector<glm::vec2> serial = poisson_disk(300.0f, 200.0f, r, 7, 1);
+        std::vector<glm::vec2> parallel = poisson_disk(300.0f, 200.0f, r, 7, 8);
+        if (serial != parallel) {
+                std::cout << "Poisson disk depends on the thread count\n";
+                return 1;
+        }
+        for (size_t i = 0; i < serial.size(); i++) {
+                for (size_t j = i + 1; j < serial.size(); j++) {
+                        if (glm::distance(serial[i], serial[j]) < r) {
+                                std::cout << "Poisson disk points too close\n";
+                                return 1;
+                        }
+                }
+        }
+        /* Tight packing is about 0.8 / r^2, pure dart throwing gets far less */
+        float density = serial.size() * r * r / (300.0f * 200.0f);
+        if (density < 0.6f) {
+                std::cout << "Poisson disk density too low: " << density
+                          << "\n";
+                return 1;
+        }
+
+        Heightmap map = create_heightmap(1024, 1024, 42);
+        ScatterSettings settings;
+        settings.min_distance = 2.5f;
+        settings.seed = 3;
+        auto start = std::chrono::steady_clock::now();
+        std::vector<ScatterInstance> instances =
+                scatter_instances(map, settings);
+        float ms = std::chrono::duration<float, std::milli>(
+                           std::chrono::steady_clock::now() - start)
+                           .count();
+        std::cout << "Scatter: " << instances.size()
+                  << " instances on 1024x1024 in " << ms << " ms\n";
+        if (instances.empty() || instances.size() > settings.max_instances) {
+                std::cout << "Scatter instance count out of range\n";
+                return 1;
+        }
+        for (const ScatterInstance &instance : instances) {
+                glm::vec3 p = instance.position;
+                float height = p.y / TERRAIN_HEIGHT_SCALE;
+                if (height < settings.min_height ||
+                    height > settings.max_height ||
+                    terrain_slope(map, p.x, p.z) > settings.max_slope ||
+                    instance.scale < settings.min_scale ||
+                    instance.scale > settings.max_scale) {
+                        std::cout << "Scatter instance breaks the filters\n";
+                        return 1;
+                }
+        }
+
+        settings.max_instances = 1000;
+        if (scatter_instances(map, settings).size() != 1000) {
+                std::cout << "Scatter ignores max_instances\n";
+                return 1;
+        }
+        return 0;
+}
+
+/* Camera at the origin looking down -z with a 90 degree field of view */
+int test_frustum() {
+        glm::mat4 projection = glm::perspective(glm::radians(90.0f), 1.0f,
+                                                1.0f, 100.0f);
+        glm::mat4 view = glm::lookAt(glm::vec3(0.0f), glm::vec3(0, 0, -1),
+                                     glm::vec3(0, 1, 0));
+        Frustum frustum{projection * view};
+        struct {
+                glm::vec3 center;
+                float radius;
+                bool visible;
+        } spheres[] = {
+                {{0, 0, -10}, 1, true},    /* straight ahead */
+                {{0, 0, 10}, 1, false},    /* behind */
+                {{12, 0, -10}, 1, false},  /* right of the 45 degree edge */
+                {{12, 0, -10}, 2, true},   /* reaching over it */
+                {{0, 0, -0.5f}, 0.4f, false}, /* before the near plane */
+                {{0, 0, -105}, 4, false},  /* past the far plane */
+                {{0, 0, -105}, 6, true},
+        };
+        for (const auto &sphere : spheres) {
+                if (frustum.intersects_sphere(sphere.center, sphere.radius) !=
+                    sphere.visible) {
+                        std::cout << "Frustum misjudges sphere at z "
+                                  << sphere.center.z << "\n";
+                        return 1;
+                }
+        }
+        /* Planes are normalized, the left one passes 45 degrees off axis */
+        float distance = glm::dot(glm::vec3(frustum.planes[0]),
+                                  glm::vec3(0, 0, -10)) +
+                         frustum.planes[0].w;
+        if (std::abs(distance - 10.0f / std::sqrt(2.0f)) > 1e-3f) {
+                std::cout << "Frustum planes not normalized: " << distance
+                          << "\n";
+                return 1;
+        }
+        if (!frustum.intersects_box(glm::vec3(-50, -1, -20),
+                                    glm::vec3(50, 1, -19)) ||
+            frustum.intersects_box(glm::vec3(-5, -5, 1), glm::vec3(5, 5, 5)) ||
+            frustum.intersects_box(glm::vec3(30, -1, -20),
+                                   glm::vec3(40, 1, -10))) {
+                std::cout << "Frustum misjudges boxes\n";
+                return 1;
+        }
+        return 0;
+}
+
+/* Triangles drawn for a selection, two per quad of every quarter */
+static size_t cdlod_triangles(const std::vector<CdlodNode> &selection) {
+        size_t quarters = 0;
+        for (const CdlodNode &node : selection) {
+                for (int i = 0; i < 4; i++) {
+                        quarters += (node.quarters >> i) & 1;
+                }
+        }
+        return quarters * (CDLOD_GRID / 2) * (CDLOD_GRID / 2) * 2;
+}
+
+/* The selection must cover the visible map once, with neighbours at most
+ * one level apart, and cost about the same on a much larger map */
+int test_cdlod() {
+        Heightmap map = create_heightmap(1024, 1024, 42);
+        CdlodQuadtree tree{map};
+        glm::vec3 camera{300.0f, 60.0f, 700.0f};
+        /* Looking straight down on everything */
+        Frustum everything{glm::ortho(-4000.0f, 4000.0f, -4000.0f, 4000.0f,
+                                      -4000.0f, 4000.0f) *
+                           glm::lookAt(camera, camera - glm::vec3(0, 1, 0),
+                                       glm::vec3(0, 0, -1))};
+        std::vector<CdlodNode> selection;
+        tree.select(camera, everything, selection);
+
+        /* Paints the level of every quarter leaf */
+        const int cell = CDLOD_LEAF_SIZE / 2, cells = 1024 / cell;
+        std::vector<int> level(cells * cells, -1);
+        for (const CdlodNode &node : selection) {
+                int half = node.size / 2 / cell;
+                for (int i = 0; i < 4; i++) {
+                        if (!(node.quarters & (1 << i))) {
+                                continue;
+                        }
+                        int x0 = node.x / cell + (i & 1) * half;
+                        int z0 = node.z / cell + (i >> 1) * half;
+                        for (int z = z0; z < z0 + half; z++) {
+                                for (int x = x0; x < x0 + half; x++) {
+                                        if (level[z * cells + x] != -1) {
+                                                std::cout << "CDLOD covers a "
+                                                             "leaf twice\n";
+                                                return 1;
+                                        }
+                                        level[z * cells + x] = node.level;
+                                }
+                        }
+                }
+        }
+        for (int z = 0; z < cells; z++) {
+                for (int x = 0; x < cells; x++) {
+                        int here = level[z * cells + x];
+                        if (here < 0) {
+                                std::cout << "CDLOD leaves a hole\n";
+                                return 1;
+                        }
+                        if ((x + 1 < cells &&
+                             std::abs(level[z * cells + x + 1] - here) > 1) ||
+                            (z + 1 < cells &&
+                             std::abs(level[(z + 1) * cells + x] - here) >
+                                     1)) {
+                                std::cout << "CDLOD neighbours skip a level\n";
+                                return 1;
+                        }
+                }
+        }
+
+        /* A flat map 16 times the area, seen from the same spot */
+        glm::mat4 view_projection =
+                glm::perspective(glm::radians(60.0f), 1.0f, 0.5f, 8000.0f) *
+                glm::lookAt(camera, camera + glm::vec3(0.3f, -0.3f, -1.0f),
+                            glm::vec3(0, 1, 0));
+        std::vector<CdlodNode> small, large;
+        tree.select(camera, Frustum{view_projection}, small);
+        CdlodQuadtree{Heightmap(4096, 4096)}.select(
+                camera, Frustum{view_projection}, large);
+        size_t small_triangles = cdlod_triangles(small);
+        size_t large_triangles = cdlod_triangles(large);
+        std::cout << "CDLOD: " << small_triangles << " triangles on 1024, "
+                  << large_triangles << " on 4096\n";
+        if (small_triangles == 0 || large_triangles > 2 * small_triangles) {
+                std::cout << "CDLOD triangle count grows with the map\n";
+                return 1;
+        }
+        return 0;
+}
+
+/* Sliding a window with toroidal updates must leave the texture holding
+ * exactly the window, and a small step must only read thin strips */
+int test_clipmap() {
+        Heightmap map = create_heightmap(1024, 1024, 42);
+        NoiseSource noise{1024, 1024, 42};
+        std::vector<unsigned char> row(1024);
+        noise.read(0, 0, 517, 1024, 1, row.data());
+        if (!std::equal(row.begin(), row.end(),
+                        map.data.begin() + 517 * 1024)) {
+                std::cout << "NoiseSource differs from create_heightmap\n";
+                return 1;
+        }
+
+        HeightmapSource source{map};
+        const int level = 2, size = CLIPMAP_TEXELS;
+        std::vector<unsigned char> texture(size * size);
+        std::vector<unsigned char> texels;
+        std::vector<TexelRect> rects, pieces;
+        glm::ivec2 window{0};
+        std::mt19937 rng{5};
+        for (int step = 0; step < 100; step++) {
+                /* Mostly flying, now and then a jump across the map */
+                glm::vec2 camera =
+                        step % 25 == 0
+                                ? glm::vec2(rng() % 1400, rng() % 1400) -
+                                          200.0f
+                                : glm::vec2(window + CLIPMAP_WINDOW / 2) *
+                                                  4.0f +
+                                          glm::vec2(rng() % 17, rng() % 17) -
+                                          8.0f;
+                glm::ivec2 next =
+                        clipmap_window(clipmap_origin(camera, level));
+                rects.clear();
+                pieces.clear();
+                if (step == 0) {
+                        rects.push_back({next.x, next.y, CLIPMAP_WINDOW,
+                                         CLIPMAP_WINDOW});
+                } else {
+                        exposed_rects(window, next, CLIPMAP_WINDOW, rects);
+                }
+                size_t read = 0;
+                for (const TexelRect &rect : rects) {
+                        toroidal_rects(rect, size, pieces);
+                }
+                for (const TexelRect &piece : pieces) {
+                        texels.resize(piece.width * piece.height);
+                        source.read(level, piece.x, piece.z, piece.width,
+                                    piece.height, texels.data());
+                        for (int z = 0; z < piece.height; z++) {
+                                for (int x = 0; x < piece.width; x++) {
+                                        texture[wrap_texel(piece.z + z, size) *
+                                                        size +
+                                                wrap_texel(piece.x + x,
+                                                           size)] =
+                                                texels[z * piece.width + x];
+                                }
+                        }
+                        read += texels.size();
+                }
+                glm::ivec2 moved = glm::abs(next - window);
+                if (step % 25 != 0 &&
+                    read > size_t(moved.x + moved.y) * CLIPMAP_WINDOW) {
+                        std::cout << "Clipmap reads more than the strips\n";
+                        return 1;
+                }
+                window = next;
+
+                texels.resize(CLIPMAP_WINDOW * CLIPMAP_WINDOW);
+                source.read(level, window.x, window.y, CLIPMAP_WINDOW,
+                            CLIPMAP_WINDOW, texels.data());
+                for (int z = 0; z < CLIPMAP_WINDOW; z++) {
+                        for (int x = 0; x < CLIPMAP_WINDOW; x++) {
+                                if (texture[wrap_texel(window.y + z, size) *
+                                                    size +
+                                            wrap_texel(window.x + x, size)] !=
+                                    texels[z * CLIPMAP_WINDOW + x]) {
+                                        std::cout << "Clipmap window is "
+                                                     "stale after step "
+                                                  << step << "\n";
+                                        return 1;
+                                }
+                        }
+                }
+        }
+        return 0;
+}
+
+int test_terrain_mesh() {
+        Heightmap map = create_heightmap(512, 512, 42);
+        TerrainMeshSettings settings;
+        auto start = std::chrono::steady_clock::now();
+        std::vector<TerrainMeshTile> tiles = build_terrain_mesh(map, settings);
+        auto ms = std::chrono::duration<double, std::milli>(
+                          std::chrono::steady_clock::now() - start)
+                          .count();
+
+        /* Twice the area of the map, and every edge on two triangles
+         * unless it lies on the border */
+        const int n = 512;
+        long long doubled_area = 0;
+        size_t triangles = 0;
+        std::map<std::pair<int, int>, int> edges;
+        float worst = 0.0f;
+        for (const TerrainMeshTile &tile : tiles) {
+                triangles += tile.indices.size() / 3;
+                for (size_t i = 0; i < tile.indices.size(); i += 3) {
+                        glm::vec3 p[3];
+                        int key[3];
+                        for (int k = 0; k < 3; k++) {
+                                p[k] = tile.vertices[tile.indices[i + k]]
+                                               .position;
+                                key[k] = static_cast<int>(p[k].z) * (n + 1) +
+                                         static_cast<int>(p[k].x);
+                        }
+                        for (int k = 0; k < 3; k++) {
+                                int a = key[k], b = key[(k + 1) % 3];
+                                edges[{std::min(a, b), std::max(a, b)}]++;
+                        }
+                        glm::vec2 u{p[1].x - p[0].x, p[1].z - p[0].z};
+                        glm::vec2 v{p[2].x - p[0].x, p[2].z - p[0].z};
+                        float cross = u.y * v.x - u.x * v.y;
+                        if (cross <= 0.0f) {
+                                std::cout << "Terrain mesh triangle faces "
+                                             "down\n";
+                                return 1;
+                        }
+                        doubled_area += static_cast<long long>(cross);
+
+                        /* Height of the mesh at every texel it covers */
+                        int x0 = std::min({p[0].x, p[1].x, p[2].x});
+                        int x1 = std::max({p[0].x, p[1].x, p[2].x});
+                        int z0 = std::min({p[0].z, p[1].z, p[2].z});
+                        int z1 = std::max({p[0].z, p[1].z, p[2].z});
+                        for (int z = z0; z <= z1; z++) {
+                                for (int x = x0; x <= x1; x++) {
+                                        glm::vec2 w{x - p[0].x, z - p[0].z};
+                                        float b1 = (w.y * v.x - w.x * v.y) /
+                                                   cross;
+                                        float b2 = (u.y * w.x - u.x * w.y) /
+                                                   cross;
+                                        if (b1 < 0 || b2 < 0 ||
+                                            b1 + b2 > 1) {
+                                                continue;
+                                        }
+                                        float mesh = p[0].y +
+                                                     b1 * (p[1].y - p[0].y) +
+                                                     b2 * (p[2].y - p[0].y);
+                                        float texel =
+                                                map.at(std::min(x, n - 1),
+                                                       std::min(z, n - 1)) *
+                                                TERRAIN_HEIGHT_SCALE / 255.0f;
+                                        worst = std::max(
+                                                worst,
+                                                std::abs(mesh - texel));
+                                }
+                        }
+                }
+        }
+        std::cout << "Terrain mesh: " << triangles << " triangles in "
+                  << tiles.size() << " tiles, "
+                  << 2.0 * n * n / triangles << "x fewer, max error "
+                  << worst << ", " << ms << " ms\n";
+        if (doubled_area != 2ll * n * n) {
+                std::cout << "Terrain mesh doesn't cover the map\n";
+                return 1;
+        }
+        for (const auto &[edge, count] : edges) {
+                int ax = edge.first % (n + 1), az = edge.first / (n + 1);
+                int bx = edge.second % (n + 1), bz = edge.second / (n + 1);
+                bool border = (ax == bx && (ax == 0 || ax == n)) ||
+                              (az == bz && (az == 0 || az == n));
+                if (count != (border ? 1 : 2)) {
+                        std::cout << "Terrain mesh has a crack at " << ax
+                                  << ", " << az << "\n";
+                        return 1;
+                }
+        }
+        if (worst > settings.max_error + 1e-4f) {
+                std::cout << "Terrain mesh strays from the map\n";
+                return 1;
+        }
+        if (triangles * 10 > 2ull * n * n) {
+                std::cout << "Terrain mesh saves too few triangles\n";
+                return 1;
+        }
+        return 0;
+}
+
+int test_height_query() {
+        Heightmap map = create_heightmap(1024, 1024, 42);
+        HeightQuery query{map};
+        std::mt19937 rng{7};
+        std::uniform_real_distribution<float> unit{0.0f, 1.0f};
+
+        for (int i = 0; i < 1000; i++) {
+                float x = unit(rng) * 1023.0f, z = unit(rng) * 1023.0f;
+                float expected = map.sample((x + 0.5f) / 1024.0f,
+                                            (z + 0.5f) / 1024.0f) *
+                                 TERRAIN_HEIGHT_SCALE;
+                if (std::abs(query.sample_height(x, z) - expected) > 1e-3f) {
+                        std::cout << "Height query samples " << x << ", "
+                                  << z << " wrong\n";
+                        return 1;
+                }
+
+                int x0 = rng() % 1000, z0 = rng() % 1000;
+                int x1 = x0 + rng() % 24, z1 = z0 + rng() % 24;
+                int lowest = 255, highest = 0;
+                for (int tz = z0; tz <= z1 + 1; tz++) {
+                        for (int tx = x0; tx <= x1 + 1; tx++) {
+                                lowest = std::min<int>(lowest, map.at(tx, tz));
+                                highest =
+                                        std::max<int>(highest, map.at(tx, tz));
+                        }
+                }
+                glm::vec2 range = query.height_range(
+                        glm::vec2(x0, z0), glm::vec2(x1 + 1, z1 + 1));
+                glm::vec2 error = glm::abs(range -
+                                           glm::vec2(lowest, highest) *
+                                                   TERRAIN_HEIGHT_SCALE /
+                                                   255.0f);
+                if (error.x > 1e-4f || error.y > 1e-4f) {
+                        std::cout << "Height query range is wrong\n";
+                        return 1;
+                }
+        }
+
+        /* Rays down onto the map against marching in small steps */
+        const float step = 0.05f;
+        auto random_ray = [&](float max_distance) {
+                glm::vec3 origin{unit(rng) * 1024.0f, 30.0f + unit(rng) * 60.0f,
+                                 unit(rng) * 1024.0f};
+                float angle = unit(rng) * 6.2831853f;
+                glm::vec3 direction = glm::normalize(
+                        glm::vec3(std::cos(angle), -0.05f - unit(rng) * 0.5f,
+                                  std::sin(angle)));
+                return TerrainRay{origin, direction, max_distance};
+        };
+        auto march = [&](const TerrainRay &ray, float &t) {
+                for (t = 0.0f; t <= ray.max_distance; t += step) {
+                        glm::vec3 p = ray.origin + ray.direction * t;
+                        if (p.x < 0 || p.z < 0 || p.x > 1024 || p.z > 1024) {
+                                return false;
+                        }
+                        if (p.y <= query.sample_height(p.x, p.z)) {
+                                return true;
+                        }
+                }
+                return false;
+        };
+        size_t marched_hits = 0;
+        auto start = std::chrono::steady_clock::now();
+        for (int i = 0; i < 200; i++) {
+                TerrainRay ray = random_ray(300.0f);
+                TerrainHit hit;
+                float t;
+                bool marched = march(ray, t);
+                bool found = query.intersect(ray, hit);
+                marched_hits += marched;
+                if (marched && (!found || hit.distance > t ||
+                                hit.distance < t - step)) {
+                        std::cout << "Height query misses a ray\n";
+                        return 1;
+                }
+                /* Marching can step over a graze */
+                if (found &&
+                    std::abs(hit.position.y -
+                             query.sample_height(hit.position.x,
+                                                 hit.position.z)) > 1e-2f) {
+                        std::cout << "Height query hit is off the ground\n";
+                        return 1;
+                }
+                if (found && !query.line_of_sight(ray.origin, hit.position)) {
+                        std::cout << "Height query can't see a hit\n";
+                        return 1;
+                }
+        }
+        double march_us = std::chrono::duration<double, std::micro>(
+                                  std::chrono::steady_clock::now() - start)
+                                  .count() /
+                          200;
+
+        std::vector<TerrainRay> rays;
+        for (int i = 0; i < 20000; i++) {
+                rays.push_back(random_ray(2000.0f));
+        }
+        std::vector<TerrainHit> hits(rays.size());
+        start = std::chrono::steady_clock::now();
+        size_t hit_count = query.intersect(rays.data(), rays.size(),
+                                           hits.data());
+        double ray_us = std::chrono::duration<double, std::micro>(
+                                std::chrono::steady_clock::now() - start)
+                                .count() /
+                        rays.size();
+        std::cout << "Height query: " << ray_us << " us per ray, "
+                  << march_us << " us marching, " << marched_hits
+                  << "/200 marched and " << hit_count << "/" << rays.size()
+                  << " batched rays hit\n";
+        if (marched_hits == 0 || hit_count == 0) {
+                std::cout << "Height query rays never hit\n";
+                return 1;
+        }
+        return 0;
+}
+
+int test_viewshed() {
+        Heightmap map = create_heightmap(1024, 1024, 42);
+        HeightQuery query{map};
+        const float step = TERRAIN_HEIGHT_SCALE / 255.0f;
+        /* The highest texel near the middle, looking out over the island */
+        Observer observer{{512, 512}, 2.0f, 300.0f};
+        for (int z = 412; z < 612; z++) {
+                for (int x = 412; x < 612; x++) {
+                        if (map.at(x, z) > map.at(observer.cell.x,
+                                                  observer.cell.y)) {
+                                observer.cell = {x, z};
+                        }
+                }
+        }
+        auto start = std::chrono::steady_clock::now();
+        VisibilityMask mask = viewshed(map, observer);
+        double ms = std::chrono::duration<double, std::milli>(
+                            std::chrono::steady_clock::now() - start)
+                            .count();
+
+        /* R2 rounds to the texel nearest each ray, so it only mostly
+         * agrees with exact sight lines */
+        glm::vec3 eye(observer.cell.x,
+                      map.at(observer.cell.x, observer.cell.y) * step +
+                              observer.height,
+                      observer.cell.y);
+        std::mt19937 rng{3};
+        int checked = 0, agreed = 0;
+        while (checked < 2000) {
+                int x = observer.cell.x + static_cast<int>(rng() % 601) - 300;
+                int z = observer.cell.y + static_cast<int>(rng() % 601) - 300;
+                float dx = x - eye.x, dz = z - eye.z;
+                if (x < 0 || z < 0 || x >= 1024 || z >= 1024 ||
+                    dx * dx + dz * dz > 290.0f * 290.0f) {
+                        continue;
+                }
+                glm::vec3 target(x, map.at(x, z) * step + 0.01f, z);
+                checked++;
+                agreed += query.line_of_sight(eye, target) ==
+                          mask.visible(x, z);
+        }
+        std::cout << "Viewshed: " << mask.count() << " texels visible in "
+                  << ms << " ms, " << agreed * 100 / checked
+                  << "% agree with sight lines\n";
+        if (agreed < checked * 9 / 10) {
+                std::cout << "Viewshed disagrees with sight lines\n";
+                return 1;
+        }
+        if (mask.visible(observer.cell.x + 301, observer.cell.y)) {
+                std::cout << "Viewshed sees past its radius\n";
+                return 1;
+        }
+
+        std::vector<Observer> observers;
+        for (int i = 0; i < 6; i++) {
+                observers.push_back({{100 + i * 150, 200 + i * 120}, 5.0f});
+        }
+        std::vector<VisibilityMask> masks = viewsheds(map, observers, 3);
+        VisibilityMask expected{1024, 1024};
+        for (const VisibilityMask &m : masks) {
+                expected |= m;
+        }
+        if (masks[2].words != viewshed(map, observers[2]).words ||
+            combined_viewshed(map, observers, 4).words != expected.words ||
+            combined_viewshed(map, observers, 1).words != expected.words) {
+                std::cout << "Viewsheds change with the thread count\n";
+                return 1;
+        }
+        return 0;
+}
+
+/* Reads must match the source at every level, including past the edges,
+ * and only inflate the tiles they cover */
+int test_tiled_heightmap() {
+        Heightmap map = create_heightmap(1000, 700, 11);
+        HeightmapSource source{map};
+        std::string path = (std::filesystem::temp_directory_path() /
+                            "mapsim_test_world.msth")
+                                   .string();
+        std::string raw_path = path + ".raw";
+        TiledHeightmapSettings settings;
+        settings.tile_size = 64;
+        settings.threads = 3;
+        bool written = write_tiled_heightmap(path, source, settings);
+        settings.compress = false;
+        written = written && write_tiled_heightmap(raw_path, source, settings);
+        uintmax_t size = std::filesystem::file_size(path);
+        uintmax_t raw_size = std::filesystem::file_size(raw_path);
+
+        bool matches = written, cached = false, bad_rejected = false;
+        {
+                TiledHeightmap tiled{path, 8};
+                TiledHeightmap raw{raw_path};
+                matches = matches && tiled.valid() && raw.valid() &&
+                          tiled.width() == 1000 && tiled.height() == 700 &&
+                          tiled.levels() == 5;
+                std::mt19937 rng{5};
+                std::vector<unsigned char> expected, got, got_raw;
+                for (int i = 0; matches && i < 300; i++) {
+                        int level = rng() % 12;
+                        int w = 1 + rng() % 150, h = 1 + rng() % 150;
+                        int extent = (1100 >> std::min(level, 10)) + 1;
+                        int x = static_cast<int>(rng() % (2 * extent)) -
+                                extent / 2;
+                        int z = static_cast<int>(rng() % (2 * extent)) -
+                                extent / 2;
+                        expected.resize(static_cast<size_t>(w) * h);
+                        got.resize(expected.size());
+                        got_raw.resize(expected.size());
+                        source.read(level, x, z, w, h, expected.data());
+                        tiled.read(level, x, z, w, h, got.data());
+                        raw.read(level, x, z, w, h, got_raw.data());
+                        matches = got == expected && got_raw == expected;
+                }
+
+                /* Eight tiles fit the cache, a 2 x 2 block of them is
+                 * inflated once however often it is read */
+                TiledHeightmap fresh{path, 8};
+                std::vector<unsigned char> block(128 * 128);
+                for (int i = 0; i < 3; i++) {
+                        fresh.read(0, 64, 64, 128, 128, block.data());
+                }
+                cached = fresh.tiles_inflated() > 0 &&
+                         fresh.tiles_inflated() <= 4;
+
+                { std::ofstream{raw_path} << "not a tiled heightmap"; }
+                bad_rejected = !TiledHeightmap{raw_path}.valid();
+                /* As an interrupted copy would leave it */
+                std::filesystem::copy_file(
+                        path, raw_path,
+                        std::filesystem::copy_options::overwrite_existing);
+                std::filesystem::resize_file(raw_path, size / 2);
+                bad_rejected = bad_rejected &&
+                               !TiledHeightmap{raw_path}.valid() &&
+                               !std::filesystem::exists(path + ".tmp");
+        }
+        std::filesystem::remove(path);
+        std::filesystem::remove(raw_path);
+        std::cout << "Tiled heightmap: " << size << " bytes, " << raw_size
+                  << " raw\n";
+        if (!matches) {
+                std::cout << "Tiled heightmap reads differ from the source\n";
+                return 1;
+        }
+        if (size >= raw_size || !cached || !bad_rejected) {
+                std::cout << "Tiled heightmap failed\n";
+                return 1;
+        }
+        return 0;
+}
+
 int main() {
+        int failed = 0;
         test_perlin_noise();
-        return 0;
+        failed += test_heightmap_seed();
+        failed += test_mesh_optimization();
+        failed += test_overdraw_clusters();
+        failed += test_material_layers();
+        failed += test_lod_chain();
+        failed += test_vertex_quantization();
+        failed += test_texture_compression();
+        failed += test_scatter();
+        failed += test_frustum();
+        failed += test_cdlod();
+        failed += test_clipmap();
+        failed += test_terrain_mesh();
+        failed += test_height_query();
+        failed += test_viewshed();
+        failed += test_tiled_heightmap();
+        std::cout << (failed ? "FAILED\n" : "All tests passed\n");
+        return failed;
 }
\ No newline at end of file
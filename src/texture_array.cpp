@@ -0,0 +1,132 @@
+#include "texture_array.hpp"
+#include "gl_state.hpp"
+#include "trace.hpp"
+
+#include <algorithm>
+
+bool TextureArray::compatible(const GpuTexture &a, const GpuTexture &b) {
+        return a.loaded && b.loaded && a.width == b.width &&
+               a.height == b.height && a.levels == b.levels &&
+               a.internal_format == b.internal_format;
+}
+
+/* Client format and bytes per texel of the sized formats the texture
+ * manager uploads, 0 for block compressed ones */
+static GLenum pixel_format(GLenum internal_format, int &texel_size) {
+        switch (internal_format) {
+        case GL_R8:
+                texel_size = 1;
+                return GL_RED;
+        case GL_RG8:
+                texel_size = 2;
+                return GL_RG;
+        case GL_RGB8:
+                texel_size = 3;
+                return GL_RGB;
+        case GL_RGBA8:
+                texel_size = 4;
+                return GL_RGBA;
+        default:
+                texel_size = 0;
+                return 0;
+        }
+}
+
+TextureArray::TextureArray(const std::vector<const GpuTexture *> &textures) {
+        TRACE_FUNCTION();
+        if (textures.empty()) {
+                return;
+        }
+        const GpuTexture &first = *textures[0];
+        width = first.width;
+        height = first.height;
+        levels = first.levels;
+        layers = textures.size();
+        internal_format = first.internal_format;
+        int texel_size;
+        GLenum format = pixel_format(internal_format, texel_size);
+        bool compressed = texel_size == 0;
+
+        /* Compressed level sizes come from the first layer */
+        std::vector<GLint> level_sizes(levels);
+        GLState &state = GLState::instance();
+        state.bind_texture(GL_TEXTURE_2D, first.id);
+        for (int l = 0; l < levels; l++) {
+                int w = std::max(width >> l, 1), h = std::max(height >> l, 1);
+                if (compressed) {
+                        glGetTexLevelParameteriv(
+                                GL_TEXTURE_2D, l,
+                                GL_TEXTURE_COMPRESSED_IMAGE_SIZE,
+                                &level_sizes[l]);
+                } else {
+                        level_sizes[l] = w * h * texel_size;
+                }
+        }
+
+        glGenTextures(1, &id);
+        state.bind_texture(GL_TEXTURE_2D_ARRAY, id);
+        for (int l = 0; l < levels; l++) {
+                int w = std::max(width >> l, 1), h = std::max(height >> l, 1);
+                if (compressed) {
+                        glCompressedTexImage3D(GL_TEXTURE_2D_ARRAY, l,
+                                               internal_format, w, h, layers,
+                                               0, level_sizes[l] * layers,
+                                               NULL);
+                } else {
+                        glTexImage3D(GL_TEXTURE_2D_ARRAY, l, internal_format,
+                                     w, h, layers, 0, format,
+                                     GL_UNSIGNED_BYTE, NULL);
+                }
+        }
+
+        GLuint buffer;
+        glGenBuffers(1, &buffer);
+        state.bind_buffer(GL_PIXEL_PACK_BUFFER, buffer);
+        glBufferData(GL_PIXEL_PACK_BUFFER, level_sizes[0], NULL,
+                     GL_STREAM_COPY);
+        /* Bound for both, each level is read into it and unpacked from it */
+        state.bind_buffer(GL_PIXEL_UNPACK_BUFFER, buffer);
+        glPixelStorei(GL_PACK_ALIGNMENT, 1);
+        glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+        for (int layer = 0; layer < layers; layer++) {
+                for (int l = 0; l < levels; l++) {
+                        int w = std::max(width >> l, 1);
+                        int h = std::max(height >> l, 1);
+                        state.bind_texture(GL_TEXTURE_2D,
+                                           textures[layer]->id);
+                        if (compressed) {
+                                glGetCompressedTexImage(GL_TEXTURE_2D, l,
+                                                        (void *)0);
+                        } else {
+                                glGetTexImage(GL_TEXTURE_2D, l, format,
+                                              GL_UNSIGNED_BYTE, (void *)0);
+                        }
+                        state.bind_texture(GL_TEXTURE_2D_ARRAY, id);
+                        if (compressed) {
+                                glCompressedTexSubImage3D(
+                                        GL_TEXTURE_2D_ARRAY, l, 0, 0, layer, w,
+                                        h, 1, internal_format, level_sizes[l],
+                                        (void *)0);
+                        } else {
+                                glTexSubImage3D(GL_TEXTURE_2D_ARRAY, l, 0, 0,
+                                                layer, w, h, 1, format,
+                                                GL_UNSIGNED_BYTE, (void *)0);
+                        }
+                }
+        }
+        glPixelStorei(GL_PACK_ALIGNMENT, 4);
+        glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+        state.bind_buffer(GL_PIXEL_PACK_BUFFER, 0);
+        state.bind_buffer(GL_PIXEL_UNPACK_BUFFER, 0);
+        state.delete_buffer(buffer);
+
+        glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAX_LEVEL, levels - 1);
+        glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_S, GL_REPEAT);
+        glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_T, GL_REPEAT);
+        glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MIN_FILTER,
+                        GL_LINEAR_MIPMAP_LINEAR);
+        glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAG_FILTER,
+                        GL_LINEAR);
+}
+
+TextureArray::~TextureArray() { GLState::instance().delete_texture(id); }
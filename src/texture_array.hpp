@@ -0,0 +1,38 @@
+#ifndef TEXTURE_ARRAY_H
+#define TEXTURE_ARRAY_H
+
+#include <glad/glad.h>
+
+#include <vector>
+
+#include "texture_manager.hpp"
+
+/**
+ * GL_TEXTURE_2D_ARRAY holding copies of textures with the same size, format
+ * and mip count, one per layer, so meshes using any of them can be drawn
+ * with a single binding and a layer index.
+ *
+ * Layers are copied GPU side through a pixel buffer, reading each level
+ * of the source into it and unpacking it into the array, which works on
+ * GL 3.3 where glCopyImageSubData isn't available.
+ */
+class TextureArray {
+      public:
+        GLuint id{0};
+        int width{0};
+        int height{0};
+        int levels{0};
+        int layers{0};
+        GLenum internal_format{GL_RGBA8};
+
+        /* Every texture must be loaded and compatible with the first */
+        TextureArray(const std::vector<const GpuTexture *> &textures);
+        ~TextureArray();
+
+        TextureArray(const TextureArray &) = delete;
+        TextureArray &operator=(const TextureArray &) = delete;
+
+        static bool compatible(const GpuTexture &a, const GpuTexture &b);
+};
+
+#endif /* TEXTURE_ARRAY_H */
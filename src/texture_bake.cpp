@@ -0,0 +1,547 @@
+#include "texture_bake.hpp"
+#include "mapped_file.hpp"
+#include "trace.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <glm/glm.hpp>
+#include <iostream>
+
+static const unsigned char KTX_IDENTIFIER[12] = {0xAB, 'K',  'T',  'X',
+                                                 ' ',  '1',  '1',  0xBB,
+                                                 '\r', '\n', 0x1A, '\n'};
+static const char KTX_SOURCE_KEY[] = "mapsim.source";
+
+struct KtxHeader {
+        unsigned char identifier[12];
+        uint32_t endianness;
+        uint32_t gl_type;
+        uint32_t gl_type_size;
+        uint32_t gl_format;
+        uint32_t gl_internal_format;
+        uint32_t gl_base_internal_format;
+        uint32_t pixel_width;
+        uint32_t pixel_height;
+        uint32_t pixel_depth;
+        uint32_t array_elements;
+        uint32_t faces;
+        uint32_t mip_levels;
+        uint32_t key_value_bytes;
+};
+
+BlockFormat block_format_for_channels(int channels) {
+        switch (channels) {
+        case 1:
+                return BlockFormat::BC4;
+        case 2:
+                return BlockFormat::BC5;
+        case 3:
+                return BlockFormat::BC1;
+        default:
+                return BlockFormat::BC3;
+        }
+}
+
+bool block_format_is_s3tc(BlockFormat format) {
+        return format == BlockFormat::BC1 || format == BlockFormat::BC3;
+}
+
+size_t block_size(BlockFormat format) {
+        return format == BlockFormat::BC1 || format == BlockFormat::BC4 ? 8
+                                                                        : 16;
+}
+
+uint32_t block_gl_format(BlockFormat format) {
+        switch (format) {
+        case BlockFormat::BC1:
+                return 0x83F0; /* GL_COMPRESSED_RGB_S3TC_DXT1_EXT */
+        case BlockFormat::BC3:
+                return 0x83F3; /* GL_COMPRESSED_RGBA_S3TC_DXT5_EXT */
+        case BlockFormat::BC4:
+                return 0x8DBB; /* GL_COMPRESSED_RED_RGTC1 */
+        default:
+                return 0x8DBD; /* GL_COMPRESSED_RG_RGTC2 */
+        }
+}
+
+static uint32_t block_gl_base_format(BlockFormat format) {
+        switch (format) {
+        case BlockFormat::BC1:
+                return 0x1907; /* GL_RGB */
+        case BlockFormat::BC3:
+                return 0x1908; /* GL_RGBA */
+        case BlockFormat::BC4:
+                return 0x1903; /* GL_RED */
+        default:
+                return 0x8227; /* GL_RG */
+        }
+}
+
+static uint16_t pack_565(glm::vec3 c) {
+        int r = std::lround(glm::clamp(c.r, 0.0f, 255.0f) * 31.0f / 255.0f);
+        int g = std::lround(glm::clamp(c.g, 0.0f, 255.0f) * 63.0f / 255.0f);
+        int b = std::lround(glm::clamp(c.b, 0.0f, 255.0f) * 31.0f / 255.0f);
+        return (r << 11) | (g << 5) | b;
+}
+
+static glm::vec3 unpack_565(uint16_t c) {
+        int r = (c >> 11) & 31, g = (c >> 5) & 63, b = c & 31;
+        return {(r << 3) | (r >> 2), (g << 2) | (g >> 4), (b << 3) | (b >> 2)};
+}
+
+/* Endpoints are the two colors furthest apart along the principal axis of
+ * the block, found with a few rounds of power iteration */
+static void encode_color_block(const unsigned char rgba[64],
+                               unsigned char *out) {
+        glm::vec3 colors[16];
+        glm::vec3 mean{0.0f};
+        for (int i = 0; i < 16; i++) {
+                colors[i] = {rgba[i * 4], rgba[i * 4 + 1], rgba[i * 4 + 2]};
+                mean += colors[i];
+        }
+        mean /= 16.0f;
+
+        glm::mat3 covariance{0.0f};
+        for (const glm::vec3 &c : colors) {
+                glm::vec3 d = c - mean;
+                covariance += glm::outerProduct(d, d);
+        }
+        glm::vec3 axis{1.0f, 1.0f, 1.0f};
+        for (int i = 0; i < 4; i++) {
+                glm::vec3 next = covariance * axis;
+                float length = glm::length(next);
+                if (length == 0.0f) {
+                        break;
+                }
+                axis = next / length;
+        }
+
+        int lo = 0, hi = 0;
+        float lo_t = INFINITY, hi_t = -INFINITY;
+        for (int i = 0; i < 16; i++) {
+                float t = glm::dot(colors[i] - mean, axis);
+                if (t < lo_t) {
+                        lo_t = t;
+                        lo = i;
+                }
+                if (t > hi_t) {
+                        hi_t = t;
+                        hi = i;
+                }
+        }
+
+        uint16_t c0 = pack_565(colors[hi]);
+        uint16_t c1 = pack_565(colors[lo]);
+        /* c0 > c1 selects four colors, equal endpoints need no indices */
+        if (c0 < c1) {
+                std::swap(c0, c1);
+        }
+        uint32_t indices = 0;
+        if (c0 != c1) {
+                glm::vec3 palette[4] = {unpack_565(c0), unpack_565(c1)};
+                palette[2] = (2.0f * palette[0] + palette[1]) / 3.0f;
+                palette[3] = (palette[0] + 2.0f * palette[1]) / 3.0f;
+                for (int i = 0; i < 16; i++) {
+                        int best = 0;
+                        float best_distance = INFINITY;
+                        for (int p = 0; p < 4; p++) {
+                                glm::vec3 d = colors[i] - palette[p];
+                                float distance = glm::dot(d, d);
+                                if (distance < best_distance) {
+                                        best_distance = distance;
+                                        best = p;
+                                }
+                        }
+                        indices |= uint32_t(best) << (i * 2);
+                }
+        }
+        out[0] = c0 & 0xFF;
+        out[1] = c0 >> 8;
+        out[2] = c1 & 0xFF;
+        out[3] = c1 >> 8;
+        for (int i = 0; i < 4; i++) {
+                out[4 + i] = (indices >> (i * 8)) & 0xFF;
+        }
+}
+
+static void bc4_palette(int a0, int a1, int palette[8]) {
+        palette[0] = a0;
+        palette[1] = a1;
+        if (a0 > a1) {
+                for (int i = 1; i < 7; i++) {
+                        palette[i + 1] = ((7 - i) * a0 + i * a1) / 7;
+                }
+        } else {
+                for (int i = 1; i < 5; i++) {
+                        palette[i + 1] = ((5 - i) * a0 + i * a1) / 5;
+                }
+                palette[6] = 0;
+                palette[7] = 255;
+        }
+}
+
+/* One channel of the block, channel is the byte offset within a pixel */
+static void encode_channel_block(const unsigned char rgba[64], int channel,
+                                 unsigned char *out) {
+        int lo = 255, hi = 0;
+        for (int i = 0; i < 16; i++) {
+                lo = std::min<int>(lo, rgba[i * 4 + channel]);
+                hi = std::max<int>(hi, rgba[i * 4 + channel]);
+        }
+        uint64_t indices = 0;
+        if (hi != lo) {
+                int palette[8];
+                bc4_palette(hi, lo, palette);
+                for (int i = 0; i < 16; i++) {
+                        int value = rgba[i * 4 + channel];
+                        int best = 0;
+                        for (int p = 1; p < 8; p++) {
+                                if (std::abs(palette[p] - value) <
+                                    std::abs(palette[best] - value)) {
+                                        best = p;
+                                }
+                        }
+                        indices |= uint64_t(best) << (i * 3);
+                }
+        }
+        out[0] = hi;
+        out[1] = lo;
+        for (int i = 0; i < 6; i++) {
+                out[2 + i] = (indices >> (i * 8)) & 0xFF;
+        }
+}
+
+void encode_block(BlockFormat format, const unsigned char rgba[64],
+                  unsigned char *out) {
+        switch (format) {
+        case BlockFormat::BC1:
+                encode_color_block(rgba, out);
+                break;
+        case BlockFormat::BC3:
+                encode_channel_block(rgba, 3, out);
+                encode_color_block(rgba, out + 8);
+                break;
+        case BlockFormat::BC4:
+                encode_channel_block(rgba, 0, out);
+                break;
+        case BlockFormat::BC5:
+                encode_channel_block(rgba, 0, out);
+                encode_channel_block(rgba, 1, out + 8);
+                break;
+        }
+}
+
+static void decode_color_block(const unsigned char *block, bool four_colors,
+                               unsigned char rgba[64]) {
+        uint16_t c0 = block[0] | (block[1] << 8);
+        uint16_t c1 = block[2] | (block[3] << 8);
+        glm::vec3 palette[4] = {unpack_565(c0), unpack_565(c1)};
+        unsigned char alpha[4] = {255, 255, 255, 255};
+        if (four_colors || c0 > c1) {
+                palette[2] = (2.0f * palette[0] + palette[1]) / 3.0f;
+                palette[3] = (palette[0] + 2.0f * palette[1]) / 3.0f;
+        } else {
+                palette[2] = (palette[0] + palette[1]) / 2.0f;
+                palette[3] = glm::vec3{0.0f};
+                alpha[3] = 0;
+        }
+        uint32_t indices = block[4] | (block[5] << 8) | (block[6] << 16) |
+                           (uint32_t(block[7]) << 24);
+        for (int i = 0; i < 16; i++) {
+                int p = (indices >> (i * 2)) & 3;
+                rgba[i * 4] = std::lround(palette[p].r);
+                rgba[i * 4 + 1] = std::lround(palette[p].g);
+                rgba[i * 4 + 2] = std::lround(palette[p].b);
+                rgba[i * 4 + 3] = alpha[p];
+        }
+}
+
+static void decode_channel_block(const unsigned char *block, int channel,
+                                 unsigned char rgba[64]) {
+        int palette[8];
+        bc4_palette(block[0], block[1], palette);
+        uint64_t indices = 0;
+        for (int i = 0; i < 6; i++) {
+                indices |= uint64_t(block[2 + i]) << (i * 8);
+        }
+        for (int i = 0; i < 16; i++) {
+                rgba[i * 4 + channel] = palette[(indices >> (i * 3)) & 7];
+        }
+}
+
+void decode_block(BlockFormat format, const unsigned char *block,
+                  unsigned char rgba[64]) {
+        std::memset(rgba, 0, 64);
+        switch (format) {
+        case BlockFormat::BC1:
+                decode_color_block(block, false, rgba);
+                break;
+        case BlockFormat::BC3:
+                /* BC3 color blocks always use four colors */
+                decode_color_block(block + 8, true, rgba);
+                decode_channel_block(block, 3, rgba);
+                break;
+        case BlockFormat::BC4:
+                decode_channel_block(block, 0, rgba);
+                break;
+        case BlockFormat::BC5:
+                decode_channel_block(block, 0, rgba);
+                decode_channel_block(block + 8, 1, rgba);
+                break;
+        }
+}
+
+static void compress_level(const unsigned char *pixels, int width, int height,
+                           int channels, BlockFormat format,
+                           CompressedLevel &level) {
+        int blocks_x = (width + 3) / 4, blocks_y = (height + 3) / 4;
+        size_t size = block_size(format);
+        level.width = width;
+        level.height = height;
+        level.data.resize(size_t(blocks_x) * blocks_y * size);
+
+        unsigned char rgba[64];
+        for (int by = 0; by < blocks_y; by++) {
+                for (int bx = 0; bx < blocks_x; bx++) {
+                        /* Levels smaller than a block repeat their edge */
+                        for (int i = 0; i < 16; i++) {
+                                int x = std::min(bx * 4 + i % 4, width - 1);
+                                int y = std::min(by * 4 + i / 4, height - 1);
+                                const unsigned char *p =
+                                        pixels + (size_t(y) * width + x) *
+                                                         channels;
+                                for (int c = 0; c < 4; c++) {
+                                        rgba[i * 4 + c] =
+                                                c < channels ? p[c]
+                                                             : (c == 3 ? 255 : 0);
+                                }
+                        }
+                        encode_block(format, rgba,
+                                     level.data.data() +
+                                             (size_t(by) * blocks_x + bx) *
+                                                     size);
+                }
+        }
+}
+
+static std::vector<unsigned char> downsample(const unsigned char *pixels,
+                                             int width, int height,
+                                             int channels) {
+        int w = std::max(width / 2, 1), h = std::max(height / 2, 1);
+        std::vector<unsigned char> out(size_t(w) * h * channels);
+        for (int y = 0; y < h; y++) {
+                const unsigned char *row0 =
+                        pixels + size_t(std::min(y * 2, height - 1)) * width *
+                                         channels;
+                const unsigned char *row1 =
+                        pixels + size_t(std::min(y * 2 + 1, height - 1)) *
+                                         width * channels;
+                for (int x = 0; x < w; x++) {
+                        int x0 = std::min(x * 2, width - 1) * channels;
+                        int x1 = std::min(x * 2 + 1, width - 1) * channels;
+                        for (int c = 0; c < channels; c++) {
+                                int sum = row0[x0 + c] + row0[x1 + c] +
+                                          row1[x0 + c] + row1[x1 + c];
+                                out[(size_t(y) * w + x) * channels + c] =
+                                        (sum + 2) / 4;
+                        }
+                }
+        }
+        return out;
+}
+
+CompressedTexture compress_texture(const unsigned char *pixels, int width,
+                                   int height, int channels) {
+        TRACE_FUNCTION();
+        CompressedTexture texture;
+        texture.format = block_format_for_channels(channels);
+        texture.width = width;
+        texture.height = height;
+
+        std::vector<unsigned char> current;
+        const unsigned char *level_pixels = pixels;
+        int w = width, h = height;
+        while (true) {
+                texture.levels.emplace_back();
+                compress_level(level_pixels, w, h, channels, texture.format,
+                               texture.levels.back());
+                if (w == 1 && h == 1) {
+                        break;
+                }
+                current = downsample(level_pixels, w, h, channels);
+                level_pixels = current.data();
+                w = std::max(w / 2, 1);
+                h = std::max(h / 2, 1);
+        }
+        return texture;
+}
+
+std::string baked_texture_path(const std::string &source_path) {
+        return source_path + ".ktx";
+}
+
+bool write_ktx(const std::string &source_path,
+               const CompressedTexture &texture) {
+        TRACE_FUNCTION();
+        uint64_t source_size;
+        int64_t source_mtime;
+        if (!file_stamp(source_path, source_size, source_mtime)) {
+                return false;
+        }
+
+        KtxHeader header{};
+        std::memcpy(header.identifier, KTX_IDENTIFIER, 12);
+        header.endianness = 0x04030201;
+        header.gl_type_size = 1;
+        header.gl_internal_format = block_gl_format(texture.format);
+        header.gl_base_internal_format = block_gl_base_format(texture.format);
+        header.pixel_width = texture.width;
+        header.pixel_height = texture.height;
+        header.faces = 1;
+        header.mip_levels = texture.levels.size();
+
+        /* One key/value pair, the key with its terminator then the stamp */
+        uint32_t pair_size = sizeof(KTX_SOURCE_KEY) + 2 * sizeof(uint64_t);
+        uint32_t padding = (4 - pair_size % 4) % 4;
+        header.key_value_bytes = sizeof(uint32_t) + pair_size + padding;
+
+        /* Renamed into place once complete, an interrupted bake leaves no
+         * truncated file that every later load would decode around */
+        std::string path = baked_texture_path(source_path);
+        std::string temp_path = path + ".tmp";
+        std::ofstream out{temp_path, std::ios::binary};
+        if (!out.is_open()) {
+                std::cout << "Failed to open baked texture at path: "
+                          << temp_path << "\n";
+                return false;
+        }
+        static const char zeros[4] = {};
+        out.write(reinterpret_cast<const char *>(&header), sizeof(header));
+        out.write(reinterpret_cast<const char *>(&pair_size), sizeof(pair_size));
+        out.write(KTX_SOURCE_KEY, sizeof(KTX_SOURCE_KEY));
+        out.write(reinterpret_cast<const char *>(&source_size),
+                  sizeof(source_size));
+        out.write(reinterpret_cast<const char *>(&source_mtime),
+                  sizeof(source_mtime));
+        out.write(zeros, padding);
+        for (const CompressedLevel &level : texture.levels) {
+                /* Block sizes keep every level 4 byte aligned already */
+                uint32_t image_size = level.data.size();
+                out.write(reinterpret_cast<const char *>(&image_size),
+                          sizeof(image_size));
+                out.write(reinterpret_cast<const char *>(level.data.data()),
+                          level.data.size());
+        }
+        out.close();
+        std::error_code error;
+        if (!out.fail()) {
+                std::filesystem::rename(temp_path, path, error);
+        }
+        if (out.fail() || error) {
+                std::cout << "Failed to write baked texture at path: " << path
+                          << "\n";
+                std::filesystem::remove(temp_path, error);
+                return false;
+        }
+        return true;
+}
+
+static bool format_from_gl(uint32_t gl_format, BlockFormat &format) {
+        for (BlockFormat f : {BlockFormat::BC1, BlockFormat::BC3,
+                              BlockFormat::BC4, BlockFormat::BC5}) {
+                if (block_gl_format(f) == gl_format) {
+                        format = f;
+                        return true;
+                }
+        }
+        return false;
+}
+
+bool read_ktx(const std::string &source_path, CompressedTexture &texture) {
+        TRACE_FUNCTION();
+        MappedFile file{baked_texture_path(source_path)};
+        const unsigned char *bytes = file.data();
+        size_t size = file.size();
+        if (bytes == NULL || size < sizeof(KtxHeader)) {
+                return false;
+        }
+
+        KtxHeader header;
+        std::memcpy(&header, bytes, sizeof(header));
+        if (std::memcmp(header.identifier, KTX_IDENTIFIER, 12) != 0 ||
+            header.endianness != 0x04030201 || header.faces != 1 ||
+            !format_from_gl(header.gl_internal_format, texture.format) ||
+            sizeof(KtxHeader) + uint64_t{header.key_value_bytes} > size) {
+                return false;
+        }
+
+        /* Only our own stamp is looked at, other keys are skipped */
+        uint64_t source_size, stamp_size = 0;
+        int64_t source_mtime, stamp_mtime = 0;
+        const unsigned char *kv = bytes + sizeof(KtxHeader);
+        const unsigned char *kv_end = kv + header.key_value_bytes;
+        while (kv + sizeof(uint32_t) <= kv_end) {
+                uint32_t pair_size;
+                std::memcpy(&pair_size, kv, sizeof(pair_size));
+                kv += sizeof(pair_size);
+                if (pair_size > size_t(kv_end - kv)) {
+                        return false;
+                }
+                if (pair_size == sizeof(KTX_SOURCE_KEY) + 16 &&
+                    std::memcmp(kv, KTX_SOURCE_KEY, sizeof(KTX_SOURCE_KEY)) ==
+                            0) {
+                        std::memcpy(&stamp_size, kv + sizeof(KTX_SOURCE_KEY),
+                                    8);
+                        std::memcpy(&stamp_mtime,
+                                    kv + sizeof(KTX_SOURCE_KEY) + 8, 8);
+                }
+                kv += pair_size + (4 - pair_size % 4) % 4;
+        }
+        if (!file_stamp(source_path, source_size, source_mtime) ||
+            stamp_size != source_size || stamp_mtime != source_mtime) {
+                return false;
+        }
+
+        texture.width = header.pixel_width;
+        texture.height = header.pixel_height;
+        texture.levels.clear();
+        uint64_t offset = sizeof(KtxHeader) + header.key_value_bytes;
+        int w = texture.width, h = texture.height;
+        for (uint32_t l = 0; l < header.mip_levels; l++) {
+                uint32_t image_size;
+                if (offset + sizeof(image_size) > size) {
+                        return false;
+                }
+                std::memcpy(&image_size, bytes + offset, sizeof(image_size));
+                offset += sizeof(image_size);
+                size_t expected = size_t((w + 3) / 4) * ((h + 3) / 4) *
+                                  block_size(texture.format);
+                if (image_size != expected || offset + image_size > size) {
+                        return false;
+                }
+                texture.levels.push_back(
+                        {w, h,
+                         std::vector<unsigned char>(bytes + offset,
+                                                    bytes + offset +
+                                                            image_size)});
+                offset += image_size + (4 - image_size % 4) % 4;
+                w = std::max(w / 2, 1);
+                h = std::max(h / 2, 1);
+        }
+        return !texture.levels.empty();
+}
+
+bool read_baked_texture(const std::string &source_path, bool s3tc,
+                        CompressedTexture &texture) {
+        if (!read_ktx(source_path, texture)) {
+                return false;
+        }
+        if (!s3tc && block_format_is_s3tc(texture.format)) {
+                texture.levels.clear();
+                return false;
+        }
+        return true;
+}
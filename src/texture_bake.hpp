@@ -0,0 +1,74 @@
+#ifndef TEXTURE_BAKE_H
+#define TEXTURE_BAKE_H
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+/**
+ * Block compression of 8 bit images with a full mip chain, and a KTX 1.1
+ * container to keep the result next to the source as <image>.ktx.
+ *
+ * The format follows the channel count of the source:
+ *      1 channel   BC4 (RGTC1)
+ *      2 channels  BC5 (RGTC2), normal and other two channel maps
+ *      3 channels  BC1 (DXT1)
+ *      4 channels  BC3 (DXT5)
+ * RGTC is core since GL 3.0, S3TC needs EXT_texture_compression_s3tc. The
+ * KTX key/value data records the size and modification time of the source,
+ * a baked file that doesn't match is ignored and rebuilt.
+ */
+
+enum class BlockFormat : uint32_t { BC1, BC3, BC4, BC5 };
+
+struct CompressedLevel {
+        int width;
+        int height;
+        std::vector<unsigned char> data;
+};
+
+struct CompressedTexture {
+        BlockFormat format;
+        int width{0};
+        int height{0};
+        std::vector<CompressedLevel> levels;
+};
+
+BlockFormat block_format_for_channels(int channels);
+
+/* BC1 and BC3, which need EXT_texture_compression_s3tc */
+bool block_format_is_s3tc(BlockFormat format);
+
+/* Bytes per 4x4 block, 8 or 16 */
+size_t block_size(BlockFormat format);
+
+/* GL internal format enum, as stored in KTX files */
+uint32_t block_gl_format(BlockFormat format);
+
+/* Box filters the mip chain down to 1x1 and compresses every level */
+CompressedTexture compress_texture(const unsigned char *pixels, int width,
+                                   int height, int channels);
+
+/* Compresses one 4x4 block of RGBA pixels, row by row */
+void encode_block(BlockFormat format, const unsigned char rgba[64],
+                  unsigned char *out);
+
+/* Back to RGBA, BC4 fills red only and BC5 red and green */
+void decode_block(BlockFormat format, const unsigned char *block,
+                  unsigned char rgba[64]);
+
+std::string baked_texture_path(const std::string &source_path);
+
+bool write_ktx(const std::string &source_path,
+               const CompressedTexture &texture);
+
+/* False when there is no baked file or it is stale */
+bool read_ktx(const std::string &source_path, CompressedTexture &texture);
+
+/* read_ktx for a driver with or without S3TC. Without it a BC1 or BC3 file
+ * is passed over, so the source is decoded instead, and kept for drivers
+ * that have it. */
+bool read_baked_texture(const std::string &source_path, bool s3tc,
+                        CompressedTexture &texture);
+
+#endif /* TEXTURE_BAKE_H */
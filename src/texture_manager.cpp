@@ -0,0 +1,328 @@
+#include "texture_manager.hpp"
+#include "gl_state.hpp"
+#include "gl_stats.hpp"
+#include "trace.hpp"
+
+#include <algorithm>
+#include <cstring>
+#include <filesystem>
+#include <iostream>
+#include <limits>
+#include <stb_image.h>
+
+/* Neither queue may block, acquire runs on the render thread and the
+ * workers must never wait on it */
+TextureManager::TextureManager()
+        : jobs{std::numeric_limits<size_t>::max()},
+          decoded{std::numeric_limits<size_t>::max()} {}
+
+/* Set by shutdown and the manager's destructor, after which textures
+ * must touch neither the context nor the manager. Outside the manager
+ * since it is read after the manager is gone. */
+static bool shut_down = false;
+
+TextureManager::~TextureManager() {
+        stop_workers();
+        shut_down = true;
+}
+
+TextureManager &TextureManager::instance() {
+        static TextureManager manager;
+        return manager;
+}
+
+void TextureManager::stop_workers() {
+        jobs.close();
+        for (std::thread &worker : workers) {
+                worker.join();
+        }
+        workers.clear();
+        DecodedImage image;
+        while (decoded.try_pop(image)) {
+                stbi_image_free(image.pixels);
+        }
+        pending = 0;
+}
+
+void TextureManager::shutdown() {
+        stop_workers();
+        GLState::instance().delete_buffer(pbo);
+        textures.clear();
+        shut_down = true;
+}
+
+GpuTexture::~GpuTexture() {
+        if (shut_down) {
+                return;
+        }
+        GLState::instance().delete_texture(id);
+        TextureManager &manager = TextureManager::instance();
+        manager.bytes_in_use -= bytes;
+        manager.resident--;
+}
+
+static bool gl_has_extension(const char *name) {
+        GLint count = 0;
+        glGetIntegerv(GL_NUM_EXTENSIONS, &count);
+        for (GLint i = 0; i < count; i++) {
+                const char *extension = reinterpret_cast<const char *>(
+                        glGetStringi(GL_EXTENSIONS, i));
+                if (extension != NULL && std::strcmp(extension, name) == 0) {
+                        return true;
+                }
+        }
+        return false;
+}
+
+/* Runs on the GL thread before the first job, so the workers know which
+ * formats they may bake */
+void TextureManager::start_workers() {
+        has_s3tc = gl_has_extension("GL_EXT_texture_compression_s3tc");
+        unsigned count = std::max(2u, std::thread::hardware_concurrency()) - 1;
+        for (unsigned i = 0; i < count; i++) {
+                workers.emplace_back(&TextureManager::decode_loop, this);
+        }
+}
+
+void TextureManager::decode_loop() {
+        TRACE_THREAD_NAME("texture decode");
+        DecodeJob job;
+        while (jobs.pop(job)) {
+                TRACE_SCOPE("decode_texture");
+                DecodedImage image;
+                image.texture = job.texture;
+                image.path = job.path;
+                /* Nobody wants it anymore, don't bother reading the file */
+                if (job.texture.expired()) {
+                        decoded.push(std::move(image));
+                        continue;
+                }
+                if (job.compress &&
+                    read_baked_texture(job.path, job.s3tc, image.compressed)) {
+                        decoded.push(std::move(image));
+                        continue;
+                }
+                image.pixels = stbi_load(job.path.c_str(), &image.width,
+                                         &image.height, &image.channels, 0);
+                BlockFormat format = block_format_for_channels(image.channels);
+                if (image.pixels != NULL && job.compress &&
+                    (job.s3tc || !block_format_is_s3tc(format))) {
+                        image.compressed = compress_texture(
+                                image.pixels, image.width, image.height,
+                                image.channels);
+                        write_ktx(job.path, image.compressed);
+                        stbi_image_free(image.pixels);
+                        image.pixels = NULL;
+                }
+                decoded.push(std::move(image));
+        }
+}
+
+std::shared_ptr<GpuTexture> TextureManager::acquire(const std::string &path) {
+        std::error_code error;
+        std::string key = std::filesystem::weakly_canonical(path, error).string();
+        if (error) {
+                key = path;
+        }
+
+        /* Slots outlive their textures, sweep them once the map doubles */
+        if (textures.size() >= sweep_size) {
+                for (auto it = textures.begin(); it != textures.end();) {
+                        it = it->second.expired() ? textures.erase(it)
+                                                  : std::next(it);
+                }
+                sweep_size = std::max<size_t>(64, textures.size() * 2);
+        }
+
+        std::weak_ptr<GpuTexture> &slot = textures[key];
+        if (std::shared_ptr<GpuTexture> texture = slot.lock()) {
+                return texture;
+        }
+
+        auto texture = std::make_shared<GpuTexture>();
+        static const unsigned char placeholder[4] = {128, 128, 128, 255};
+        glGenTextures(1, &texture->id);
+        GLState::instance().bind_texture(GL_TEXTURE_2D, texture->id);
+        glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, 1, 1, 0, GL_RGBA,
+                     GL_UNSIGNED_BYTE, placeholder);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+        resident++;
+        slot = texture;
+
+        if (workers.empty()) {
+                start_workers();
+        }
+        pending++;
+        jobs.push({path, texture, use_compression, has_s3tc});
+        return texture;
+}
+
+void TextureManager::upload(DecodedImage &image) {
+        TRACE_FUNCTION();
+        std::shared_ptr<GpuTexture> texture = image.texture.lock();
+        if (!texture) {
+                return;
+        }
+        if (!image.compressed.levels.empty()) {
+                upload_compressed(image, *texture);
+                return;
+        }
+        if (image.pixels == NULL) {
+                std::cout << "Texture failed to load at path: " << image.path
+                          << std::endl;
+                return;
+        }
+
+        GLenum format, internal_format;
+        if (image.channels == 1) {
+                format = GL_RED;
+                internal_format = GL_R8;
+        } else if (image.channels == 2) {
+                format = GL_RG;
+                internal_format = GL_RG8;
+        } else if (image.channels == 3) {
+                format = GL_RGB;
+                internal_format = GL_RGB8;
+        } else {
+                format = GL_RGBA;
+                internal_format = GL_RGBA8;
+        }
+        size_t size = size_t(image.width) * image.height * image.channels;
+
+        /* Rows of one and three channel images aren't 4 byte aligned */
+        glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+        GLState &state = GLState::instance();
+        state.bind_texture(GL_TEXTURE_2D, texture->id);
+        bool staged = false;
+        if (use_pbo) {
+                if (pbo == 0) {
+                        glGenBuffers(1, &pbo);
+                }
+                state.bind_buffer(GL_PIXEL_UNPACK_BUFFER, pbo);
+                /* Orphaning lets the driver hand out fresh storage while the
+                 * previous upload may still be reading the old one */
+                pbo_size = std::max(pbo_size, size);
+                glBufferData(GL_PIXEL_UNPACK_BUFFER, pbo_size, NULL,
+                             GL_STREAM_DRAW);
+                void *mapped = glMapBufferRange(
+                        GL_PIXEL_UNPACK_BUFFER, 0, size,
+                        GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_BUFFER_BIT);
+                /* Unmapping fails if the storage was lost meanwhile */
+                if (mapped != NULL) {
+                        std::memcpy(mapped, image.pixels, size);
+                        staged = glUnmapBuffer(GL_PIXEL_UNPACK_BUFFER) ==
+                                 GL_TRUE;
+                }
+                if (staged) {
+                        glTexImage2D(GL_TEXTURE_2D, 0, internal_format,
+                                     image.width, image.height, 0, format,
+                                     GL_UNSIGNED_BYTE, (void *)0);
+                } else {
+                        std::cout << "Failed to map pixel buffer, uploading "
+                                  << image.path << " directly\n";
+                }
+                state.bind_buffer(GL_PIXEL_UNPACK_BUFFER, 0);
+        }
+        if (!staged) {
+                glTexImage2D(GL_TEXTURE_2D, 0, internal_format, image.width,
+                             image.height, 0, format, GL_UNSIGNED_BYTE,
+                             image.pixels);
+        }
+        glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+        GLStats::instance().count_upload(size);
+        glGenerateMipmap(GL_TEXTURE_2D);
+
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER,
+                        GL_LINEAR_MIPMAP_LINEAR);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+
+        texture->width = image.width;
+        texture->height = image.height;
+        texture->internal_format = internal_format;
+        texture->levels = 1;
+        for (int size = std::max(image.width, image.height); size > 1;
+             size /= 2) {
+                texture->levels++;
+        }
+        /* Drivers pad three channels out to four, mips add a third */
+        size_t texel = image.channels == 3 ? 4 : image.channels;
+        texture->bytes = size_t(image.width) * image.height * texel * 4 / 3;
+        texture->loaded = true;
+        bytes_in_use += texture->bytes;
+}
+
+/* Workers decode the source instead of a baked file in a format the driver
+ * lacks, the check here only keeps such a file from reaching GL */
+void TextureManager::upload_compressed(DecodedImage &image,
+                                       GpuTexture &texture) {
+        const CompressedTexture &compressed = image.compressed;
+        if (block_format_is_s3tc(compressed.format) && !has_s3tc) {
+                std::cout << "No S3TC support for baked texture: "
+                          << image.path << std::endl;
+                return;
+        }
+
+        GLState::instance().bind_texture(GL_TEXTURE_2D, texture.id);
+        size_t bytes = 0;
+        for (size_t l = 0; l < compressed.levels.size(); l++) {
+                const CompressedLevel &level = compressed.levels[l];
+                glCompressedTexImage2D(GL_TEXTURE_2D, l,
+                                       block_gl_format(compressed.format),
+                                       level.width, level.height, 0,
+                                       level.data.size(), level.data.data());
+                bytes += level.data.size();
+        }
+        GLStats::instance().count_upload(bytes);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL,
+                        compressed.levels.size() - 1);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER,
+                        GL_LINEAR_MIPMAP_LINEAR);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+
+        texture.width = compressed.width;
+        texture.height = compressed.height;
+        texture.internal_format = block_gl_format(compressed.format);
+        texture.levels = compressed.levels.size();
+        texture.bytes = bytes;
+        texture.loaded = true;
+        bytes_in_use += bytes;
+}
+
+/* Size of what upload has to push to the driver */
+static size_t upload_size(const CompressedTexture &compressed, int width,
+                          int height, int channels) {
+        if (compressed.levels.empty()) {
+                return size_t(width) * height * channels;
+        }
+        size_t bytes = 0;
+        for (const CompressedLevel &level : compressed.levels) {
+                bytes += level.data.size();
+        }
+        return bytes;
+}
+
+void TextureManager::upload_pending(size_t byte_budget) {
+        size_t used = 0;
+        DecodedImage image;
+        while (used < byte_budget && decoded.try_pop(image)) {
+                upload(image);
+                used += upload_size(image.compressed, image.width, image.height,
+                                    image.channels);
+                stbi_image_free(image.pixels);
+                pending--;
+        }
+}
+
+void TextureManager::finish_uploads() {
+        TRACE_FUNCTION();
+        DecodedImage image;
+        while (pending > 0 && decoded.pop(image)) {
+                upload(image);
+                stbi_image_free(image.pixels);
+                pending--;
+        }
+}
@@ -0,0 +1,136 @@
+#ifndef TEXTURE_MANAGER_H
+#define TEXTURE_MANAGER_H
+
+#include <glad/glad.h>
+
+#include <memory>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+#include "texture_bake.hpp"
+#include "work_queue.hpp"
+
+/* Bytes of decoded images uploaded per frame, about 2 RGBA 1024x1024 maps */
+const size_t TEXTURE_UPLOAD_BUDGET = 8 << 20;
+
+/* A texture uploaded by the TextureManager, deleted with its last owner
+ * unless TextureManager::shutdown already ran */
+class GpuTexture {
+      public:
+        GLuint id{0};
+        int width{0};
+        int height{0};
+        /* Estimated size on the GPU, including the mip chain */
+        size_t bytes{0};
+        /* Sized or compressed format and mip count once loaded */
+        GLenum internal_format{GL_RGBA8};
+        int levels{1};
+        /* False until the decoded image replaced the placeholder */
+        bool loaded{false};
+
+        GpuTexture() = default;
+        ~GpuTexture();
+
+        GpuTexture(const GpuTexture &) = delete;
+        GpuTexture &operator=(const GpuTexture &) = delete;
+};
+
+/**
+ * Process wide cache of image textures, so every file is decoded and
+ * uploaded once however many models use it.
+ *
+ * Textures are looked up by canonical path in a hash map. The map only
+ * holds weak references, a texture lives as long as somebody keeps the
+ * shared_ptr returned by acquire and is reloaded when asked for again
+ * after that.
+ *
+ * Files are decoded on a pool of worker threads. acquire hands out the
+ * texture name straight away with a one texel placeholder, the image is
+ * uploaded into it later by upload_pending, which the render loop calls
+ * once a frame with a byte budget. Everything but the decoding happens on
+ * the thread that owns the GL context.
+ *
+ * With compression on, workers load the baked <image>.ktx instead, baking
+ * and writing it first when it is missing or stale. Those textures arrive
+ * with their whole mip chain and skip glGenerateMipmap.
+ */
+class TextureManager {
+      public:
+        static TextureManager &instance();
+        ~TextureManager();
+
+        /* Starts loading the image at path unless it is already resident.
+         * A file that fails to load keeps the placeholder. */
+        std::shared_ptr<GpuTexture> acquire(const std::string &path);
+
+        /* Uploads decoded images until byte_budget is used up, always at
+         * least one so large images can't stall forever */
+        void upload_pending(size_t byte_budget = TEXTURE_UPLOAD_BUDGET);
+
+        /* Waits for every requested texture to be decoded and uploaded */
+        void finish_uploads();
+
+        /* Stops the workers and frees the manager's GL objects, call it
+         * before the context goes away. Textures still alive afterwards,
+         * or destroyed after the manager itself, leave their names to the
+         * dying context. */
+        void shutdown();
+
+        /* Stage uploads through a pixel unpack buffer */
+        void set_use_pbo(bool use) { use_pbo = use; }
+
+        /* Use block compressed textures, on by default */
+        void set_compression(bool use) { use_compression = use; }
+
+        /* Bytes held by textures that are still alive */
+        size_t vram_bytes() const { return bytes_in_use; }
+        size_t texture_count() const { return resident; }
+        size_t pending_count() const { return pending; }
+
+      private:
+        struct DecodeJob {
+                std::string path;
+                std::weak_ptr<GpuTexture> texture;
+                bool compress;
+                bool s3tc;
+        };
+
+        struct DecodedImage {
+                std::weak_ptr<GpuTexture> texture;
+                std::string path;
+                unsigned char *pixels{NULL};
+                int width{0};
+                int height{0};
+                int channels{0};
+                /* Used instead of pixels when it has levels */
+                CompressedTexture compressed;
+        };
+
+        std::unordered_map<std::string, std::weak_ptr<GpuTexture>> textures;
+        /* Map size at which acquire next drops expired slots */
+        size_t sweep_size{64};
+        size_t bytes_in_use{0};
+        size_t resident{0};
+        size_t pending{0};
+        bool use_pbo{false};
+        bool use_compression{true};
+        bool has_s3tc{false};
+        GLuint pbo{0};
+        size_t pbo_size{0};
+
+        WorkQueue<DecodeJob> jobs;
+        WorkQueue<DecodedImage> decoded;
+        std::vector<std::thread> workers;
+
+        TextureManager();
+        void start_workers();
+        void stop_workers();
+        void decode_loop();
+        void upload(DecodedImage &image);
+        void upload_compressed(DecodedImage &image, GpuTexture &texture);
+        friend class GpuTexture;
+};
+
+#endif /* TEXTURE_MANAGER_H */
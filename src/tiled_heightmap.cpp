@@ -0,0 +1,301 @@
+#include "tiled_heightmap.hpp"
+#include "parallel_for.hpp"
+#include "trace.hpp"
+
+#include <zlib.h>
+
+#include <algorithm>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+
+static const char TILED_HEIGHTMAP_MAGIC[4] = {'M', 'S', 'T', 'H'};
+
+static uint64_t align16(uint64_t offset) { return (offset + 15) & ~15ull; }
+
+int tiled_level_size(int size, int level) {
+        /* Every 2^l-th texel, plus the last one where it falls in between,
+         * which is where HeightSource clamps reads past the edge */
+        long long step = 1ll << level;
+        return static_cast<int>((size - 1 + step - 1) / step) + 1;
+}
+
+/* Levels down to the first that fits in one tile */
+static std::vector<TiledHeightmapLevel> level_layout(int width, int height,
+                                                     int tile_size) {
+        std::vector<TiledHeightmapLevel> levels;
+        uint64_t first_tile = 0;
+        for (int l = 0;; l++) {
+                TiledHeightmapLevel level;
+                level.width = tiled_level_size(width, l);
+                level.height = tiled_level_size(height, l);
+                level.tiles_x = (level.width + tile_size - 1) / tile_size;
+                level.tiles_z = (level.height + tile_size - 1) / tile_size;
+                level.first_tile = first_tile;
+                first_tile += uint64_t{level.tiles_x} * level.tiles_z;
+                levels.push_back(level);
+                if (level.tiles_x == 1 && level.tiles_z == 1) {
+                        return levels;
+                }
+        }
+}
+
+/* zlib when it saves anything, otherwise the texels as they are */
+static uint32_t encode_tile(const std::vector<unsigned char> &texels,
+                            const TiledHeightmapSettings &settings,
+                            std::vector<unsigned char> &stored) {
+        if (settings.compress) {
+                uLongf size = compressBound(texels.size());
+                stored.resize(size);
+                if (compress2(stored.data(), &size, texels.data(),
+                              texels.size(),
+                              settings.compression_level) == Z_OK &&
+                    size < texels.size()) {
+                        stored.resize(size);
+                        return TILE_ZLIB;
+                }
+        }
+        stored = texels;
+        return TILE_RAW;
+}
+
+bool write_tiled_heightmap(const std::string &path, const HeightSource &source,
+                           const TiledHeightmapSettings &settings) {
+        TRACE_FUNCTION();
+        const int tile_size = settings.tile_size;
+        if (tile_size < 16 || (tile_size & (tile_size - 1)) != 0) {
+                std::cout << "Tile size must be a power of two of at least "
+                             "16, not "
+                          << tile_size << "\n";
+                return false;
+        }
+        std::vector<TiledHeightmapLevel> levels =
+                level_layout(source.width(), source.height(), tile_size);
+        std::vector<TiledHeightmapTile> tiles(levels.back().first_tile + 1);
+
+        TiledHeightmapHeader header{};
+        std::memcpy(header.magic, TILED_HEIGHTMAP_MAGIC, 4);
+        header.version = TILED_HEIGHTMAP_VERSION;
+        header.width = source.width();
+        header.height = source.height();
+        header.tile_size = tile_size;
+        header.level_count = levels.size();
+
+        /* Written next to path and renamed over it once complete, so an
+         * interrupted bake never leaves a partial file at path */
+        std::string temp_path = path + ".tmp";
+        std::ofstream out{temp_path, std::ios::binary};
+        if (!out.is_open()) {
+                std::cout << "Failed to open tiled heightmap at path: "
+                          << temp_path << "\n";
+                return false;
+        }
+        /* The tile table is filled in once the tiles are written */
+        out.write(reinterpret_cast<const char *>(&header), sizeof(header));
+        out.write(reinterpret_cast<const char *>(levels.data()),
+                  levels.size() * sizeof(TiledHeightmapLevel));
+        uint64_t table_offset = out.tellp();
+        out.write(reinterpret_cast<const char *>(tiles.data()),
+                  tiles.size() * sizeof(TiledHeightmapTile));
+
+        const size_t tile_bytes = static_cast<size_t>(tile_size) * tile_size;
+        /* Scratch for each worker, level 0 has the most tiles per row */
+        std::vector<std::vector<unsigned char>> texels(
+                parallel_workers(levels[0].tiles_x, settings.threads),
+                std::vector<unsigned char>(tile_bytes));
+        std::vector<std::vector<unsigned char>> row;
+        for (const TiledHeightmapLevel &level : levels) {
+                int l = static_cast<int>(&level - levels.data());
+                row.resize(level.tiles_x);
+                for (uint32_t tz = 0; tz < level.tiles_z; tz++) {
+                        parallel_for(level.tiles_x, settings.threads,
+                                     [&](size_t tx, int worker) {
+                                TRACE_SCOPE("tiled_heightmap_tile");
+                                TiledHeightmapTile &tile =
+                                        tiles[level.first_tile +
+                                              tz * level.tiles_x + tx];
+                                source.read(l, tx * tile_size, tz * tile_size,
+                                            tile_size, tile_size,
+                                            texels[worker].data());
+                                tile.encoding = encode_tile(
+                                        texels[worker], settings, row[tx]);
+                                tile.stored_size = row[tx].size();
+                        });
+
+                        /* In order, so the file is the same for any
+                         * thread count */
+                        for (uint32_t tx = 0; tx < level.tiles_x; tx++) {
+                                static const char zeros[16] = {};
+                                uint64_t pos = out.tellp();
+                                out.write(zeros, align16(pos) - pos);
+                                tiles[level.first_tile + tz * level.tiles_x +
+                                      tx]
+                                        .offset = align16(pos);
+                                out.write(reinterpret_cast<const char *>(
+                                                  row[tx].data()),
+                                          row[tx].size());
+                        }
+                }
+        }
+
+        out.seekp(table_offset);
+        out.write(reinterpret_cast<const char *>(tiles.data()),
+                  tiles.size() * sizeof(TiledHeightmapTile));
+        out.close();
+        std::error_code error;
+        if (!out.fail()) {
+                std::filesystem::rename(temp_path, path, error);
+        }
+        if (out.fail() || error) {
+                std::cout << "Failed to write tiled heightmap at path: "
+                          << path << "\n";
+                std::filesystem::remove(temp_path, error);
+                return false;
+        }
+        return true;
+}
+
+TiledHeightmap::TiledHeightmap(const std::string &path, size_t cache_tiles)
+        : file{path}, cache_tiles{std::max<size_t>(cache_tiles, 1)} {
+        TRACE_SCOPE("TiledHeightmap::TiledHeightmap");
+        const unsigned char *bytes = file.data();
+        size_t size = file.size();
+        if (bytes == NULL || size < sizeof(TiledHeightmapHeader)) {
+                return;
+        }
+        std::memcpy(&header, bytes, sizeof(header));
+        int tile_size = header.tile_size;
+        if (std::memcmp(header.magic, TILED_HEIGHTMAP_MAGIC, 4) != 0 ||
+            header.version != TILED_HEIGHTMAP_VERSION || header.width == 0 ||
+            header.height == 0 || tile_size < 16 ||
+            (tile_size & (tile_size - 1)) != 0) {
+                return;
+        }
+
+        /* Must match what the writer would lay out for this size */
+        std::vector<TiledHeightmapLevel> expected =
+                level_layout(header.width, header.height, tile_size);
+        uint64_t table_offset = sizeof(TiledHeightmapHeader) +
+                                expected.size() * sizeof(TiledHeightmapLevel);
+        uint64_t tile_count = expected.back().first_tile + 1;
+        if (header.level_count != expected.size() ||
+            table_offset + tile_count * sizeof(TiledHeightmapTile) > size) {
+                return;
+        }
+        level_table.resize(expected.size());
+        std::memcpy(level_table.data(), bytes + sizeof(TiledHeightmapHeader),
+                    expected.size() * sizeof(TiledHeightmapLevel));
+        if (std::memcmp(level_table.data(), expected.data(),
+                        expected.size() * sizeof(TiledHeightmapLevel)) != 0) {
+                return;
+        }
+
+        /* Both tables are 8 byte aligned in a page aligned mapping */
+        tile_table = reinterpret_cast<const TiledHeightmapTile *>(
+                bytes + table_offset);
+        const uint64_t tile_bytes = uint64_t(tile_size) * tile_size;
+        for (uint64_t i = 0; i < tile_count; i++) {
+                const TiledHeightmapTile &tile = tile_table[i];
+                if (tile.offset > size ||
+                    tile.stored_size > size - tile.offset ||
+                    (tile.encoding == TILE_RAW &&
+                     tile.stored_size != tile_bytes) ||
+                    tile.encoding > TILE_ZLIB) {
+                        return;
+                }
+        }
+        is_valid = true;
+}
+
+const TiledHeightmapTile &TiledHeightmap::tile_entry(int l, int tx,
+                                                     int tz) const {
+        const TiledHeightmapLevel &level = level_table[l];
+        return tile_table[level.first_tile +
+                          uint64_t(tz) * level.tiles_x + tx];
+}
+
+TiledHeightmap::TileData TiledHeightmap::tile(int l, int tx, int tz) const {
+        const TiledHeightmapTile &entry = tile_entry(l, tx, tz);
+        const unsigned char *stored = file.data() + entry.offset;
+        if (entry.encoding == TILE_RAW) {
+                /* Owned by the mapping, nothing to keep alive */
+                return TileData(TileData(), stored);
+        }
+
+        uint64_t index = &entry - tile_table;
+        {
+                std::lock_guard<std::mutex> lock{cache_mutex};
+                auto found = cached.find(index);
+                if (found != cached.end()) {
+                        lru.splice(lru.begin(), lru, found->second);
+                        const auto &texels = found->second->texels;
+                        return TileData(texels, texels->data());
+                }
+        }
+
+        /* Inflated outside the lock, so threads reading other tiles
+         * don't wait on this one */
+        TRACE_SCOPE("inflate_tile");
+        uLongf size = uLongf(tile_size()) * tile_size();
+        auto texels = std::make_shared<std::vector<unsigned char>>(size);
+        if (uncompress(texels->data(), &size, stored, entry.stored_size) !=
+                    Z_OK ||
+            size != texels->size()) {
+                return NULL;
+        }
+
+        std::lock_guard<std::mutex> lock{cache_mutex};
+        inflated++;
+        auto found = cached.find(index);
+        if (found != cached.end()) {
+                /* Another thread got there first */
+                const auto &theirs = found->second->texels;
+                return TileData(theirs, theirs->data());
+        }
+        lru.push_front({index, texels});
+        cached[index] = lru.begin();
+        while (lru.size() > cache_tiles) {
+                cached.erase(lru.back().index);
+                lru.pop_back();
+        }
+        return TileData(texels, texels->data());
+}
+
+size_t TiledHeightmap::tiles_inflated() const {
+        std::lock_guard<std::mutex> lock{cache_mutex};
+        return inflated;
+}
+
+void TiledHeightmap::read(int level, int x, int z, int w, int h,
+                          unsigned char *out) const {
+        TRACE_FUNCTION();
+        /* Past the last level, every 2^(level - l)-th texel of it */
+        int l = std::min(level, levels() - 1);
+        long long step = 1ll << (level - l);
+        const TiledHeightmapLevel &stored = level_table[l];
+        const int size = tile_size();
+        auto texel = [step](int i, int last) {
+                return static_cast<int>(std::clamp<long long>(i * step, 0,
+                                                              last));
+        };
+
+        for (int row = 0; row < h; row++) {
+                int tz_texel = texel(z + row, stored.height - 1);
+                int tz = tz_texel / size;
+                size_t row_start = static_cast<size_t>(tz_texel % size) * size;
+                /* A row crosses few tiles, look each up once */
+                int current = -1;
+                TileData data;
+                for (int column = 0; column < w; column++) {
+                        int tx_texel = texel(x + column, stored.width - 1);
+                        int tx = tx_texel / size;
+                        if (tx != current) {
+                                data = tile(l, tx, tz);
+                                current = tx;
+                        }
+                        *out++ = data ? data.get()[row_start + tx_texel % size]
+                                      : 0;
+                }
+        }
+}
@@ -0,0 +1,143 @@
+#ifndef TILED_HEIGHTMAP_H
+#define TILED_HEIGHTMAP_H
+
+#include <cstddef>
+#include <cstdint>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "height_source.hpp"
+#include "mapped_file.hpp"
+
+/**
+ * Heightmaps far larger than memory, a 64k x 64k world is 4 GB of texels,
+ * kept on disk in square tiles and read through a memory mapping.
+ *
+ * Layout, in host byte order:
+ *      TiledHeightmapHeader
+ *      TiledHeightmapLevel[level_count]
+ *      TiledHeightmapTile[] of every level, row by row, level 0 first
+ *      tile data, each tile starting on a 16 byte boundary
+ *
+ * Level l holds the texels HeightSource::read returns for it, so reads at
+ * any level touch only the few tiles they cover instead of every 2^l-th
+ * texel of the full map. Levels go on halving until one tile covers the
+ * map, coarser reads sample the last one. Edge tiles are padded with the
+ * clamped texels the source returns past the map.
+ *
+ * Tiles are stored raw or zlib compressed, whichever is smaller, so open
+ * sea costs almost nothing. Raw tiles are read straight from the mapping,
+ * compressed ones are inflated into a cache holding the most recently used
+ * tiles, which is shared by every reader and safe to use from several
+ * threads.
+ */
+
+const uint32_t TILED_HEIGHTMAP_VERSION = 1;
+const int TILED_HEIGHTMAP_TILE = 256;
+/* 16 MB of inflated 256 x 256 tiles */
+const size_t TILED_HEIGHTMAP_CACHE_TILES = 256;
+
+struct TiledHeightmapHeader {
+        char magic[4];
+        uint32_t version;
+        uint32_t width;
+        uint32_t height;
+        uint32_t tile_size;
+        uint32_t level_count;
+};
+
+struct TiledHeightmapLevel {
+        uint32_t width;
+        uint32_t height;
+        uint32_t tiles_x;
+        uint32_t tiles_z;
+        /* Index of the level's first tile in the tile table */
+        uint64_t first_tile;
+};
+
+enum TiledHeightmapEncoding : uint32_t {
+        TILE_RAW = 0,
+        TILE_ZLIB = 1,
+};
+
+struct TiledHeightmapTile {
+        uint64_t offset;
+        uint32_t stored_size;
+        uint32_t encoding;
+};
+
+struct TiledHeightmapSettings {
+        /* Power of two */
+        int tile_size{TILED_HEIGHTMAP_TILE};
+        /* False stores every tile raw */
+        bool compress{true};
+        /* zlib level, 1 is fastest */
+        int compression_level{1};
+        /* 0 uses every core */
+        int threads{0};
+};
+
+/* Texels of level l along a side of size map texels */
+int tiled_level_size(int size, int level);
+
+/**
+ * Bakes source into a tiled heightmap file. Tiles are read and compressed
+ * in parallel a row at a time, so memory stays at one row of tiles
+ * whatever the size of the map.
+ */
+bool write_tiled_heightmap(const std::string &path, const HeightSource &source,
+                           const TiledHeightmapSettings &settings = {});
+
+class TiledHeightmap : public HeightSource {
+      public:
+        /* Texels of one tile, tile_size rows of tile_size, kept alive as
+         * long as the pointer even if the cache lets go of the tile */
+        using TileData = std::shared_ptr<const unsigned char>;
+
+        /* Maps and validates the file, see valid() */
+        TiledHeightmap(const std::string &path,
+                       size_t cache_tiles = TILED_HEIGHTMAP_CACHE_TILES);
+
+        bool valid() const { return is_valid; }
+
+        int width() const override { return header.width; }
+        int height() const override { return header.height; }
+        void read(int level, int x, int z, int w, int h,
+                  unsigned char *out) const override;
+
+        int tile_size() const { return header.tile_size; }
+        int levels() const { return header.level_count; }
+        const TiledHeightmapLevel &level(int l) const { return level_table[l]; }
+        const TiledHeightmapTile &tile_entry(int l, int tx, int tz) const;
+
+        /* NULL when the tile doesn't inflate */
+        TileData tile(int l, int tx, int tz) const;
+
+        /* Tiles inflated so far, each miss of the cache counts once */
+        size_t tiles_inflated() const;
+
+      private:
+        MappedFile file;
+        bool is_valid{false};
+        TiledHeightmapHeader header{};
+        std::vector<TiledHeightmapLevel> level_table;
+        const TiledHeightmapTile *tile_table{};
+
+        /* Least recently used tiles at the back */
+        struct CachedTile {
+                uint64_t index;
+                std::shared_ptr<std::vector<unsigned char>> texels;
+        };
+        size_t cache_tiles;
+        mutable std::mutex cache_mutex;
+        mutable std::list<CachedTile> lru;
+        mutable std::unordered_map<uint64_t, std::list<CachedTile>::iterator>
+                cached;
+        mutable size_t inflated{0};
+};
+
+#endif /* TILED_HEIGHTMAP_H */
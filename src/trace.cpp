@@ -0,0 +1,144 @@
+#include "trace.hpp"
+
+#ifdef MAPSIM_TRACE
+
+#include <atomic>
+#include <chrono>
+#include <fstream>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+namespace trace {
+
+struct Event {
+        const char *name;
+        long long start;
+        long long duration;
+};
+
+struct ThreadBuffer {
+        /* Held by the owning thread to record, and by the session to clear
+         * or write out, so only contended while a session begins or ends */
+        std::mutex mutex;
+        int tid;
+        std::string name;
+        std::vector<Event> events;
+};
+
+static std::atomic<bool> active{false};
+static std::mutex registry_mutex;
+static std::vector<std::shared_ptr<ThreadBuffer>> registry;
+static std::string output_path;
+static std::chrono::steady_clock::time_point epoch;
+static int next_tid = 1;
+
+static long long now_us() {
+        return std::chrono::duration_cast<std::chrono::microseconds>(
+                       std::chrono::steady_clock::now() - epoch)
+                .count();
+}
+
+/*
+ * Each thread appends to its own buffer, so recording an event never waits
+ * on another thread's. The registry keeps the buffer alive after the
+ * thread exits.
+ */
+static ThreadBuffer &thread_buffer() {
+        thread_local std::shared_ptr<ThreadBuffer> buffer;
+        if (!buffer) {
+                buffer = std::make_shared<ThreadBuffer>();
+                std::lock_guard<std::mutex> lock{registry_mutex};
+                buffer->tid = next_tid++;
+                registry.push_back(buffer);
+        }
+        return *buffer;
+}
+
+static void write_escaped(std::ofstream &out, const char *s) {
+        for (; *s; s++) {
+                if (*s == '"' || *s == '\\') {
+                        out << '\\';
+                }
+                out << *s;
+        }
+}
+
+void begin_session(const char *path) {
+        std::lock_guard<std::mutex> lock{registry_mutex};
+        output_path = path;
+        epoch = std::chrono::steady_clock::now();
+        for (auto &buffer : registry) {
+                std::lock_guard<std::mutex> buffer_lock{buffer->mutex};
+                buffer->events.clear();
+        }
+        active = true;
+}
+
+void end_session() {
+        if (!active) {
+                return;
+        }
+        active = false;
+
+        std::lock_guard<std::mutex> lock{registry_mutex};
+        std::ofstream out{output_path};
+        if (!out.is_open()) {
+                std::cout << "Failed to open trace file at path: "
+                          << output_path << "\n";
+                return;
+        }
+
+        out << "{\"traceEvents\":[";
+        bool first = true;
+        for (auto &buffer : registry) {
+                std::lock_guard<std::mutex> buffer_lock{buffer->mutex};
+                if (!buffer->name.empty()) {
+                        out << (first ? "" : ",")
+                            << "\n{\"name\":\"thread_name\",\"ph\":\"M\","
+                               "\"pid\":1,\"tid\":"
+                            << buffer->tid << ",\"args\":{\"name\":\"";
+                        write_escaped(out, buffer->name.c_str());
+                        out << "\"}}";
+                        first = false;
+                }
+                for (const Event &e : buffer->events) {
+                        out << (first ? "" : ",") << "\n{\"name\":\"";
+                        write_escaped(out, e.name);
+                        out << "\",\"cat\":\"mapsim\",\"ph\":\"X\",\"ts\":"
+                            << e.start << ",\"dur\":" << e.duration
+                            << ",\"pid\":1,\"tid\":" << buffer->tid << "}";
+                        first = false;
+                }
+                buffer->events.clear();
+        }
+        out << "\n],\"displayTimeUnit\":\"ms\"}\n";
+}
+
+void set_thread_name(const char *name) {
+        ThreadBuffer &buffer = thread_buffer();
+        std::lock_guard<std::mutex> lock{buffer.mutex};
+        buffer.name = name;
+}
+
+Scope::Scope(const char *name) : name{name}, start{-1} {
+        if (active) {
+                start = now_us();
+        }
+}
+
+Scope::~Scope() {
+        if (start < 0 || !active) {
+                return;
+        }
+        long long end = now_us();
+        ThreadBuffer &buffer = thread_buffer();
+        std::lock_guard<std::mutex> lock{buffer.mutex};
+        buffer.events.push_back({name, start, end - start});
+}
+
+} // namespace trace
+
+#endif /* MAPSIM_TRACE */
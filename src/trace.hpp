@@ -0,0 +1,60 @@
+#ifndef TRACE_H
+#define TRACE_H
+
+/**
+ * Scoped instrumentation that writes Chrome trace-event JSON, viewable in
+ * chrome://tracing or ui.perfetto.dev.
+ *
+ * Tracing is compiled in only when MAPSIM_TRACE is defined, otherwise every
+ * macro expands to nothing. Events are buffered per thread and written out
+ * when the session ends.
+ *
+ *      TRACE_BEGIN_SESSION("trace.json");
+ *      {
+ *              TRACE_SCOPE("create_noise");
+ *              ...
+ *      }
+ *      TRACE_END_SESSION();
+ */
+
+#ifdef MAPSIM_TRACE
+
+namespace trace {
+void begin_session(const char *path);
+void end_session();
+void set_thread_name(const char *name);
+
+class Scope {
+      public:
+        Scope(const char *name);
+        ~Scope();
+
+        Scope(const Scope &) = delete;
+        Scope &operator=(const Scope &) = delete;
+
+      private:
+        const char *name;
+        long long start;
+};
+} // namespace trace
+
+#define TRACE_CONCAT_INNER(a, b) a##b
+#define TRACE_CONCAT(a, b) TRACE_CONCAT_INNER(a, b)
+
+#define TRACE_BEGIN_SESSION(path) trace::begin_session(path)
+#define TRACE_END_SESSION() trace::end_session()
+#define TRACE_THREAD_NAME(name) trace::set_thread_name(name)
+#define TRACE_SCOPE(name) trace::Scope TRACE_CONCAT(trace_scope_, __LINE__){name}
+#define TRACE_FUNCTION() TRACE_SCOPE(__func__)
+
+#else
+
+#define TRACE_BEGIN_SESSION(path) ((void)0)
+#define TRACE_END_SESSION() ((void)0)
+#define TRACE_THREAD_NAME(name) ((void)0)
+#define TRACE_SCOPE(name) ((void)0)
+#define TRACE_FUNCTION() ((void)0)
+
+#endif /* MAPSIM_TRACE */
+
+#endif /* TRACE_H */
@@ -0,0 +1,33 @@
+#ifndef VERTEX_H
+#define VERTEX_H
+
+#include <cstdint>
+#include <glm/glm.hpp>
+
+struct Vertex {
+        glm::vec3 position;
+        glm::vec3 normal;
+        glm::vec2 tex_coords;
+};
+
+/**
+ * Half the size of Vertex, for meshes drawn in large numbers.
+ *      position   unsigned 16 bit normalized, relative to a bounding box
+ *      normal     signed 10_10_10_2 normalized, w unused
+ *      tex_coords half floats
+ */
+struct PackedVertex {
+        uint16_t position[4];
+        uint32_t normal;
+        uint16_t tex_coords[2];
+};
+
+enum class VertexFormat { Float, Packed };
+
+/* Maps packed positions back to model space, offset + position * scale */
+struct VertexQuantization {
+        glm::vec3 offset{0.0f};
+        glm::vec3 scale{1.0f};
+};
+
+#endif /* VERTEX_H */
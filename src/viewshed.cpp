@@ -0,0 +1,135 @@
+#include "viewshed.hpp"
+#include "parallel_for.hpp"
+#include "terrain.hpp"
+#include "trace.hpp"
+
+#include <algorithm>
+#include <bitset>
+#include <cmath>
+#include <limits>
+
+static const float HEIGHT_STEP = TERRAIN_HEIGHT_SCALE / 255.0f;
+
+size_t VisibilityMask::count() const {
+        size_t visible = 0;
+        for (uint32_t word : words) {
+                visible += std::bitset<32>(word).count();
+        }
+        return visible;
+}
+
+VisibilityMask &VisibilityMask::operator|=(const VisibilityMask &other) {
+        for (size_t i = 0; i < words.size(); i++) {
+                words[i] |= other.words[i];
+        }
+        return *this;
+}
+
+/* One R2 ray from the observer to texel to, marking what it sees */
+static void trace_ray(const Heightmap &map, const Observer &observer,
+                      float eye, glm::ivec2 to, VisibilityMask &mask) {
+        glm::ivec2 delta = to - observer.cell;
+        /* Walk along the longer axis, a for major and b for minor */
+        bool along_x = std::abs(delta.x) >= std::abs(delta.y);
+        int a0 = along_x ? observer.cell.x : observer.cell.y;
+        int b0 = along_x ? observer.cell.y : observer.cell.x;
+        int da = along_x ? delta.x : delta.y;
+        int db = along_x ? delta.y : delta.x;
+        int b_last = (along_x ? map.height : map.width) - 1;
+        int steps = std::abs(da);
+        if (steps == 0) {
+                return;
+        }
+        int direction = da > 0 ? 1 : -1;
+        float slope = static_cast<float>(db) / steps;
+        if (observer.radius > 0.0f) {
+                float step_length = std::sqrt(1.0f + slope * slope);
+                steps = std::min(steps, static_cast<int>(observer.radius /
+                                                         step_length));
+        }
+        auto height = [&](int a, int b) -> float {
+                return along_x ? map.at(a, b) : map.at(b, a);
+        };
+
+        /* Slopes are rise over steps rather than distance, which only
+         * scales them along one ray */
+        float horizon = -std::numeric_limits<float>::infinity();
+        for (int k = 1; k <= steps; k++) {
+                int a = a0 + direction * k;
+                float b = b0 + slope * k;
+                /* Rounding can put the last step just off the map */
+                int b_low = std::clamp(static_cast<int>(std::floor(b)), 0,
+                                       b_last);
+                int b_high = std::min(b_low + 1, b_last);
+                float f = std::clamp(b - b_low, 0.0f, 1.0f);
+                int nearest = f < 0.5f ? b_low : b_high;
+
+                float target = height(a, nearest) * HEIGHT_STEP +
+                               observer.target_height;
+                if ((target - eye) / k >= horizon) {
+                        if (along_x) {
+                                mask.set(a, nearest);
+                        } else {
+                                mask.set(nearest, a);
+                        }
+                }
+                float ground = (height(a, b_low) * (1.0f - f) +
+                                height(a, b_high) * f) *
+                               HEIGHT_STEP;
+                horizon = std::max(horizon, (ground - eye) / k);
+        }
+}
+
+VisibilityMask viewshed(const Heightmap &map, const Observer &observer) {
+        TRACE_FUNCTION();
+        VisibilityMask mask{map.width, map.height};
+        glm::ivec2 o = observer.cell;
+        if (o.x < 0 || o.y < 0 || o.x >= map.width || o.y >= map.height) {
+                return mask;
+        }
+        float eye = map.at(o.x, o.y) * HEIGHT_STEP + observer.height;
+        mask.set(o.x, o.y);
+
+        int r = observer.radius > 0.0f
+                        ? static_cast<int>(std::ceil(observer.radius))
+                        : std::max(map.width, map.height);
+        int x0 = std::max(o.x - r, 0), x1 = std::min(o.x + r, map.width - 1);
+        int z0 = std::max(o.y - r, 0), z1 = std::min(o.y + r, map.height - 1);
+        for (int x = x0; x <= x1; x++) {
+                trace_ray(map, observer, eye, {x, z0}, mask);
+                trace_ray(map, observer, eye, {x, z1}, mask);
+        }
+        for (int z = z0 + 1; z < z1; z++) {
+                trace_ray(map, observer, eye, {x0, z}, mask);
+                trace_ray(map, observer, eye, {x1, z}, mask);
+        }
+        return mask;
+}
+
+std::vector<VisibilityMask> viewsheds(const Heightmap &map,
+                                      const std::vector<Observer> &observers,
+                                      int threads) {
+        TRACE_FUNCTION();
+        std::vector<VisibilityMask> masks(observers.size());
+        parallel_for(observers.size(), threads, [&](size_t i, int) {
+                masks[i] = viewshed(map, observers[i]);
+        });
+        return masks;
+}
+
+VisibilityMask combined_viewshed(const Heightmap &map,
+                                 const std::vector<Observer> &observers,
+                                 int threads) {
+        TRACE_FUNCTION();
+        /* One running union per worker, merged at the end */
+        int workers = parallel_workers(observers.size(), threads);
+        std::vector<VisibilityMask> unions(workers,
+                                           {map.width, map.height});
+        parallel_for(observers.size(), workers, [&](size_t i, int worker) {
+                unions[worker] |= viewshed(map, observers[i]);
+        });
+        for (int i = 1; i < workers; i++) {
+                unions[0] |= unions[i];
+        }
+        return unions[0];
+}
@@ -0,0 +1,87 @@
+#ifndef VIEWSHED_H
+#define VIEWSHED_H
+
+#include <glm/glm.hpp>
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include "heightmap.hpp"
+
+/**
+ * Which texels an observer standing on the map can see.
+ *
+ * Franklin's R2: a ray goes from the observer to every texel on the border
+ * of the area, stepping one texel at a time along its longer axis. At each
+ * step the ground height is interpolated between the two texels the ray
+ * passes, and the texel nearest the ray is visible if it rises above the
+ * steepest slope seen so far along the ray. Rays cover every texel at
+ * least once, a texel is visible if any ray sees it. The border has 8r
+ * texels for an area of 4r^2 and every ray is at most r long, so an
+ * observer costs a few steps per texel, linear in the area, where a ray to
+ * each texel would take r times that.
+ *
+ * Observers are independent and run in parallel, one per task. Heights
+ * are in terrain world units with texel x, z at world x, z, as for
+ * HeightQuery.
+ */
+
+struct Observer {
+        /* Texel the observer stands on */
+        glm::ivec2 cell;
+        /* Eye above the ground, in world units */
+        float height{2.0f};
+        /* In texels, nothing further is visible. 0 is the whole map. */
+        float radius{0.0f};
+        /* Height above the ground a target needs to be seen */
+        float target_height{0.0f};
+};
+
+/**
+ * One bit per texel, rows running up the map like the heightmap, each row
+ * padded to whole 32 bit words. Bit x % 32 of word x / 32 is texel x, the
+ * layout create_visibility_texture uploads as is.
+ */
+class VisibilityMask {
+      public:
+        int width{};
+        int height{};
+        int words_per_row{};
+        std::vector<uint32_t> words;
+
+        VisibilityMask() = default;
+        VisibilityMask(int width, int height)
+                : width{width}, height{height},
+                  words_per_row{(width + 31) / 32},
+                  words(static_cast<size_t>(words_per_row) * height) {}
+
+        bool visible(int x, int z) const {
+                uint32_t word =
+                        words[static_cast<size_t>(z) * words_per_row + x / 32];
+                return (word >> (x % 32)) & 1u;
+        }
+        void set(int x, int z) {
+                words[static_cast<size_t>(z) * words_per_row + x / 32] |=
+                        1u << (x % 32);
+        }
+
+        /* Number of visible texels */
+        size_t count() const;
+
+        VisibilityMask &operator|=(const VisibilityMask &other);
+};
+
+VisibilityMask viewshed(const Heightmap &map, const Observer &observer);
+
+/* One mask per observer, threads 0 uses every core */
+std::vector<VisibilityMask> viewsheds(const Heightmap &map,
+                                      const std::vector<Observer> &observers,
+                                      int threads = 0);
+
+/* Texels any of the observers can see */
+VisibilityMask combined_viewshed(const Heightmap &map,
+                                 const std::vector<Observer> &observers,
+                                 int threads = 0);
+
+#endif /* VIEWSHED_H */
@@ -0,0 +1,65 @@
+#ifndef WORK_QUEUE_H
+#define WORK_QUEUE_H
+
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+
+/**
+ * Fixed capacity multi-producer multi-consumer queue. push() blocks while the
+ * queue is full so a fast stage can't run ahead of a slow one, pop() blocks
+ * while it is empty and returns false once the queue is closed and drained.
+ * try_pop() is for consumers that must never wait, like the render loop.
+ */
+template <typename T>
+class WorkQueue {
+      public:
+        WorkQueue(size_t capacity) : capacity{capacity} {}
+
+        void push(T item) {
+                std::unique_lock<std::mutex> lock{mutex};
+                not_full.wait(lock, [this] { return items.size() < capacity; });
+                items.push_back(std::move(item));
+                not_empty.notify_one();
+        }
+
+        bool pop(T &item) {
+                std::unique_lock<std::mutex> lock{mutex};
+                not_empty.wait(lock, [this] { return !items.empty() || closed; });
+                if (items.empty()) {
+                        return false;
+                }
+                item = std::move(items.front());
+                items.pop_front();
+                not_full.notify_one();
+                return true;
+        }
+
+        bool try_pop(T &item) {
+                std::lock_guard<std::mutex> lock{mutex};
+                if (items.empty()) {
+                        return false;
+                }
+                item = std::move(items.front());
+                items.pop_front();
+                not_full.notify_one();
+                return true;
+        }
+
+        /* Called once every producer is done */
+        void close() {
+                std::lock_guard<std::mutex> lock{mutex};
+                closed = true;
+                not_empty.notify_all();
+        }
+
+      private:
+        size_t capacity;
+        bool closed{false};
+        std::deque<T> items;
+        std::mutex mutex;
+        std::condition_variable not_empty;
+        std::condition_variable not_full;
+};
+
+#endif /* WORK_QUEUE_H */